@@ -0,0 +1,92 @@
+#include "alloc_counter.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+//! Allocations of all counting threads
+std::atomic<std::uint64_t> allocations{0};
+
+//! True while the thread counts its allocations
+thread_local bool counting = false;
+
+/**
+ * @brief Allocates and counts the allocation.
+ * @param size Size in bytes
+ * @param alignment Alignment, 0 for the default one
+ */
+void* allocate(std::size_t size, std::size_t alignment) noexcept {
+  if (counting) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (size == 0) {
+    size = 1;
+  }
+  if (alignment <= alignof(std::max_align_t)) {
+    return std::malloc(size);
+  }
+  void* p = nullptr;
+  return posix_memalign(&p, alignment, size) == 0 ? p : nullptr;
+}
+
+/**
+ * @brief Allocates or throws std::bad_alloc.
+ * @param size Size in bytes
+ * @param alignment Alignment, 0 for the default one
+ */
+void* allocate_or_throw(std::size_t size, std::size_t alignment) {
+  if (auto p = allocate(size, alignment)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+} // namespace
+
+void count_allocations(bool enabled) {
+  counting = enabled;
+}
+
+std::uint64_t allocation_count() {
+  return allocations.load(std::memory_order_relaxed);
+}
+
+allocation_pause::allocation_pause() : was_enabled_(counting) {
+  counting = false;
+}
+
+allocation_pause::~allocation_pause() {
+  counting = was_enabled_;
+}
+
+void* operator new(std::size_t size) { return allocate_or_throw(size, 0); }
+void* operator new[](std::size_t size) { return allocate_or_throw(size, 0); }
+void* operator new(std::size_t size, std::align_val_t alignment) {
+  return allocate_or_throw(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+  return allocate_or_throw(size, static_cast<std::size_t>(alignment));
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return allocate(size, 0); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return allocate(size, 0); }
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+  return allocate(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+  return allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
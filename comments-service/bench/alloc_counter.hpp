@@ -0,0 +1,36 @@
+#ifndef ALLOC_COUNTER_HPP
+#define ALLOC_COUNTER_HPP
+
+#include <cstdint>
+
+/**
+ * @brief Enables or disables counting of the heap allocations of the calling thread.
+ *
+ * comments-bench replaces the global operator new, allocations of threads
+ * with counting enabled are added to one process-wide counter.
+ * @param enabled True to count
+ */
+void count_allocations(bool enabled);
+
+/**
+ * @brief Returns the number of counted heap allocations.
+ */
+std::uint64_t allocation_count();
+
+/**
+ * @brief Disables counting on the calling thread for its lifetime, used for
+ * work of a benchmark that should not be measured.
+ */
+class allocation_pause {
+ public:
+  allocation_pause();
+  ~allocation_pause();
+  allocation_pause(const allocation_pause&) = delete;
+  allocation_pause& operator=(const allocation_pause&) = delete;
+
+ private:
+  //! Counting state before the pause
+  bool was_enabled_;
+};
+
+#endif // ALLOC_COUNTER_HPP
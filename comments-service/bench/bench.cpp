@@ -0,0 +1,154 @@
+#include "bench.hpp"
+#include "alloc_counter.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief Registered microbenchmark.
+ */
+struct registered_benchmark {
+  const char* name;
+  bench_function function;
+};
+
+/**
+ * @brief Returns the registered microbenchmarks, in registration order.
+ */
+std::vector<registered_benchmark>& registry() {
+  static std::vector<registered_benchmark> benchmarks;
+  return benchmarks;
+}
+
+/**
+ * @brief Result of one measurement.
+ */
+struct measurement {
+  double ns_per_iteration = 0;
+  std::uint64_t iterations = 0;
+  std::uint64_t bytes_per_iteration = 0;
+  std::uint64_t items_per_iteration = 0;
+  double allocations_per_iteration = 0;
+};
+
+/**
+ * @brief Runs the benchmark with growing iteration counts until one run
+ * takes at least min_time.
+ * @param function Benchmark function
+ * @param min_time Minimum time of the measurement
+ */
+measurement measure(bench_function function, std::chrono::nanoseconds min_time) {
+  std::uint64_t iterations = 1;
+  while (true) {
+    bench_state state(iterations);
+    function(state);
+    auto elapsed = state.elapsed();
+
+    if (elapsed >= min_time || iterations >= (1ULL << 40)) {
+      measurement result;
+      result.ns_per_iteration = static_cast<double>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / iterations;
+      result.iterations = iterations;
+      result.bytes_per_iteration = state.bytes_per_iteration();
+      result.items_per_iteration = state.items_per_iteration();
+      result.allocations_per_iteration = static_cast<double>(state.allocations()) / iterations;
+      return result;
+    }
+
+    // Aim 40% over the minimum time, growing at most tenfold per attempt.
+    auto elapsed_ns = std::max<double>(1.0,
+      static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    auto target = static_cast<double>(iterations) * 1.4 * static_cast<double>(min_time.count()) / elapsed_ns;
+    iterations = std::clamp<std::uint64_t>(static_cast<std::uint64_t>(target), iterations + 1, iterations * 10);
+  }
+}
+
+/**
+ * @brief Formats a rate with a binary or decimal unit prefix.
+ * @param per_second Rate
+ * @param unit Unit
+ * @param binary True for Ki, Mi, Gi prefixes
+ */
+std::string format_rate(double per_second, const char* unit, bool binary) {
+  static const char* decimal_prefixes[] = {"", "k", "M", "G"};
+  static const char* binary_prefixes[] = {"", "Ki", "Mi", "Gi"};
+  const double step = binary ? 1024.0 : 1000.0;
+  int prefix = 0;
+  while (per_second >= step && prefix < 3) {
+    per_second /= step;
+    ++prefix;
+  }
+  char text[64];
+  std::snprintf(text, sizeof(text), "%.2f %s%s/s", per_second,
+    binary ? binary_prefixes[prefix] : decimal_prefixes[prefix], unit);
+  return text;
+}
+
+} // namespace
+
+bench_state::iterator bench_state::begin() {
+  started_ = true;
+  allocations_ = allocation_count();
+  count_allocations(true);
+  start_ = std::chrono::steady_clock::now();
+  return iterator(iterations_, this);
+}
+
+void bench_state::stop() {
+  stop_ = std::chrono::steady_clock::now();
+  count_allocations(false);
+  allocations_ = allocation_count() - allocations_;
+}
+
+bench_state::iterator bench_state::end() {
+  return iterator(0, this);
+}
+
+std::chrono::steady_clock::duration bench_state::elapsed() const {
+  return started_ ? stop_ - start_ : std::chrono::steady_clock::duration{};
+}
+
+int register_benchmark(const char* name, bench_function function) {
+  registry().push_back({name, function});
+  return static_cast<int>(registry().size());
+}
+
+int run_benchmarks(const micro_config& config) {
+  std::printf("%-40s %14s %14s %12s %22s\n", "benchmark", "ns/op", "iterations", "allocs/op", "rate");
+
+  bool found = false;
+  for (const auto& benchmark : registry()) {
+    if (!config.filter.empty() && std::string_view(benchmark.name).find(config.filter) == std::string_view::npos) {
+      continue;
+    }
+    found = true;
+
+    std::vector<measurement> results;
+    for (unsigned i = 0; i < std::max(config.repetitions, 1u); ++i) {
+      results.push_back(measure(benchmark.function, config.min_time));
+    }
+    std::sort(results.begin(), results.end(), [](const measurement& a, const measurement& b) {
+      return a.ns_per_iteration < b.ns_per_iteration;
+    });
+    const auto& median = results[results.size() / 2];
+
+    std::string rate;
+    if (median.bytes_per_iteration > 0) {
+      rate = format_rate(median.bytes_per_iteration * 1e9 / median.ns_per_iteration, "B", true);
+    } else if (median.items_per_iteration > 0) {
+      rate = format_rate(median.items_per_iteration * 1e9 / median.ns_per_iteration, "items", false);
+    }
+    std::printf("%-40s %14.1f %14llu %12.2f %22s\n", benchmark.name, median.ns_per_iteration,
+      static_cast<unsigned long long>(median.iterations), median.allocations_per_iteration,
+      rate.c_str());
+    std::fflush(stdout);
+  }
+
+  if (!found) {
+    std::fprintf(stderr, "No benchmark matches the filter: %s\n", config.filter.c_str());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,167 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Iteration state passed to a microbenchmark.
+ *
+ * The benchmark loops over the state, everything inside the loop is timed:
+ * @code
+ * void bm_example(bench_state& state) {
+ *   for (auto _ : state) {
+ *     do_not_optimize(work());
+ *   }
+ * }
+ * BENCHMARK(bm_example);
+ * @endcode
+ */
+class bench_state {
+ public:
+  /**
+   * @brief Iterator counting down the iterations of one run, stops the
+   * timer when the count reaches zero.
+   */
+  class iterator {
+   public:
+    //! Value of the loop variable, marked so the unused loop variable is not warned about
+    struct [[maybe_unused]] value {};
+
+    iterator(std::uint64_t remaining, bench_state* state) : remaining_(remaining), state_(state) {}
+    value operator*() const { return {}; }
+    iterator& operator++() { --remaining_; return *this; }
+    bool operator!=(const iterator&) const {
+      if (remaining_ != 0) {
+        return true;
+      }
+      state_->stop();
+      return false;
+    }
+
+   private:
+    std::uint64_t remaining_;
+    bench_state* state_;
+  };
+
+  /**
+   * @brief Constructor of the bench_state class.
+   * @param iterations Number of iterations of the run
+   */
+  explicit bench_state(std::uint64_t iterations) : iterations_(iterations) {}
+
+  /**
+   * @brief Starts the timer, called when the loop starts.
+   */
+  iterator begin();
+
+  /**
+   * @brief Returns the end of the loop.
+   */
+  iterator end();
+
+  /**
+   * @brief Returns the number of iterations of the run.
+   */
+  std::uint64_t iterations() const { return iterations_; }
+
+  /**
+   * @brief Sets the bytes processed by one iteration, reported as a rate.
+   * @param bytes Bytes per iteration
+   */
+  void set_bytes_per_iteration(std::uint64_t bytes) { bytes_per_iteration_ = bytes; }
+
+  /**
+   * @brief Sets the items processed by one iteration, reported as a rate.
+   * @param items Items per iteration
+   */
+  void set_items_per_iteration(std::uint64_t items) { items_per_iteration_ = items; }
+
+  /**
+   * @brief Returns the time spent in the loop.
+   */
+  std::chrono::steady_clock::duration elapsed() const;
+
+  /**
+   * @brief Returns the bytes processed by one iteration.
+   */
+  std::uint64_t bytes_per_iteration() const { return bytes_per_iteration_; }
+
+  /**
+   * @brief Returns the items processed by one iteration.
+   */
+  std::uint64_t items_per_iteration() const { return items_per_iteration_; }
+
+  /**
+   * @brief Returns the heap allocations made by the benchmark thread in the loop.
+   */
+  std::uint64_t allocations() const { return allocations_; }
+
+ private:
+  /**
+   * @brief Stops the timer and the allocation counting, called when the loop ends.
+   */
+  void stop();
+
+  //! Number of iterations
+  std::uint64_t iterations_;
+  //! Bytes processed by one iteration
+  std::uint64_t bytes_per_iteration_ = 0;
+  //! Items processed by one iteration
+  std::uint64_t items_per_iteration_ = 0;
+  //! Time the loop started
+  std::chrono::steady_clock::time_point start_;
+  //! Time the loop ended
+  std::chrono::steady_clock::time_point stop_;
+  //! True once the loop started
+  bool started_ = false;
+  //! Allocation count when the loop started, then the allocations of the loop
+  std::uint64_t allocations_ = 0;
+};
+
+//! Microbenchmark function
+using bench_function = void (*)(bench_state&);
+
+/**
+ * @brief Registers a microbenchmark, used through the BENCHMARK macro.
+ * @param name Name of the benchmark
+ * @param function Benchmark function
+ */
+int register_benchmark(const char* name, bench_function function);
+
+//! Registers the function as a microbenchmark at static initialization
+#define BENCHMARK(function) \
+  [[maybe_unused]] static const int function##_registration = register_benchmark(#function, function)
+
+/**
+ * @brief Keeps the compiler from optimizing the value away.
+ * @param value Value
+ */
+template <class T>
+inline void do_not_optimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/**
+ * @brief Settings of a microbenchmark run.
+ */
+struct micro_config {
+  //! Only benchmarks whose name contains the filter run, empty runs all
+  std::string filter;
+  //! Minimum time of one measurement
+  std::chrono::milliseconds min_time{500};
+  //! Number of measurements, the median is reported
+  unsigned repetitions = 3;
+};
+
+/**
+ * @brief Runs the registered microbenchmarks and prints one line per benchmark
+ * with the time and heap allocations per iteration.
+ * Returns the process exit code.
+ * @param config Run settings
+ */
+int run_benchmarks(const micro_config& config);
+
+#endif // BENCH_HPP
@@ -0,0 +1,606 @@
+#include "load.hpp"
+#include "memory_store.hpp"
+#include "server.hpp"
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+
+namespace {
+
+using load_clock = std::chrono::steady_clock;
+
+/**
+ * @brief Text of a mix entry split into literals and placeholders.
+ */
+class text_template {
+ public:
+  /**
+   * @brief Splits the text at the placeholders. Throws std::runtime_error
+   * on unknown placeholders.
+   * @param text Text
+   */
+  explicit text_template(std::string_view text) {
+    while (!text.empty()) {
+      auto open = text.find('{');
+      auto close = open == std::string_view::npos ? open : text.find('}', open);
+      auto name = close == std::string_view::npos ?
+        std::string_view{} : text.substr(open + 1, close - open - 1);
+
+      part placeholder;
+      if (name == "entity") {
+        placeholder.kind = part_kind::entity;
+      } else if (name.starts_with("entity_list:")) {
+        placeholder.kind = part_kind::entity_list;
+        placeholder.count = std::stoul(std::string(name.substr(12)));
+      } else {
+        // Braces of json bodies are literals.
+        auto literal_end = open == std::string_view::npos ? text.size() : open + 1;
+        append_literal(text.substr(0, literal_end));
+        text.remove_prefix(literal_end);
+        continue;
+      }
+
+      append_literal(text.substr(0, open));
+      parts_.push_back(std::move(placeholder));
+      text.remove_prefix(close + 1);
+    }
+  }
+
+  /**
+   * @brief Appends the text with the placeholders replaced.
+   * @param out Output buffer
+   * @param random Random generator
+   * @param entities Number of distinct entities
+   */
+  void render(std::string& out, std::mt19937_64& random, unsigned entities) const {
+    std::uniform_int_distribution<unsigned> entity(0, std::max(entities, 1u) - 1);
+    for (const auto& p : parts_) {
+      switch (p.kind) {
+        case part_kind::literal:
+          out.append(p.text);
+          break;
+        case part_kind::entity:
+          out.append("bench-").append(std::to_string(entity(random)));
+          break;
+        case part_kind::entity_list:
+          for (std::size_t i = 0; i < p.count; ++i) {
+            out.append(i == 0 ? "\"bench-" : ",\"bench-")
+              .append(std::to_string(entity(random))).push_back('"');
+          }
+          break;
+      }
+    }
+  }
+
+ private:
+  enum class part_kind { literal, entity, entity_list };
+
+  struct part {
+    part_kind kind = part_kind::literal;
+    std::string text;
+    std::size_t count = 0;
+  };
+
+  void append_literal(std::string_view text) {
+    if (text.empty()) {
+      return;
+    }
+    if (parts_.empty() || parts_.back().kind != part_kind::literal) {
+      parts_.push_back(part{});
+    }
+    parts_.back().text.append(text);
+  }
+
+  std::vector<part> parts_;
+};
+
+/**
+ * @brief Mix entry with its texts split at the placeholders.
+ */
+struct compiled_entry {
+  http::verb method;
+  text_template target;
+  std::vector<std::pair<std::string, text_template>> headers;
+  text_template body;
+  bool has_body;
+
+  explicit compiled_entry(const mix_entry& entry) :
+    method(entry.method), target(entry.target), body(entry.body), has_body(!entry.body.empty()) {
+    for (const auto& [name, value] : entry.headers) {
+      headers.emplace_back(name, text_template(value));
+    }
+  }
+};
+
+/**
+ * @brief Results of one mix entry on one connection.
+ */
+struct entry_stats {
+  //! Latencies of the answered requests in nanoseconds
+  std::vector<std::int64_t> latencies;
+  //! Answered requests with a status other than 2xx
+  std::uint64_t non_2xx = 0;
+  //! Requests that failed with a connection error or timeout
+  std::uint64_t failures = 0;
+};
+
+/**
+ * @brief Start, end of the warmup and end of a run.
+ */
+struct run_times {
+  load_clock::time_point start;
+  load_clock::time_point measure;
+  load_clock::time_point end;
+};
+
+/**
+ * @brief Keep-alive client connection sending requests of the mix.
+ *
+ * In a closed loop the next request is sent when the response arrives. In
+ * an open loop requests are scheduled with exponentially distributed gaps
+ * and latencies count from the scheduled time, so a stalled server is not
+ * hidden by requests that were never sent.
+ */
+class load_connection : public std::enable_shared_from_this<load_connection> {
+ public:
+  load_connection(net::io_context& ioc, const tcp::resolver::results_type& endpoints,
+    const std::vector<compiled_entry>& mix, const std::vector<double>& weights,
+    const load_config& config, const run_times& times, std::uint64_t seed, double rate) :
+    stream_(net::make_strand(ioc)),
+    timer_(stream_.get_executor()),
+    endpoints_(endpoints),
+    mix_(mix),
+    pick_(weights.begin(), weights.end()),
+    config_(config),
+    times_(times),
+    random_(seed),
+    stats_(mix.size()) {
+    if (rate > 0) {
+      gap_.emplace(rate);
+    }
+  }
+
+  /**
+   * @brief Starts sending requests.
+   */
+  void start() {
+    net::dispatch(stream_.get_executor(), [self = shared_from_this()] {
+      self->scheduled_ = self->times_.start;
+      self->schedule();
+    });
+  }
+
+  /**
+   * @brief Returns the results per mix entry, read after the run.
+   */
+  const std::vector<entry_stats>& stats() const { return stats_; }
+
+ private:
+  void schedule() {
+    if (!gap_) {
+      scheduled_ = load_clock::now();
+      if (scheduled_ >= times_.end) {
+        return close();
+      }
+      return send();
+    }
+
+    scheduled_ += std::chrono::duration_cast<load_clock::duration>(
+      std::chrono::duration<double>((*gap_)(random_)));
+    if (scheduled_ >= times_.end) {
+      return close();
+    }
+    timer_.expires_at(scheduled_);
+    timer_.async_wait([self = shared_from_this()](beast::error_code ec) {
+      if (!ec) {
+        self->send();
+      }
+    });
+  }
+
+  void send() {
+    current_ = static_cast<std::size_t>(pick_(random_));
+    build_request(mix_[current_]);
+
+    if (connected_) {
+      return write();
+    }
+    stream_.expires_after(std::chrono::seconds(10));
+    stream_.async_connect(endpoints_,
+      [self = shared_from_this()](beast::error_code ec, const tcp::endpoint&) {
+        if (ec) {
+          return self->fail();
+        }
+        self->stream_.socket().set_option(tcp::no_delay(true));
+        self->connected_ = true;
+        self->write();
+      });
+  }
+
+  void build_request(const compiled_entry& entry) {
+    request_ = {};
+    request_.method(entry.method);
+    request_.version(11);
+    std::string text;
+    entry.target.render(text, random_, config_.entities);
+    request_.target(text);
+    request_.set(http::field::host, config_.host);
+    request_.set(http::field::user_agent, "comments-bench");
+    for (const auto& [name, value] : entry.headers) {
+      text.clear();
+      value.render(text, random_, config_.entities);
+      request_.set(name, text);
+    }
+    if (entry.has_body) {
+      entry.body.render(request_.body(), random_, config_.entities);
+      request_.set(http::field::content_type, "application/json");
+    }
+    request_.keep_alive(true);
+    request_.prepare_payload();
+  }
+
+  void write() {
+    stream_.expires_after(std::chrono::seconds(10));
+    http::async_write(stream_, request_,
+      [self = shared_from_this()](beast::error_code ec, std::size_t) {
+        if (ec) {
+          return self->fail();
+        }
+        self->read();
+      });
+  }
+
+  void read() {
+    response_ = {};
+    http::async_read(stream_, buffer_, response_,
+      [self = shared_from_this()](beast::error_code ec, std::size_t) {
+        if (ec) {
+          return self->fail();
+        }
+        self->record();
+      });
+  }
+
+  void record() {
+    if (scheduled_ >= times_.measure) {
+      auto& stats = stats_[current_];
+      stats.latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        load_clock::now() - scheduled_).count());
+      if (response_.result_int() < 200 || response_.result_int() >= 300) {
+        ++stats.non_2xx;
+      }
+    }
+    if (!response_.keep_alive()) {
+      disconnect();
+    }
+    schedule();
+  }
+
+  void fail() {
+    if (scheduled_ >= times_.measure) {
+      ++stats_[current_].failures;
+    }
+    disconnect();
+
+    // Backs off briefly, so a server that is down is not hammered with connects.
+    timer_.expires_after(std::chrono::milliseconds(100));
+    timer_.async_wait([self = shared_from_this()](beast::error_code ec) {
+      if (!ec) {
+        self->schedule();
+      }
+    });
+  }
+
+  void disconnect() {
+    beast::error_code ec;
+    stream_.socket().shutdown(tcp::socket::shutdown_both, ec);
+    stream_.close();
+    buffer_.clear();
+    connected_ = false;
+  }
+
+  void close() {
+    if (connected_) {
+      disconnect();
+    }
+  }
+
+  beast::tcp_stream stream_;
+  net::steady_timer timer_;
+  const tcp::resolver::results_type& endpoints_;
+  const std::vector<compiled_entry>& mix_;
+  std::discrete_distribution<int> pick_;
+  const load_config& config_;
+  const run_times& times_;
+  std::mt19937_64 random_;
+  //! Gaps between requests of an open loop in seconds
+  std::optional<std::exponential_distribution<double>> gap_;
+  beast::flat_buffer buffer_;
+  http::request<http::string_body> request_;
+  http::response<http::string_body> response_;
+  //! Time the current request was scheduled
+  load_clock::time_point scheduled_;
+  //! Mix entry of the current request
+  std::size_t current_ = 0;
+  bool connected_ = false;
+  std::vector<entry_stats> stats_;
+};
+
+/**
+ * @brief Server started in process on a memory store.
+ */
+class local_server {
+ public:
+  /**
+   * @brief Fills a memory store and starts the server on a free port of 127.0.0.1.
+   * @param config Run settings
+   */
+  explicit local_server(const load_config& config) :
+    ioc_(static_cast<int>(std::max(config.server_threads, 1u))) {
+    log_config log;
+    log.level = boost::log::trivial::warning;
+    log.rotation_mb = 0;
+    init_log(log);
+
+    auto store = std::make_shared<memory_store>();
+    preload(*store, config);
+
+    auto context = std::make_shared<service_context>();
+    context->store = store;
+    context->cache = std::make_shared<response_cache>(cache_config{});
+    context->hub = std::make_shared<comment_hub>();
+    context->admission = std::make_shared<admission_control>(admission_config{});
+
+    acceptor_.emplace(make_acceptor(ioc_, tcp::endpoint{net::ip::make_address("127.0.0.1"), 0}, false));
+    http_server(*acceptor_, context);
+    for (unsigned i = 0; i < std::max(config.server_threads, 1u); ++i) {
+      threads_.emplace_back([this] { ioc_.run(); });
+    }
+  }
+
+  ~local_server() {
+    ioc_.stop();
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+    stop_log();
+  }
+
+  /**
+   * @brief Returns the port the server listens on.
+   */
+  unsigned short port() const { return acceptor_->local_endpoint().port(); }
+
+ private:
+  /**
+   * @brief Inserts config.preload comments into every entity of the placeholders.
+   * @param store Store
+   * @param config Run settings
+   */
+  static void preload(memory_store& store, const load_config& config) {
+    net::io_context ioc;
+    const std::string text =
+      "Preloaded comment of the load generator, about as long as a typical comment on a preset page.";
+    const auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+
+    for (unsigned e = 0; e < config.entities; ++e) {
+      auto entity = "bench-" + std::to_string(e);
+      for (unsigned i = 0; i < config.preload; ++i) {
+        comment_fields comment;
+        comment.entity = entity;
+        comment.comment_id = store.new_comment_id();
+        comment.author = "bench";
+        comment.created_by = i;
+        comment.text = text;
+        comment.created_time = now - i;
+        comment.updated_time = comment.created_time;
+        store.insert(comment, ioc.get_executor(), [](store_status) {});
+      }
+      ioc.run();
+      ioc.restart();
+    }
+  }
+
+  net::io_context ioc_;
+  std::optional<tcp::acceptor> acceptor_;
+  std::vector<std::thread> threads_;
+};
+
+/**
+ * @brief Returns the value at the percentile of sorted latencies.
+ * @param sorted Sorted latencies
+ * @param percentile Percentile between 0 and 1
+ */
+std::int64_t percentile_of(const std::vector<std::int64_t>& sorted, double percentile) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  auto rank = static_cast<std::size_t>(std::ceil(percentile * sorted.size()));
+  return sorted[std::clamp<std::size_t>(rank, 1, sorted.size()) - 1];
+}
+
+/**
+ * @brief Prints one result line.
+ * @param name Mix entry name
+ * @param stats Merged results
+ * @param seconds Measured time in seconds
+ */
+void print_stats(const std::string& name, entry_stats& stats, double seconds) {
+  auto& latencies = stats.latencies;
+  std::sort(latencies.begin(), latencies.end());
+  auto ms = [&](double p) { return percentile_of(latencies, p) / 1e6; };
+  std::printf("%-24s %10zu %8llu %8llu %10.1f %9.3f %9.3f %9.3f %9.3f %9.3f\n", name.c_str(),
+    latencies.size(), static_cast<unsigned long long>(stats.non_2xx),
+    static_cast<unsigned long long>(stats.failures), latencies.size() / seconds,
+    ms(0.5), ms(0.9), ms(0.99), ms(0.999), latencies.empty() ? 0.0 : latencies.back() / 1e6);
+}
+
+/**
+ * @brief Converts a mix line to a mix entry.
+ * @param line Json object
+ */
+mix_entry to_mix_entry(const nlohmann::json& line) {
+  mix_entry entry;
+  entry.target = line.at("target").get<std::string>();
+  entry.name = line.value("name", entry.target);
+  entry.weight = line.value("weight", 1.0);
+  auto method = line.value("method", std::string("GET"));
+  entry.method = http::string_to_verb(method);
+  if (entry.method == http::verb::unknown) {
+    throw std::runtime_error("Unknown method: " + method);
+  }
+  if (line.contains("headers")) {
+    for (const auto& [name, value] : line.at("headers").items()) {
+      entry.headers.emplace_back(name, value.get<std::string>());
+    }
+  }
+  if (line.contains("body")) {
+    const auto& body = line.at("body");
+    entry.body = body.is_string() ? body.get<std::string>() : body.dump();
+  }
+  return entry;
+}
+
+} // namespace
+
+std::vector<mix_entry> load_mix(const std::string& path) {
+  std::ifstream file(path);
+  if (!file) {
+    throw std::runtime_error("Cannot open the mix file: " + path);
+  }
+
+  std::vector<mix_entry> mix;
+  std::string line;
+  for (int number = 1; std::getline(file, line); ++number) {
+    if (line.empty() || line.front() == '#') {
+      continue;
+    }
+    try {
+      mix.push_back(to_mix_entry(nlohmann::json::parse(line)));
+    } catch (const std::exception& e) {
+      throw std::runtime_error(path + ":" + std::to_string(number) + ": " + e.what());
+    }
+  }
+  if (mix.empty()) {
+    throw std::runtime_error("The mix file has no requests: " + path);
+  }
+  return mix;
+}
+
+std::vector<mix_entry> default_mix() {
+  std::vector<mix_entry> mix(4);
+
+  mix[0].name = "first_page";
+  mix[0].weight = 70;
+  mix[0].target = "/comments";
+  mix[0].headers = {{"Entity", "{entity}"}, {"Pagination-Page", "1"}, {"Pagination-Per-Page", "20"}};
+
+  mix[1].name = "later_page";
+  mix[1].weight = 10;
+  mix[1].target = "/comments";
+  mix[1].headers = {{"Entity", "{entity}"}, {"Pagination-Page", "3"}, {"Pagination-Per-Page", "5"}};
+
+  mix[2].name = "bulk";
+  mix[2].weight = 10;
+  mix[2].method = http::verb::post;
+  mix[2].target = "/comments/bulk";
+  mix[2].body = "{\"entities\":[{entity_list:10}],\"limit\":3}";
+
+  mix[3].name = "make";
+  mix[3].weight = 10;
+  mix[3].method = http::verb::post;
+  mix[3].target = "/comments/make";
+  mix[3].headers = {{"Entity", "{entity}"}, {"Author", "bench"}, {"Created_by", "1"}};
+  mix[3].body = "{\"text\":\"Comment of the load generator\"}";
+
+  return mix;
+}
+
+int run_load(const load_config& config) {
+  auto mix = config.mix.empty() ? default_mix() : load_mix(config.mix);
+
+  std::optional<local_server> server;
+  std::string port = config.port;
+  if (config.self) {
+    server.emplace(config);
+    port = std::to_string(server->port());
+  }
+
+  std::vector<compiled_entry> compiled;
+  std::vector<double> weights;
+  for (const auto& entry : mix) {
+    compiled.emplace_back(entry);
+    weights.push_back(entry.weight);
+  }
+
+  net::io_context ioc(static_cast<int>(std::max(config.threads, 1u)));
+  auto endpoints = tcp::resolver(ioc).resolve(config.self ? "127.0.0.1" : config.host, port);
+
+  run_times times;
+  times.start = load_clock::now();
+  times.measure = times.start + config.warmup;
+  times.end = times.measure + config.duration;
+
+  const unsigned connections = std::max(config.connections, 1u);
+  std::seed_seq seeds{config.seed};
+  std::vector<std::uint32_t> connection_seeds(connections);
+  seeds.generate(connection_seeds.begin(), connection_seeds.end());
+
+  std::vector<std::shared_ptr<load_connection>> clients;
+  for (unsigned i = 0; i < connections; ++i) {
+    clients.push_back(std::make_shared<load_connection>(ioc, endpoints, compiled, weights,
+      config, times, connection_seeds[i], config.rate / connections));
+    clients.back()->start();
+  }
+
+  std::vector<std::thread> workers;
+  for (unsigned i = 1; i < std::max(config.threads, 1u); ++i) {
+    workers.emplace_back([&ioc] { ioc.run(); });
+  }
+  ioc.run();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  std::vector<entry_stats> merged(mix.size());
+  entry_stats total;
+  for (const auto& client : clients) {
+    for (std::size_t i = 0; i < mix.size(); ++i) {
+      const auto& stats = client->stats()[i];
+      for (auto* target : {&merged[i], &total}) {
+        target->latencies.insert(target->latencies.end(), stats.latencies.begin(), stats.latencies.end());
+        target->non_2xx += stats.non_2xx;
+        target->failures += stats.failures;
+      }
+    }
+  }
+
+  const double seconds = std::chrono::duration<double>(config.duration).count();
+  std::printf("%s loop, %u connections, %u client threads, %.0f s measured after %.0f s warmup\n",
+    config.rate > 0 ? "open" : "closed", connections, std::max(config.threads, 1u), seconds,
+    std::chrono::duration<double>(config.warmup).count());
+  std::printf("%-24s %10s %8s %8s %10s %9s %9s %9s %9s %9s\n", "request", "answered", "non-2xx",
+    "failed", "req/s", "p50 ms", "p90 ms", "p99 ms", "p999 ms", "max ms");
+  for (std::size_t i = 0; i < mix.size(); ++i) {
+    print_stats(mix[i].name, merged[i], seconds);
+  }
+  print_stats("total", total, seconds);
+
+  return total.latencies.empty() ? 1 : 0;
+}
@@ -0,0 +1,87 @@
+#ifndef LOAD_HPP
+#define LOAD_HPP
+
+#include <boost/beast/http.hpp>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Request of a traffic mix, one line of a mix file.
+ *
+ * The target, header values and body may contain placeholders replaced per
+ * request: {entity} by a random entity, {entity_list:N} by a json list of
+ * N random entities.
+ */
+struct mix_entry {
+  //! Name the latencies are reported under
+  std::string name;
+  //! Relative share of the requests
+  double weight = 1;
+  //! Method
+  boost::beast::http::verb method = boost::beast::http::verb::get;
+  //! Target
+  std::string target;
+  //! Additional headers
+  std::vector<std::pair<std::string, std::string>> headers;
+  //! Body, sent as application/json when not empty
+  std::string body;
+};
+
+/**
+ * @brief Settings of a load run.
+ */
+struct load_config {
+  //! Host of the server under load
+  std::string host = "127.0.0.1";
+  //! Port of the server under load
+  std::string port = "8080";
+  //! Starts the server in process on a memory store instead of using host and port
+  bool self = false;
+  //! Threads of the in-process server
+  unsigned server_threads = 1;
+  //! Mix file, empty uses the built-in mix
+  std::string mix;
+  //! Number of keep-alive connections
+  unsigned connections = 16;
+  //! Measured time
+  std::chrono::seconds duration{10};
+  //! Time before the measurement whose requests are not recorded
+  std::chrono::seconds warmup{2};
+  //! Requests per second over all connections, 0 runs a closed loop
+  double rate = 0;
+  //! Number of distinct entities of the placeholders
+  unsigned entities = 1000;
+  //! Comments inserted per entity into the in-process server before the run
+  unsigned preload = 20;
+  //! Threads of the load generator
+  unsigned threads = 1;
+  //! Seed of the random choices
+  std::uint64_t seed = 1;
+};
+
+/**
+ * @brief Reads a mix file with one json object per line:
+ * {"name", "weight", "method", "target", "headers", "body"}.
+ * Empty lines and lines starting with # are skipped. Throws
+ * std::runtime_error on malformed lines.
+ * @param path Path of the mix file
+ */
+std::vector<mix_entry> load_mix(const std::string& path);
+
+/**
+ * @brief Returns the mix used without a mix file, mostly page reads with
+ * some bulk reads and new comments.
+ */
+std::vector<mix_entry> default_mix();
+
+/**
+ * @brief Runs the load and prints the throughput and latency percentiles
+ * per mix entry. Returns the process exit code.
+ * @param config Run settings
+ */
+int run_load(const load_config& config);
+
+#endif // LOAD_HPP
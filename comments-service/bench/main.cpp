@@ -0,0 +1,174 @@
+#include "bench.hpp"
+#include "load.hpp"
+#include "logs.hpp"
+#include "schema.hpp"
+#include <charconv>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+
+namespace {
+
+/**
+ * @brief Converts an option value to an unsigned number.
+ * @param name Option name
+ * @param value Option value
+ */
+unsigned to_unsigned(std::string_view name, std::string_view value) {
+  unsigned result = 0;
+  auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+  if(ec != std::errc() || ptr != value.data() + value.size()) {
+    throw std::invalid_argument("Invalid value of " + std::string(name) + ": " + std::string(value));
+  }
+  return result;
+}
+
+/**
+ * @brief Splits host:port of --target.
+ * @param value Option value
+ * @param config Load settings
+ */
+void set_target(std::string_view value, load_config& config) {
+  auto colon = value.rfind(':');
+  if(colon == std::string_view::npos || colon == 0 || colon + 1 == value.size()) {
+    throw std::invalid_argument("Invalid value of --target: " + std::string(value));
+  }
+  config.host = std::string(value.substr(0, colon));
+  config.port = std::string(value.substr(colon + 1));
+}
+
+/**
+ * @brief Applies the option pairs following the mode.
+ * @param argc Number of arguments
+ * @param argv Arguments
+ * @param options Option setters by name
+ */
+void apply_options(int argc, char* argv[],
+  const std::unordered_map<std::string_view, std::function<void(std::string_view)>>& options) {
+  for(int i = 2; i < argc; i += 2) {
+    auto option = options.find(argv[i]);
+    if(option == options.end()) {
+      throw std::invalid_argument("Unknown option: " + std::string(argv[i]));
+    }
+    if(i + 1 >= argc) {
+      throw std::invalid_argument("Missing value of " + std::string(argv[i]));
+    }
+    option->second(argv[i + 1]);
+  }
+}
+
+/**
+ * @brief Prints command line usage.
+ * @param program Program name
+ */
+void print_usage(const char* program) {
+  std::cerr << "Usage: " << program << " micro [options]\n";
+  std::cerr << "       " << program << " load [options]\n";
+  std::cerr << "       " << program << " schema [options]\n";
+  std::cerr << "Micro options:\n";
+  std::cerr << "  --filter <text>          Only runs benchmarks whose name contains the text\n";
+  std::cerr << "  --min-time-ms <ms>       Minimum time of one measurement\n";
+  std::cerr << "  --repetitions <n>        Measurements per benchmark, the median is reported\n";
+  std::cerr << "Load options:\n";
+  std::cerr << "  --target <host:port>     Server under load\n";
+  std::cerr << "  --self <0|1>             Starts the server in process on a memory store\n";
+  std::cerr << "  --server-threads <n>     Threads of the in-process server\n";
+  std::cerr << "  --preload <n>            Comments per entity inserted into the in-process server\n";
+  std::cerr << "  --mix <file>             JSON lines mix of requests, see bench/mixes\n";
+  std::cerr << "  --connections <n>        Keep-alive connections\n";
+  std::cerr << "  --duration-s <s>         Measured time\n";
+  std::cerr << "  --warmup-s <s>           Time before the measurement\n";
+  std::cerr << "  --rate <n>               Requests per second of an open loop, 0 runs a closed loop\n";
+  std::cerr << "  --entities <n>           Distinct entities of the {entity} placeholders\n";
+  std::cerr << "  --threads <n>            Threads of the load generator\n";
+  std::cerr << "  --seed <n>               Seed of the random choices\n";
+  std::cerr << "Schema options:\n";
+  std::cerr << "  --db-hosts <hosts>       ScyllaDB contact points, comments_live must be migrated\n";
+  std::cerr << "  --rows <n>               Comments seeded into the partition\n";
+  std::cerr << "  --deleted-percent <n>    Share of the seeded comments that are deleted\n";
+  std::cerr << "  --reads <n>              Measured reads per schema and page\n";
+  std::cerr << "  --per-page <n>           Page size of the reads\n";
+  std::cerr << "  --concurrency <n>        Writes in flight while seeding\n";
+}
+
+} // namespace
+
+/**
+ * @brief Runs the microbenchmarks or the load generator.
+ */
+int main(int argc, char* argv[]) {
+  if(argc < 2) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const std::string_view mode = argv[1];
+  try {
+    if(mode == "micro") {
+      micro_config config;
+      apply_options(argc, argv, {
+        {"--filter", [&](std::string_view v) { config.filter = std::string(v); }},
+        {"--min-time-ms", [&](std::string_view v) { config.min_time = std::chrono::milliseconds(to_unsigned("--min-time-ms", v)); }},
+        {"--repetitions", [&](std::string_view v) { config.repetitions = to_unsigned("--repetitions", v); }}
+      });
+      // The server benchmarks log like the service, only warnings reach the console.
+      log_config log;
+      log.level = boost::log::trivial::warning;
+      log.rotation_mb = 0;
+      init_log(log);
+      auto result = run_benchmarks(config);
+      stop_log();
+      return result;
+    }
+
+    if(mode == "load") {
+      load_config config;
+      apply_options(argc, argv, {
+        {"--target", [&](std::string_view v) { set_target(v, config); }},
+        {"--self", [&](std::string_view v) { config.self = to_unsigned("--self", v) != 0; }},
+        {"--server-threads", [&](std::string_view v) { config.server_threads = to_unsigned("--server-threads", v); }},
+        {"--preload", [&](std::string_view v) { config.preload = to_unsigned("--preload", v); }},
+        {"--mix", [&](std::string_view v) { config.mix = std::string(v); }},
+        {"--connections", [&](std::string_view v) { config.connections = to_unsigned("--connections", v); }},
+        {"--duration-s", [&](std::string_view v) { config.duration = std::chrono::seconds(to_unsigned("--duration-s", v)); }},
+        {"--warmup-s", [&](std::string_view v) { config.warmup = std::chrono::seconds(to_unsigned("--warmup-s", v)); }},
+        {"--rate", [&](std::string_view v) { config.rate = to_unsigned("--rate", v); }},
+        {"--entities", [&](std::string_view v) { config.entities = to_unsigned("--entities", v); }},
+        {"--threads", [&](std::string_view v) { config.threads = to_unsigned("--threads", v); }},
+        {"--seed", [&](std::string_view v) { config.seed = to_unsigned("--seed", v); }}
+      });
+      return run_load(config);
+    }
+
+    if(mode == "schema") {
+      schema_bench_config config;
+      apply_options(argc, argv, {
+        {"--db-hosts", [&](std::string_view v) { config.db_hosts = std::string(v); }},
+        {"--rows", [&](std::string_view v) { config.rows = to_unsigned("--rows", v); }},
+        {"--deleted-percent", [&](std::string_view v) { config.deleted_percent = to_unsigned("--deleted-percent", v); }},
+        {"--reads", [&](std::string_view v) { config.reads = to_unsigned("--reads", v); }},
+        {"--per-page", [&](std::string_view v) { config.per_page = to_unsigned("--per-page", v); }},
+        {"--concurrency", [&](std::string_view v) { config.concurrency = to_unsigned("--concurrency", v); }}
+      });
+      log_config log;
+      log.level = boost::log::trivial::warning;
+      log.rotation_mb = 0;
+      init_log(log);
+      auto result = run_schema_bench(config);
+      stop_log();
+      return result;
+    }
+
+    throw std::invalid_argument("Unknown mode: " + std::string(mode));
+  }
+  catch(std::exception const& e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    if(dynamic_cast<const std::invalid_argument*>(&e) != nullptr) {
+      print_usage(argv[0]);
+    }
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,286 @@
+#include "bench.hpp"
+#include "json_writer.hpp"
+#include "memory_store.hpp"
+#include "metrics.hpp"
+#include "request_params.hpp"
+#include "response_cache.hpp"
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+namespace http = boost::beast::http;
+namespace net = boost::asio;
+
+namespace {
+
+//! Text of a typical comment
+const std::string plain_text =
+  "Really like the low end on this one, the filter envelope is great for "
+  "basslines. Tweaked the release a bit and it works nicely in my track, thanks for sharing!";
+
+//! Text with quotes, newlines and control characters that have to be escaped
+const std::string escaped_text =
+  "\"Quoted\"\tand\ttabbed\nmultiline\r\ntext with a \\backslash\\ and a bell \x07 "
+  "and some unicode: \xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82";
+
+/**
+ * @brief Returns a comment with the text.
+ * @param text Comment text
+ */
+comment_fields make_comment(std::string_view text) {
+  comment_fields comment;
+  comment.entity = "preset-12345";
+  comment.comment_id = CassUuid{0x11eeb6a53a9c11f0ULL, 0x8000123456789abcULL};
+  comment.author = "user4";
+  comment.created_by = 4;
+  comment.text = text;
+  comment.created_time = 1706531307174;
+  comment.updated_time = 1706531307174;
+  return comment;
+}
+
+/**
+ * @brief Returns the headers of a GET /comments request.
+ */
+http::request<http::string_body, request_fields> make_get_request() {
+  http::request<http::string_body, request_fields> request{http::verb::get, "/comments", 11};
+  request.set(http::field::host, "localhost");
+  request.set("Entity", "preset-12345");
+  request.set("Pagination-Page", "2");
+  request.set("Pagination-Per-Page", "20");
+  return request;
+}
+
+void bm_parse_get_comments_params(bench_state& state) {
+  auto request = make_get_request();
+  for (auto _ : state) {
+    do_not_optimize(parse_get_comments_params(request));
+  }
+}
+BENCHMARK(bm_parse_get_comments_params);
+
+void bm_parse_comment_key(bench_state& state) {
+  http::request<http::string_body, request_fields> request{http::verb::patch, "/comments/delete", 11};
+  request.set("Entity", "preset-12345");
+  request.set("Comment_id", "280f0208-b56a-4bb7-bcb1-a2f7988cf647");
+  request.set("Created_time", "1706531307174");
+  for (auto _ : state) {
+    do_not_optimize(parse_comment_key(request));
+  }
+}
+BENCHMARK(bm_parse_comment_key);
+
+/**
+ * @brief Returns a POST /comments/make body.
+ */
+std::string make_comment_body() {
+  std::string body = "{\"text\":";
+  append_json_string(body, plain_text);
+  body.push_back('}');
+  return body;
+}
+
+void bm_parse_comment_text(bench_state& state) {
+  auto body = make_comment_body();
+  state.set_bytes_per_iteration(body.size());
+  for (auto _ : state) {
+    do_not_optimize(parse_comment_text(body));
+  }
+}
+BENCHMARK(bm_parse_comment_text);
+
+// The body parsing used before parse_comment_text: a json tree of the whole body.
+void bm_parse_comment_body_tree(bench_state& state) {
+  auto body = make_comment_body();
+  state.set_bytes_per_iteration(body.size());
+  for (auto _ : state) {
+    auto json = nlohmann::json::parse(body);
+    do_not_optimize(json.value("text", ""));
+  }
+}
+BENCHMARK(bm_parse_comment_body_tree);
+
+void bm_parse_bulk_body(bench_state& state) {
+  std::string body = "{\"entities\":[";
+  for (int i = 0; i < 50; ++i) {
+    body.append(i == 0 ? "\"preset-" : ",\"preset-").append(std::to_string(i)).push_back('"');
+  }
+  body.append("],\"limit\":3}");
+
+  state.set_bytes_per_iteration(body.size());
+  for (auto _ : state) {
+    do_not_optimize(parse_bulk_params(nlohmann::json::parse(body), 100));
+  }
+}
+BENCHMARK(bm_parse_bulk_body);
+
+// append_comment shares its writer with append_comment_row, which needs
+// driver rows that cannot be built without a cluster.
+void bm_append_comment(bench_state& state) {
+  auto comment = make_comment(plain_text);
+  std::string out;
+  out.reserve(1024);
+  append_comment(out, comment);
+  state.set_bytes_per_iteration(out.size());
+
+  for (auto _ : state) {
+    out.clear();
+    append_comment(out, comment);
+    do_not_optimize(out.data());
+  }
+}
+BENCHMARK(bm_append_comment);
+
+void bm_append_comment_escaped(bench_state& state) {
+  auto comment = make_comment(escaped_text);
+  std::string out;
+  out.reserve(1024);
+  append_comment(out, comment);
+  state.set_bytes_per_iteration(out.size());
+
+  for (auto _ : state) {
+    out.clear();
+    append_comment(out, comment);
+    do_not_optimize(out.data());
+  }
+}
+BENCHMARK(bm_append_comment_escaped);
+
+// The row serialization used before append_comment_row: a json object per
+// row, dumped into the response.
+void bm_nlohmann_comment_dump(bench_state& state) {
+  auto comment = make_comment(plain_text);
+  char comment_id[CASS_UUID_STRING_LENGTH];
+  cass_uuid_string(comment.comment_id, comment_id);
+
+  std::string out;
+  for (auto _ : state) {
+    nlohmann::json row;
+    row["author"] = comment.author;
+    row["comment_id"] = comment_id;
+    row["created_by"] = comment.created_by;
+    row["created_time"] = comment.created_time;
+    row["entity"] = comment.entity;
+    row["text"] = comment.text;
+    row["updated_time"] = comment.updated_time;
+    out = row.dump();
+    do_not_optimize(out.data());
+  }
+  state.set_bytes_per_iteration(out.size());
+}
+BENCHMARK(bm_nlohmann_comment_dump);
+
+void bm_serialize_comments_response(bench_state& state) {
+  std::string page;
+  auto comment = make_comment(plain_text);
+  for (int i = 0; i < 20; ++i) {
+    page.push_back(i == 0 ? '[' : ',');
+    append_comment(page, comment);
+  }
+  page.push_back(']');
+
+  std::string out;
+  for (auto _ : state) {
+    http::response<http::string_body> response{http::status::ok, 11};
+    response.set(http::field::content_type, "application/json");
+    response.set(http::field::server, "presetshare.comments");
+    response.set("X-Request-Id", "123456");
+    response.set("Pagination-Current-Page", "1");
+    response.set("Pagination-Per-Page", "20");
+    response.set("Pagination-Total-Pages", "7");
+    response.set("Pagination-Total-Comments", "140");
+    response.body() = page;
+    response.content_length(response.body().size());
+
+    // Gathers the buffers the socket write would send.
+    out.clear();
+    http::response_serializer<http::string_body> serializer{response};
+    boost::beast::error_code ec;
+    do {
+      serializer.next(ec, [&](boost::beast::error_code&, const auto& buffers) {
+        for (auto buffer : boost::beast::buffers_range_ref(buffers)) {
+          out.append(static_cast<const char*>(buffer.data()), buffer.size());
+        }
+        serializer.consume(boost::beast::buffer_bytes(buffers));
+      });
+    } while (!ec && !serializer.is_done());
+    do_not_optimize(out.data());
+  }
+  state.set_bytes_per_iteration(out.size());
+}
+BENCHMARK(bm_serialize_comments_response);
+
+void bm_response_cache_hit(bench_state& state) {
+  response_cache cache(cache_config{});
+  auto page = std::make_shared<cached_page>();
+  page->body = std::string(4096, 'x');
+  cache.insert("preset-12345", 1, 20, cache.generation("preset-12345"), page);
+
+  for (auto _ : state) {
+    do_not_optimize(cache.find("preset-12345", 1, 20));
+  }
+}
+BENCHMARK(bm_response_cache_hit);
+
+void bm_record_latency(bench_state& state) {
+  auto duration = std::chrono::microseconds(250);
+  for (auto _ : state) {
+    record_latency(route_id::get_comments, phase_id::db_execute, duration);
+  }
+}
+BENCHMARK(bm_record_latency);
+
+/**
+ * @brief Returns a memory store with count comments of preset-12345.
+ * @param ioc io_context to complete the inserts on
+ * @param count Number of comments
+ */
+std::shared_ptr<memory_store> make_memory_store(net::io_context& ioc, int count) {
+  auto store = std::make_shared<memory_store>();
+  for (int i = 0; i < count; ++i) {
+    auto comment = make_comment(plain_text);
+    comment.comment_id = store->new_comment_id();
+    comment.created_time += i;
+    store->insert(comment, ioc.get_executor(), [](store_status) {});
+  }
+  ioc.run();
+  ioc.restart();
+  return store;
+}
+
+void bm_memory_store_list_page(bench_state& state) {
+  net::io_context ioc;
+  auto store = make_memory_store(ioc, 1000);
+
+  page_request request;
+  request.entity = "preset-12345";
+  request.per_page = 20;
+  std::size_t bytes = 0;
+
+  for (auto _ : state) {
+    store->list_page(request, ioc.get_executor(), [&](store_status, page_result result) {
+      bytes = result.comments.size();
+    });
+    ioc.poll();
+  }
+  state.set_bytes_per_iteration(bytes);
+}
+BENCHMARK(bm_memory_store_list_page);
+
+void bm_memory_store_insert(bench_state& state) {
+  net::io_context ioc;
+  auto store = std::make_shared<memory_store>();
+  auto comment = make_comment(plain_text);
+
+  for (auto _ : state) {
+    comment.comment_id = store->new_comment_id();
+    store->insert(comment, ioc.get_executor(), [](store_status) {});
+    ioc.poll();
+  }
+}
+BENCHMARK(bm_memory_store_insert);
+
+} // namespace
@@ -0,0 +1,222 @@
+#include "schema.hpp"
+#include "scylla_store.hpp"
+#include <boost/asio.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace net = boost::asio;
+
+namespace {
+
+using bench_clock = std::chrono::steady_clock;
+
+//! Reads per schema and page kind before the measurement
+constexpr unsigned warmup_reads = 20;
+
+/**
+ * @brief Key of a seeded comment.
+ */
+struct seeded_comment {
+  //! Comment id
+  CassUuid comment_id{};
+  //! Creation time
+  long long created_time = 0;
+};
+
+//! Starts the operation with the index and calls the handler with its status
+using seed_operation = std::function<void(unsigned, comment_store::write_handler)>;
+
+/**
+ * @brief Runs count operations with at most concurrency of them in flight.
+ * Throws std::runtime_error when one of them failed.
+ * @param ioc io_context the handlers are invoked on
+ * @param count Number of operations
+ * @param concurrency Operations in flight
+ * @param operation Operation
+ * @param what Description of the operations
+ */
+void run_bounded(net::io_context& ioc, unsigned count, unsigned concurrency,
+  const seed_operation& operation, const std::string& what) {
+  unsigned next = 0;
+  unsigned failed = 0;
+  std::function<void()> start = [&] {
+    if (next >= count) {
+      return;
+    }
+    operation(next++, [&](store_status status) {
+      if (status != store_status::ok) {
+        ++failed;
+      }
+      start();
+    });
+  };
+
+  for (unsigned i = 0; i < std::min(std::max(concurrency, 1u), count); ++i) {
+    start();
+  }
+  ioc.restart();
+  ioc.run();
+  if (failed > 0) {
+    throw std::runtime_error(std::to_string(failed) + " of " + std::to_string(count) +
+      " " + what + " failed");
+  }
+}
+
+/**
+ * @brief Inserts the comments of the partition and deletes deleted_percent
+ * of them, spread over the partition. Returns the keys of all comments.
+ * @param store Store writing both tables
+ * @param ioc io_context the handlers are invoked on
+ * @param entity Entity of the partition
+ * @param config Run settings
+ */
+std::vector<seeded_comment> seed(comment_store& store, net::io_context& ioc,
+  const std::string& entity, const schema_bench_config& config) {
+  std::vector<seeded_comment> comments(config.rows);
+  run_bounded(ioc, config.rows, config.concurrency, [&](unsigned i, auto handler) {
+    auto& seeded = comments[i];
+    seeded.comment_id = store.new_comment_id();
+    seeded.created_time = static_cast<long long>(cass_uuid_timestamp(seeded.comment_id));
+
+    comment_fields comment;
+    comment.entity = entity;
+    comment.comment_id = seeded.comment_id;
+    comment.author = "bench";
+    comment.created_by = 1;
+    comment.text = "Comment seeded by the schema benchmark";
+    comment.created_time = seeded.created_time;
+    comment.updated_time = seeded.created_time;
+    store.insert(comment, ioc.get_executor(), std::move(handler));
+  }, "inserts");
+
+  std::vector<unsigned> deleted;
+  for (unsigned i = 0; i < config.rows; ++i) {
+    if (i % 100 < config.deleted_percent) {
+      deleted.push_back(i);
+    }
+  }
+  run_bounded(ioc, static_cast<unsigned>(deleted.size()), config.concurrency,
+    [&](unsigned i, auto handler) {
+      comment_key key;
+      key.entity = entity;
+      key.comment_id = comments[deleted[i]].comment_id;
+      key.created_time = comments[deleted[i]].created_time;
+      store.soft_delete(key, ioc.get_executor(), std::move(handler));
+    }, "deletes");
+
+  return comments;
+}
+
+/**
+ * @brief Reads the page reads times one after another and returns the
+ * sorted latencies in nanoseconds, after warmup_reads unmeasured reads.
+ * Throws std::runtime_error when a read failed.
+ * @param store Store reading one schema
+ * @param ioc io_context the handlers are invoked on
+ * @param request Page to read
+ * @param reads Number of measured reads
+ */
+std::vector<std::int64_t> measure_reads(comment_store& store, net::io_context& ioc,
+  const page_request& request, unsigned reads) {
+  std::vector<std::int64_t> latencies;
+  latencies.reserve(reads);
+  for (unsigned i = 0; i < warmup_reads + reads; ++i) {
+    auto status = store_status::failed;
+    auto start = bench_clock::now();
+    store.list_page(request, ioc.get_executor(), [&](store_status s, page_result) {
+      status = s;
+    });
+    ioc.restart();
+    ioc.run();
+    auto elapsed = bench_clock::now() - start;
+    if (status != store_status::ok) {
+      throw std::runtime_error("Unable to read a page");
+    }
+    if (i >= warmup_reads) {
+      latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+  }
+  std::sort(latencies.begin(), latencies.end());
+  return latencies;
+}
+
+/**
+ * @brief Prints one result line.
+ * @param schema Schema name
+ * @param page Page kind
+ * @param latencies Sorted latencies in nanoseconds
+ */
+void print_latencies(const char* schema, const char* page, const std::vector<std::int64_t>& latencies) {
+  auto ms = [&](double percentile) {
+    auto rank = static_cast<std::size_t>(std::ceil(percentile * latencies.size()));
+    return latencies[std::clamp<std::size_t>(rank, 1, latencies.size()) - 1] / 1e6;
+  };
+  std::printf("%-8s %-12s %8zu %9.3f %9.3f %9.3f %9.3f\n", schema, page, latencies.size(),
+    ms(0.5), ms(0.9), ms(0.99), latencies.back() / 1e6);
+}
+
+} // namespace
+
+int run_schema_bench(const schema_bench_config& config) {
+  if (config.rows == 0 || config.reads == 0 || config.per_page == 0) {
+    throw std::invalid_argument("--rows, --reads and --per-page must not be 0");
+  }
+
+  db_config db;
+  db.contact_points = config.db_hosts;
+  net::io_context ioc;
+
+  // Every run seeds a new partition, the partitions of earlier runs are left behind.
+  db.schema = schema_mode::dual;
+  auto seed_db = std::make_shared<db_session>(db);
+  seed_db->connect();
+  auto seed_store = std::make_shared<scylla_store>(seed_db, insert_batch_config{});
+
+  char run_id[CASS_UUID_STRING_LENGTH];
+  cass_uuid_string(seed_store->new_comment_id(), run_id);
+  const std::string entity = std::string("schema-bench-") + run_id;
+
+  auto seed_start = bench_clock::now();
+  auto comments = seed(*seed_store, ioc, entity, config);
+  std::printf("Seeded %u comments, %u%% deleted, into entity %s in %.1f s\n", config.rows,
+    std::min(config.deleted_percent, 100u), entity.c_str(),
+    std::chrono::duration<double>(bench_clock::now() - seed_start).count());
+  seed_store.reset();
+  seed_db.reset();
+
+  // The keyset page starts in the middle of the partition, newest first.
+  std::sort(comments.begin(), comments.end(), [](const auto& a, const auto& b) {
+    return a.created_time > b.created_time;
+  });
+  const auto& middle = comments[comments.size() / 2];
+
+  page_request first_page;
+  first_page.entity = entity;
+  first_page.per_page = config.per_page;
+
+  page_request keyset_page = first_page;
+  keyset_page.has_keyset = true;
+  keyset_page.after_created_time = middle.created_time;
+  keyset_page.after_comment_id = middle.comment_id;
+
+  std::printf("%-8s %-12s %8s %9s %9s %9s %9s\n", "schema", "page", "reads",
+    "p50 ms", "p90 ms", "p99 ms", "max ms");
+  for (auto mode : {schema_mode::v1, schema_mode::v2}) {
+    db.schema = mode;
+    auto read_db = std::make_shared<db_session>(db);
+    read_db->connect();
+    auto store = std::make_shared<scylla_store>(read_db, insert_batch_config{});
+    const char* name = mode == schema_mode::v1 ? "v1" : "v2";
+    print_latencies(name, "first", measure_reads(*store, ioc, first_page, config.reads));
+    print_latencies(name, "keyset", measure_reads(*store, ioc, keyset_page, config.reads));
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,33 @@
+#ifndef SCHEMA_BENCH_HPP
+#define SCHEMA_BENCH_HPP
+
+#include <string>
+
+/**
+ * @brief Settings of the read comparison of the v1 and v2 schemas.
+ */
+struct schema_bench_config {
+  //! Comma separated list of contact points
+  std::string db_hosts = "127.0.0.1";
+  //! Comments seeded into the partition
+  unsigned rows = 50000;
+  //! Share of the seeded comments that are deleted, in percent
+  unsigned deleted_percent = 20;
+  //! Measured reads per schema and page kind
+  unsigned reads = 500;
+  //! Page size of the reads
+  unsigned per_page = 20;
+  //! Inserts and deletes in flight while seeding
+  unsigned concurrency = 64;
+};
+
+/**
+ * @brief Seeds one partition through a dual schema store, then reads its
+ * first page and a keyset page from its middle through a v1 and a v2 store
+ * and prints the latency percentiles of both. Needs a cluster with the
+ * comments_live migration applied. Returns the process exit code.
+ * @param config Run settings
+ */
+int run_schema_bench(const schema_bench_config& config);
+
+#endif // SCHEMA_BENCH_HPP
@@ -0,0 +1,149 @@
+#include "alloc_counter.hpp"
+#include "bench.hpp"
+#include "memory_store.hpp"
+#include "server.hpp"
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace {
+
+/**
+ * @brief Service listening on a loopback port, run by the benchmark thread.
+ *
+ * Requests are written and responses read with blocking calls of a client
+ * socket whose allocations are not counted, so allocs/op is the heap
+ * allocations of the server per request.
+ */
+class loopback_server {
+ public:
+  /**
+   * @brief Starts the service on a memory store with 20 comments of preset-12345.
+   * @param cache Response cache settings
+   */
+  explicit loopback_server(cache_config cache) {
+    auto store = std::make_shared<memory_store>();
+    for (int i = 0; i < 20; ++i) {
+      comment_fields comment;
+      comment.entity = "preset-12345";
+      comment.comment_id = store->new_comment_id();
+      comment.author = "user4";
+      comment.created_by = 4;
+      comment.text = "Really like the low end on this one, the filter envelope is great for basslines.";
+      comment.created_time = 1706531307174 + i;
+      comment.updated_time = comment.created_time;
+      store->insert(comment, ioc_.get_executor(), [](store_status) {});
+    }
+    ioc_.poll();
+    ioc_.restart();
+
+    auto context = std::make_shared<service_context>();
+    context->store = store;
+    context->cache = std::make_shared<response_cache>(cache);
+    context->hub = std::make_shared<comment_hub>();
+    context->admission = std::make_shared<admission_control>(admission_config{});
+    // The client connection has to outlive any number of iterations.
+    connection_settings settings;
+    settings.http.max_requests_per_connection = std::numeric_limits<unsigned>::max();
+    context->update_settings(settings);
+
+    acceptor_.emplace(make_acceptor(ioc_, tcp::endpoint{net::ip::make_address("127.0.0.1"), 0}, false));
+    http_server(*acceptor_, context);
+    client_.connect(acceptor_->local_endpoint());
+    client_.set_option(tcp::no_delay(true));
+    while (ioc_.poll_one() > 0) {
+    }
+  }
+
+  /**
+   * @brief Sends the request and runs the service until the response arrived.
+   * @param request Request
+   */
+  void round_trip(const http::request<http::string_body>& request) {
+    {
+      allocation_pause pause;
+      http::write(client_, request);
+    }
+    while (client_.available() == 0) {
+      ioc_.run_one();
+    }
+    {
+      allocation_pause pause;
+      response_ = {};
+      http::read(client_, buffer_, response_);
+    }
+  }
+
+  /**
+   * @brief Returns the last response.
+   */
+  const http::response<http::string_body>& response() const { return response_; }
+
+ private:
+  net::io_context ioc_{1};
+  std::optional<tcp::acceptor> acceptor_;
+  tcp::socket client_{ioc_};
+  beast::flat_buffer buffer_;
+  http::response<http::string_body> response_;
+};
+
+/**
+ * @brief Returns a GET /comments request of the first page.
+ */
+http::request<http::string_body> make_page_request() {
+  http::request<http::string_body> request{http::verb::get, "/comments", 11};
+  request.set(http::field::host, "localhost");
+  request.set("Entity", "preset-12345");
+  request.set("Pagination-Page", "1");
+  request.set("Pagination-Per-Page", "20");
+  return request;
+}
+
+void bm_server_get_cached_page(bench_state& state) {
+  loopback_server server(cache_config{});
+  auto request = make_page_request();
+  server.round_trip(request);
+
+  for (auto _ : state) {
+    server.round_trip(request);
+  }
+  state.set_bytes_per_iteration(server.response().body().size());
+}
+BENCHMARK(bm_server_get_cached_page);
+
+void bm_server_get_page(bench_state& state) {
+  cache_config cache;
+  cache.max_bytes = 0;
+  loopback_server server(cache);
+  auto request = make_page_request();
+  server.round_trip(request);
+
+  for (auto _ : state) {
+    server.round_trip(request);
+  }
+  state.set_bytes_per_iteration(server.response().body().size());
+}
+BENCHMARK(bm_server_get_page);
+
+void bm_server_add_comment(bench_state& state) {
+  loopback_server server(cache_config{});
+  http::request<http::string_body> request{http::verb::post, "/comments/make", 11};
+  request.set(http::field::host, "localhost");
+  request.set("Entity", "preset-777");
+  request.set("Author", "user4");
+  request.set("Created_by", "4");
+  request.body() = "{\"text\":\"Thanks for sharing, the pad sounds great.\"}";
+  request.prepare_payload();
+  server.round_trip(request);
+
+  for (auto _ : state) {
+    server.round_trip(request);
+  }
+}
+BENCHMARK(bm_server_add_comment);
+
+} // namespace
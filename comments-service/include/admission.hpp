@@ -0,0 +1,189 @@
+#ifndef ADMISSION_HPP
+#define ADMISSION_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Client a POST /comments/make rate limit applies to.
+ */
+enum class rate_limit_key {
+  //! Created_by header
+  created_by,
+  //! Remote IP address
+  ip
+};
+
+/**
+ * @brief Settings of admission control.
+ */
+struct admission_config {
+  //! Largest number of open connections, 0 is unlimited
+  unsigned max_connections = 0;
+  //! Largest number of requests in process, the initial limit when adaptive, 0 is unlimited
+  unsigned max_in_flight = 0;
+  //! Adjusts the limit between min_in_flight and max_in_flight to the service time
+  bool adaptive = false;
+  //! Lower bound of the adaptive limit
+  unsigned min_in_flight = 8;
+  //! Service time above which the adaptive limit is decreased
+  std::chrono::milliseconds target_latency{50};
+  //! Retry-After of rejected requests
+  std::chrono::seconds retry_after{1};
+  //! Comments per second one client may add, 0 is unlimited
+  double make_rate = 0;
+  //! Comments one client may add at once after being idle
+  double make_burst = 10;
+  //! Client the make rate limit applies to, Created_by is sent by the client and only fits trusted clients
+  rate_limit_key make_key = rate_limit_key::ip;
+  //! Number of tracked clients above which full buckets are dropped
+  std::size_t max_clients = 100000;
+};
+
+/**
+ * @brief Reason a request or connection was turned away.
+ */
+enum class reject_reason : std::size_t {
+  //! Too many open connections
+  connections,
+  //! Too many requests in process
+  concurrency,
+  //! Rate limit of the client exceeded
+  rate,
+  count
+};
+
+/**
+ * @brief Connection cap, concurrency limit and per-client token buckets.
+ *
+ * Requests hold a slot from the parsed request until their response is
+ * ready. With adaptive set, the limit follows AIMD on the service time of
+ * the requests: it grows by one per limit requests answered within the
+ * target latency while the slots are in use, and shrinks by a tenth, at
+ * most once per target latency, when a request takes longer. A slow
+ * backend so turns into fast rejections instead of queued db queries.
+ *
+ * All members are safe to call from any thread.
+ */
+class admission_control {
+ public:
+  /**
+   * @brief Constructor of the admission_control class.
+   * @param config Admission settings
+   */
+  explicit admission_control(admission_config config);
+
+  /**
+   * @brief Returns true if a new connection may be opened and counts it.
+   */
+  bool try_open_connection();
+
+  /**
+   * @brief Counts a closed connection that was opened with try_open_connection.
+   */
+  void close_connection();
+
+  /**
+   * @brief Returns true and takes a slot if a request may be processed.
+   */
+  bool try_acquire();
+
+  /**
+   * @brief Releases the slot of a processed request.
+   * @param service_time Time from the parsed request to the ready response
+   */
+  void release(std::chrono::steady_clock::duration service_time);
+
+  /**
+   * @brief Releases the slot of a request that was rejected before it was
+   * processed, the adaptive limit is not changed.
+   */
+  void cancel();
+
+  /**
+   * @brief Takes a token of the client for a new comment. Returns zero when
+   * the comment is allowed, otherwise the time until a token is available.
+   * @param client Client key
+   * @param now Current time
+   */
+  std::chrono::milliseconds take_make_token(std::string_view client,
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+  /**
+   * @brief Counts a rejected connection or request.
+   * @param reason Reason of the rejection
+   */
+  void count_rejected(reject_reason reason);
+
+  /**
+   * @brief Returns the settings.
+   */
+  const admission_config& config() const { return config_; }
+
+  /**
+   * @brief Returns the number of open connections.
+   */
+  unsigned connections() const { return connections_.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief Appends the limit, the requests in process and the rejections
+   * in the Prometheus text format.
+   * @param out Output buffer
+   */
+  void append_metrics(std::string& out) const;
+
+ private:
+  /**
+   * @brief Tokens of one client.
+   */
+  struct bucket {
+    double tokens = 0;
+    std::chrono::steady_clock::time_point updated;
+  };
+
+  /**
+   * @brief Independently locked part of the buckets.
+   */
+  struct bucket_shard {
+    std::mutex mutex;
+    std::unordered_map<std::string, bucket> buckets;
+  };
+
+  /**
+   * @brief Grows or shrinks the adaptive limit after a request.
+   * @param service_time Service time of the request
+   * @param in_flight Requests in process when the request completed
+   */
+  void adapt_limit(std::chrono::steady_clock::duration service_time, unsigned in_flight);
+
+  //! Settings
+  admission_config config_;
+  //! Open connections
+  std::atomic<unsigned> connections_{0};
+  //! Requests in process
+  std::atomic<unsigned> in_flight_{0};
+  //! Current limit of requests in process
+  std::atomic<double> limit_;
+  //! Time of the last decrease of the adaptive limit in steady clock nanoseconds
+  std::atomic<std::int64_t> last_decrease_{0};
+  //! Rejections by reason
+  std::atomic<std::uint64_t> rejected_[static_cast<std::size_t>(reject_reason::count)] = {};
+  //! Token buckets of the make rate limit
+  std::vector<std::unique_ptr<bucket_shard>> shards_;
+};
+
+/**
+ * @brief Returns the Retry-After header value of a wait: whole seconds,
+ * rounded up and at least 1.
+ * @param wait Time until the request may be sent again
+ */
+long long retry_after_seconds(std::chrono::milliseconds wait);
+
+#endif // ADMISSION_HPP
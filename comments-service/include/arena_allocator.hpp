@@ -0,0 +1,59 @@
+#ifndef ARENA_ALLOCATOR_HPP
+#define ARENA_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <memory_resource>
+
+/**
+ * @brief Allocator drawing from a memory resource, like
+ * std::pmr::polymorphic_allocator but assignable as Beast requires of the
+ * allocator of its header fields.
+ *
+ * Containers with allocators of different resources copy their elements
+ * on a move instead of stealing them.
+ */
+template <class T>
+class arena_allocator {
+ public:
+  using value_type = T;
+
+  arena_allocator() noexcept : resource_(std::pmr::get_default_resource()) {}
+
+  /**
+   * @brief Constructor of the arena_allocator class.
+   * @param resource Memory resource, outlives the allocator and its allocations
+   */
+  arena_allocator(std::pmr::memory_resource* resource) noexcept : resource_(resource) {}
+
+  template <class U>
+  arena_allocator(const arena_allocator<U>& other) noexcept : resource_(other.resource()) {}
+
+  T* allocate(std::size_t n) {
+    return static_cast<T*>(resource_->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T* p, std::size_t n) noexcept {
+    resource_->deallocate(p, n * sizeof(T), alignof(T));
+  }
+
+  /**
+   * @brief Returns the memory resource.
+   */
+  std::pmr::memory_resource* resource() const noexcept { return resource_; }
+
+  template <class U>
+  bool operator==(const arena_allocator<U>& other) const noexcept {
+    return resource_ == other.resource();
+  }
+
+  template <class U>
+  bool operator!=(const arena_allocator<U>& other) const noexcept {
+    return resource_ != other.resource();
+  }
+
+ private:
+  //! Memory resource
+  std::pmr::memory_resource* resource_;
+};
+
+#endif // ARENA_ALLOCATOR_HPP
@@ -0,0 +1,113 @@
+#ifndef COMMENT_HUB_HPP
+#define COMMENT_HUB_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Receiver of the events of one entity.
+ */
+class comment_subscriber {
+ public:
+  virtual ~comment_subscriber() = default;
+
+  /**
+   * @brief Queues the event without blocking. Called from any thread.
+   * Returns false when the subscriber is closed or too slow, it is then
+   * removed from the hub.
+   * @param event Serialized event, shared by all subscribers
+   */
+  virtual bool push(std::shared_ptr<const std::string> event) = 0;
+};
+
+/**
+ * @brief In-process publish/subscribe hub of comment events.
+ *
+ * Subscribers are grouped by entity in independently locked shards, an
+ * event is serialized once and shared by all subscribers of its entity.
+ * The hub keeps weak references, subscribers unsubscribe when they close.
+ */
+class comment_hub {
+ public:
+  /**
+   * @brief Constructor of the comment_hub class.
+   * @param shards Number of independently locked shards
+   */
+  explicit comment_hub(std::size_t shards = 64);
+
+  /**
+   * @brief Subscribes to the events of the entity.
+   * @param entity Entity
+   * @param subscriber Subscriber
+   */
+  void subscribe(const std::string& entity, std::weak_ptr<comment_subscriber> subscriber);
+
+  /**
+   * @brief Unsubscribes from the events of the entity.
+   * @param entity Entity
+   * @param subscriber Subscriber
+   */
+  void unsubscribe(const std::string& entity, const comment_subscriber* subscriber);
+
+  /**
+   * @brief Returns true if the entity has subscribers.
+   * Used to skip building events nobody receives.
+   * @param entity Entity
+   */
+  bool has_subscribers(std::string_view entity);
+
+  /**
+   * @brief Pushes the event to all subscribers of the entity.
+   * @param entity Entity
+   * @param event Serialized event
+   */
+  void publish(std::string_view entity, std::shared_ptr<const std::string> event);
+
+  /**
+   * @brief Returns the number of subscribers.
+   */
+  std::uint64_t subscribers() const;
+
+  /**
+   * @brief Returns the number of subscribers removed because they were too slow.
+   */
+  std::uint64_t evictions() const;
+
+ private:
+  /**
+   * @brief Subscriber with its address, kept to find it after it expired.
+   */
+  struct entry {
+    const comment_subscriber* address;
+    std::weak_ptr<comment_subscriber> subscriber;
+  };
+
+  /**
+   * @brief Independently locked part of the hub.
+   */
+  struct shard {
+    std::mutex mutex;
+    std::unordered_map<std::string, std::vector<entry>> entities;
+  };
+
+  /**
+   * @brief Returns the shard owning the entity.
+   * @param entity Entity
+   */
+  shard& shard_of(std::string_view entity);
+
+  //! Shards
+  std::vector<std::unique_ptr<shard>> shards_;
+  //! Number of subscribers
+  std::atomic<std::uint64_t> subscribers_{0};
+  //! Number of evicted subscribers
+  std::atomic<std::uint64_t> evictions_{0};
+};
+
+#endif // COMMENT_HUB_HPP
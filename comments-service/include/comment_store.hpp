@@ -0,0 +1,158 @@
+#ifndef COMMENT_STORE_HPP
+#define COMMENT_STORE_HPP
+
+#include <boost/asio.hpp>
+#include <cassandra.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include "json_writer.hpp"
+#include "request_params.hpp"
+
+/**
+ * @brief Outcome of a comment store operation.
+ */
+enum class store_status {
+  //! Completed
+  ok,
+  //! The comment does not exist
+  not_found,
+  //! The comment is deleted
+  deleted,
+  //! The backend failed, the error is logged by the store
+  failed
+};
+
+/**
+ * @brief Page of comments to list, newest first.
+ *
+ * The page starts after the cursor when there is one, otherwise after the
+ * keyset when has_keyset is set, otherwise after to_skip comments.
+ */
+struct page_request {
+  //! Entity
+  std::string_view entity;
+  //! Page size
+  std::size_t per_page = 0;
+  //! Number of comments to skip before the page
+  std::size_t to_skip = 0;
+  //! Cursor returned with the previous page, empty for none
+  std::string_view cursor;
+  //! True when the page starts after after_created_time and after_comment_id
+  bool has_keyset = false;
+  //! Creation time of the last comment of the previous page
+  long long after_created_time = 0;
+  //! Id of the last comment of the previous page
+  CassUuid after_comment_id{};
+};
+
+/**
+ * @brief Listed page of comments.
+ */
+struct page_result {
+  //! Comments as a json array in the format of append_comment_row
+  std::string comments;
+  //! Number of comments in the page
+  std::size_t row_count = 0;
+  //! Opaque cursor of the next page, empty on the last page
+  std::string next_cursor;
+  //! Part of the operation spent serializing comments
+  std::chrono::steady_clock::duration serialization{};
+};
+
+/**
+ * @brief Storage backend of the comments.
+ *
+ * Operations return immediately and invoke their handler on the executor
+ * passed to them, never from inside the call. Arguments are copied or
+ * bound before the call returns. Writes keep the comment counter of the
+ * entity up to date. Malformed cursors throw request_error from list_page.
+ */
+class comment_store {
+ public:
+  //! Handler of list_page
+  using page_handler = std::function<void(store_status, page_result)>;
+  //! Handler of count, the count is valid when the status is ok
+  using count_handler = std::function<void(store_status, long long)>;
+  //! Handler of insert, update_text and soft_delete
+  using write_handler = std::function<void(store_status)>;
+
+  virtual ~comment_store() = default;
+
+  /**
+   * @brief Generates a time based id of a new comment. Thread safe.
+   * The creation time of the comment is taken from the id with cass_uuid_timestamp.
+   */
+  virtual CassUuid new_comment_id() = 0;
+
+  /**
+   * @brief Lists a page of comments of the entity, deleted comments are skipped.
+   * @param request Page to list
+   * @param executor Executor to invoke the handler on
+   * @param handler Page handler
+   */
+  virtual void list_page(const page_request& request, boost::asio::any_io_executor executor,
+    page_handler handler) = 0;
+
+  /**
+   * @brief Reads the number of comments of the entity.
+   * @param entity Entity
+   * @param executor Executor to invoke the handler on
+   * @param handler Count handler
+   */
+  virtual void count(std::string_view entity, boost::asio::any_io_executor executor,
+    count_handler handler) = 0;
+
+  /**
+   * @brief Inserts a new comment.
+   * @param comment Comment with an id from new_comment_id
+   * @param executor Executor to invoke the handler on
+   * @param handler Write handler
+   */
+  virtual void insert(const comment_fields& comment, boost::asio::any_io_executor executor,
+    write_handler handler) = 0;
+
+  /**
+   * @brief Replaces the text of a comment that is not deleted and sets its
+   * update time to now.
+   * @param key Comment key
+   * @param text New text
+   * @param executor Executor to invoke the handler on
+   * @param handler Write handler
+   */
+  virtual void update_text(const comment_key& key, std::string_view text,
+    boost::asio::any_io_executor executor, write_handler handler) = 0;
+
+  /**
+   * @brief Marks a comment that is not deleted as deleted.
+   * @param key Comment key
+   * @param executor Executor to invoke the handler on
+   * @param handler Write handler
+   */
+  virtual void soft_delete(const comment_key& key, boost::asio::any_io_executor executor,
+    write_handler handler) = 0;
+
+  /**
+   * @brief Appends the metrics of the backend in the Prometheus text format.
+   * @param out Output buffer
+   */
+  virtual void append_metrics(std::string& out) = 0;
+
+  /**
+   * @brief Returns the number of writes started in the background, such as
+   * counter updates, that are not completed yet.
+   */
+  virtual std::size_t background_writes() const = 0;
+
+  /**
+   * @brief Waits for the operations in flight and releases the backend.
+   * Handlers of the operations are posted or dropped, none is invoked
+   * later, so it is called before the executors are destroyed.
+   */
+  virtual void close() = 0;
+};
+
+#endif // COMMENT_STORE_HPP
@@ -0,0 +1,96 @@
+#ifndef COMMENT_STREAM_HPP
+#define COMMENT_STREAM_HPP
+
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "comment_hub.hpp"
+
+/**
+ * @brief Settings of comment streams.
+ */
+struct stream_config {
+  //! Events queued for one subscriber before it is evicted as too slow
+  std::size_t max_queue = 64;
+  //! Interval of the keep-alive comments sent to idle subscribers
+  std::chrono::seconds heartbeat{15};
+};
+
+/**
+ * @brief Server-Sent Events stream of the comment events of one entity.
+ *
+ * Takes over the socket of the http_connection that received
+ * GET /comments/stream. Events are queued by publishers on any thread and
+ * written on the strand of the socket, one at a time. A subscriber whose
+ * queue is full is closed instead of buffering without bound.
+ */
+class comment_stream : public comment_subscriber,
+  public std::enable_shared_from_this<comment_stream> {
+ public:
+  /**
+   * @brief Constructor of the comment_stream class.
+   * @param socket Socket of the connection
+   * @param hub Hub to subscribe to
+   * @param entity Entity
+   * @param config Stream settings
+   */
+  comment_stream(boost::asio::ip::tcp::socket socket, std::shared_ptr<comment_hub> hub,
+    std::string entity, stream_config config);
+
+  /**
+   * @brief Writes the response header, subscribes to the entity and starts
+   * the heartbeat.
+   * @param request_id Id of the request, returned in X-Request-Id
+   */
+  void start(std::uint64_t request_id);
+
+  bool push(std::shared_ptr<const std::string> event) override;
+
+ private:
+  /**
+   * @brief Writes the first queued event.
+   */
+  void write_next();
+
+  /**
+   * @brief Reads from the socket to notice when the client goes away.
+   */
+  void wait_for_close();
+
+  /**
+   * @brief Queues a keep-alive comment every heartbeat interval.
+   */
+  void heartbeat();
+
+  /**
+   * @brief Unsubscribes and closes the socket.
+   */
+  void close();
+
+  //! Socket
+  boost::asio::ip::tcp::socket socket_;
+  //! Timer of the heartbeat
+  boost::asio::steady_timer heartbeat_timer_;
+  //! Hub
+  std::shared_ptr<comment_hub> hub_;
+  //! Entity
+  std::string entity_;
+  //! Stream settings
+  stream_config config_;
+  //! Guards queue_, writing_ and closed_
+  std::mutex mutex_;
+  //! Events to write, the front one is being written
+  std::deque<std::shared_ptr<const std::string>> queue_;
+  //! True while a write is in progress
+  bool writing_ = false;
+  //! True once the stream is closed or evicted
+  bool closed_ = false;
+  //! Buffer of the reads that detect a closed connection
+  char read_buffer_[64];
+};
+
+#endif // COMMENT_STREAM_HPP
@@ -0,0 +1,112 @@
+#ifndef CONFIG_HPP
+#define CONFIG_HPP
+
+#include <chrono>
+#include <string>
+#include "db_session.hpp"
+#include "logs.hpp"
+#include "response_cache.hpp"
+#include "insert_batcher.hpp"
+#include "comment_stream.hpp"
+#include "admission.hpp"
+#include "tracing.hpp"
+
+/**
+ * @brief How the server uses several threads.
+ */
+enum class thread_mode {
+  //! One io_context and SO_REUSEPORT acceptor per thread
+  reuse_port,
+  //! One io_context and acceptor shared by all threads
+  shared
+};
+
+/**
+ * @brief Storage backend of the comments.
+ */
+enum class store_backend {
+  //! ScyllaDB through the shared db session
+  scylla,
+  //! Process memory, for tests and benchmarks
+  memory
+};
+
+/**
+ * @brief Settings of HTTP connections.
+ */
+struct http_config {
+  //! Time a keep-alive connection may stay idle between requests
+  std::chrono::seconds idle_timeout{60};
+  //! Number of requests served on one connection before it is closed
+  unsigned max_requests_per_connection = 1000;
+  //! Largest request body, larger ones are answered with 413 Payload Too Large
+  std::size_t max_body_bytes = 64 * 1024;
+  //! Token of the Admin-Token header of /admin requests, empty disables them
+  std::string admin_token;
+};
+
+/**
+ * @brief Settings of POST /comments/bulk.
+ */
+struct bulk_config {
+  //! Largest number of entities in one request
+  std::size_t max_entities = 100;
+  //! Largest number of entities fetched at the same time for one request
+  std::size_t concurrency = 16;
+  //! Time after which the response is written with the entities fetched so far
+  std::chrono::milliseconds deadline{1000};
+};
+
+/**
+ * @brief Settings of the whole service.
+ */
+struct service_config {
+  //! Listen address
+  std::string address;
+  //! Listen port
+  unsigned short port = 0;
+  //! Number of server threads, 0 means one per core
+  unsigned threads = 1;
+  //! Threading mode
+  thread_mode mode = thread_mode::reuse_port;
+  //! HTTP settings
+  http_config http;
+  //! Bulk fetch settings
+  bulk_config bulk;
+  //! Storage backend
+  store_backend store = store_backend::scylla;
+  //! ScyllaDB settings
+  db_config db;
+  //! Response cache settings
+  cache_config cache;
+  //! Logging settings
+  log_config log;
+  //! Insert batching settings
+  insert_batch_config batch;
+  //! Comment stream settings
+  stream_config stream;
+  //! Admission control settings
+  admission_config admission;
+  //! Request tracing settings
+  trace_config trace;
+  //! Time a SIGTERM waits for the requests in process before the service stops
+  std::chrono::seconds drain_timeout{10};
+};
+
+/**
+ * @brief Parses the service settings. Options are read from the config file
+ * of --config or COMMENTS_CONFIG, then from COMMENTS_* environment variables
+ * and then from the command line, later sources override earlier ones.
+ * Throws std::invalid_argument on malformed arguments.
+ * @param argc Number of arguments
+ * @param argv Arguments
+ */
+service_config parse_command_line(int argc, char* argv[]);
+
+/**
+ * @brief Prints command line usage.
+ * @param program Program name
+ */
+void print_usage(const char* program);
+
+#endif // CONFIG_HPP
@@ -0,0 +1,74 @@
+#ifndef DB_FUTURE_HPP
+#define DB_FUTURE_HPP
+
+#include <boost/asio.hpp>
+#include <cassandra.h>
+#include <memory>
+#include <utility>
+
+/**
+ * @brief Waits for a CassFuture without blocking and resumes on an executor.
+ *
+ * The driver invokes the future callback on one of its I/O threads, the
+ * operation posts the handler back to the executor it was started from
+ * (the connection's strand), so handlers never race with socket operations
+ * and the io_context is never blocked by a db round trip.
+ */
+template <class Executor, class Handler>
+class db_future_operation {
+ public:
+  /**
+   * @brief Starts waiting for the future. The operation owns the future.
+   * @param future Pending CassFuture object
+   * @param executor Executor to run the handler on
+   * @param handler Handler with void(CassFuture*) signature
+   */
+  static void start(CassFuture* future, Executor executor, Handler handler) {
+    auto operation = new db_future_operation(future, std::move(executor), std::move(handler));
+    cass_future_set_callback(future, &db_future_operation::on_complete, operation);
+  }
+
+ private:
+  db_future_operation(CassFuture* future, Executor executor, Handler handler) :
+    future_(future, &cass_future_free),
+    work_(boost::asio::prefer(std::move(executor),
+      boost::asio::execution::outstanding_work.tracked)),
+    handler_(std::move(handler)) {}
+
+  /**
+   * @brief Driver callback, posts the handler to the executor.
+   * @param future Completed CassFuture object
+   * @param data Pointer to the db_future_operation object
+   */
+  static void on_complete(CassFuture* future, void* data) {
+    boost::ignore_unused(future);
+    std::unique_ptr<db_future_operation> operation(static_cast<db_future_operation*>(data));
+    auto executor = operation->work_;
+    boost::asio::post(executor, [operation = std::move(operation)]() mutable {
+      operation->handler_(operation->future_.get());
+    });
+  }
+
+  //! Owned future
+  std::unique_ptr<CassFuture, decltype(&cass_future_free)> future_;
+  //! Executor that keeps the io_context running until the handler is invoked
+  typename std::decay<decltype(boost::asio::prefer(std::declval<Executor>(),
+    boost::asio::execution::outstanding_work.tracked))>::type work_;
+  //! Completion handler
+  Handler handler_;
+};
+
+/**
+ * @brief Invokes the handler on the executor when the future is completed.
+ * Takes ownership of the future.
+ * @param future Pending CassFuture object
+ * @param executor Executor to run the handler on
+ * @param handler Handler with void(CassFuture*) signature
+ */
+template <class Executor, class Handler>
+void async_wait_future(CassFuture* future, Executor executor, Handler&& handler) {
+  db_future_operation<Executor, std::decay_t<Handler>>::start(
+    future, std::move(executor), std::forward<Handler>(handler));
+}
+
+#endif // DB_FUTURE_HPP
@@ -0,0 +1,152 @@
+#ifndef DB_SESSION_HPP
+#define DB_SESSION_HPP
+
+#include <cassandra.h>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include "logs.hpp"
+#include "statements.hpp"
+
+/**
+ * @brief ScyllaDB connection settings.
+ */
+struct db_config {
+  //! Comma separated list of contact points
+  std::string contact_points = "scylla-node1";
+  //! CQL native transport port
+  int port = 9042;
+  //! Number of driver I/O threads
+  unsigned io_threads = 1;
+  //! Number of connections opened to every host per I/O thread
+  unsigned connections_per_host = 1;
+  //! Timeout of a single connection attempt in milliseconds
+  unsigned connect_timeout_ms = 5000;
+  //! Timeout of a single request in milliseconds
+  unsigned request_timeout_ms = 12000;
+  //! First delay between reconnection attempts to a dropped node in milliseconds
+  unsigned reconnect_base_delay_ms = 500;
+  //! Upper bound of the delay between reconnection attempts in milliseconds
+  unsigned reconnect_max_delay_ms = 10000;
+  //! Number of attempts to establish the session at startup
+  unsigned startup_attempts = 30;
+  //! Layout of the comment tables
+  schema_mode schema = schema_mode::v1;
+};
+
+/**
+ * @brief Process-wide ScyllaDB session.
+ *
+ * Created once at startup and shared by all connections. The driver keeps
+ * a pool of connections to every node, discovers the topology and
+ * reconnects in the background when a node drops, so request handlers
+ * only pay for the query itself.
+ */
+class db_session {
+ public:
+  /**
+   * @brief Constructor of the db_session class.
+   * @param config Connection settings
+   */
+  explicit db_session(db_config config);
+
+  /**
+   * @brief Closes the session if close was not called.
+   */
+  ~db_session();
+
+  db_session(const db_session&) = delete;
+  db_session& operator=(const db_session&) = delete;
+
+  /**
+   * @brief Connects to the cluster, retrying with backoff while it is not reachable,
+   * and prepares all queries.
+   * Throws std::runtime_error when all startup attempts failed.
+   */
+  void connect();
+
+  /**
+   * @brief Runs as many trivial queries at once as the contact points have
+   * pooled connections, so that they spread over the connections and the
+   * first requests do not pay for lazy initialization. Connections to hosts
+   * that are not contact points may stay cold.
+   */
+  void warm_up();
+
+  /**
+   * @brief Closes the session, waiting for the queries in flight. Their
+   * completion handlers are posted before close returns, so it is called
+   * while the executors of the handlers still exist.
+   */
+  void close();
+
+  /**
+   * @brief Counts a query whose result no request waits for, until
+   * background_finished is called.
+   */
+  void background_started();
+
+  /**
+   * @brief Marks a query counted by background_started as completed.
+   */
+  void background_finished();
+
+  /**
+   * @brief Returns the number of background queries not completed yet.
+   */
+  std::size_t background_queries() const;
+
+  /**
+   * @brief Returns the underlying driver session.
+   */
+  CassSession* get() const;
+
+  /**
+   * @brief Returns the prepared statement registry. Valid after connect.
+   */
+  prepared_statements& statements();
+
+  /**
+   * @brief Returns the layout of the comment tables.
+   */
+  schema_mode schema() const;
+
+  /**
+   * @brief Returns the time connect took, including the failed attempts.
+   */
+  std::chrono::steady_clock::duration connect_time() const;
+
+  /**
+   * @brief Generates a time based id of a new comment. Thread safe.
+   * The creation time of the comment is taken from the id with cass_uuid_timestamp.
+   */
+  CassUuid new_comment_id();
+
+ private:
+  /**
+   * @brief Returns the error message of the future.
+   * @param future Completed CassFuture object
+   */
+  static std::string error_message(CassFuture* future);
+
+  //! Connection settings
+  db_config config_;
+  //! Cluster configuration
+  std::unique_ptr<CassCluster, decltype(&cass_cluster_free)> cluster_;
+  //! db session
+  std::unique_ptr<CassSession, decltype(&cass_session_free)> session_;
+  //! Prepared statements
+  std::unique_ptr<prepared_statements> statements_;
+  //! Generator of comment ids
+  std::unique_ptr<CassUuidGen, decltype(&cass_uuid_gen_free)> uuid_gen_;
+  //! True when the session is connected
+  bool connected_ = false;
+  //! Time connect took
+  std::chrono::steady_clock::duration connect_time_{};
+  //! Number of background queries not completed yet
+  std::atomic<std::size_t> background_queries_{0};
+};
+
+#endif // DB_SESSION_HPP
@@ -0,0 +1,189 @@
+#ifndef INSERT_BATCHER_HPP
+#define INSERT_BATCHER_HPP
+
+#include <boost/asio.hpp>
+#include <cassandra.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "db_session.hpp"
+
+/**
+ * @brief Settings of insert batching.
+ */
+struct insert_batch_config {
+  //! Largest number of comments in one batch, 0 or 1 disables batching
+  std::size_t max_size = 0;
+  //! Time the first comment of a batch waits for more comments
+  std::chrono::milliseconds linger{2};
+  //! Number of independently locked shards
+  std::size_t shards = 16;
+};
+
+/**
+ * @brief Groups concurrent inserts of one entity into one batch.
+ *
+ * All statements of a batch target the partition of one entity, so the
+ * batch is sent to its replicas as a single mutation. A batch is sent when
+ * it is full or when the linger time of its first comment is over. The
+ * comment counter of the entity is updated once per batch.
+ *
+ * Every insert gets the result of its batch. When a batch of several
+ * comments fails, its comments are retried one by one, so a bad comment
+ * does not fail the others. Inserts use ids generated by the service and
+ * are safe to repeat.
+ */
+class insert_batcher : public std::enable_shared_from_this<insert_batcher> {
+ public:
+  //! Completion handler, invoked on the executor passed to add
+  using handler_type = std::function<void(CassFuture*)>;
+
+  /**
+   * @brief Constructor of the insert_batcher class.
+   * @param db Shared db session
+   * @param config Batching settings
+   * @param batch_type CASS_BATCH_TYPE_UNLOGGED, or CASS_BATCH_TYPE_LOGGED when
+   * a comment is written to several tables that must stay in sync
+   */
+  insert_batcher(std::shared_ptr<db_session> db, insert_batch_config config, CassBatchType batch_type);
+
+  /**
+   * @brief Adds the statements of one comment to the batch of its entity.
+   * @param entity Entity of the comment
+   * @param statements Insert statements of the comment
+   * @param executor Executor to invoke the handler on
+   * @param handler Handler with void(CassFuture*) signature
+   */
+  void add(std::string_view entity, std::vector<statement_ptr> statements,
+    boost::asio::any_io_executor executor, handler_type handler);
+
+  /**
+   * @brief Sends every pending batch without waiting for its linger time.
+   */
+  void flush_all();
+
+  /**
+   * @brief Returns the number of sent batches.
+   */
+  std::uint64_t batches() const;
+
+  /**
+   * @brief Returns the number of comments sent in batches.
+   */
+  std::uint64_t batched_inserts() const;
+
+ private:
+  /**
+   * @brief Comment waiting for its batch.
+   */
+  struct pending_insert {
+    std::vector<statement_ptr> statements;
+    boost::asio::any_io_executor executor;
+    handler_type handler;
+  };
+
+  /**
+   * @brief Batch collecting comments of one entity.
+   */
+  struct pending_batch {
+    std::uint64_t id = 0;
+    std::vector<pending_insert> inserts;
+  };
+
+  /**
+   * @brief Batch sent to the db, owned by the driver callback.
+   */
+  struct sent_batch {
+    std::shared_ptr<insert_batcher> batcher;
+    std::string entity;
+    std::vector<pending_insert> inserts;
+  };
+
+  /**
+   * @brief Counter update, owned by the driver callback.
+   */
+  struct counter_update {
+    std::shared_ptr<db_session> db;
+    std::string entity;
+  };
+
+  /**
+   * @brief Independently locked part of the pending batches.
+   */
+  struct shard {
+    std::mutex mutex;
+    std::unordered_map<std::string, pending_batch> batches;
+  };
+
+  /**
+   * @brief Returns the shard owning the entity.
+   * @param entity Entity
+   */
+  shard& shard_of(std::string_view entity);
+
+  /**
+   * @brief Sends the pending batch of the entity if it is still the batch with the id.
+   * @param entity Entity
+   * @param id Batch id
+   */
+  void flush(const std::string& entity, std::uint64_t id);
+
+  /**
+   * @brief Sends the inserts as one batch.
+   * @param entity Entity
+   * @param inserts Comments of the batch
+   */
+  void send(std::string entity, std::vector<pending_insert> inserts);
+
+  /**
+   * @brief Driver callback of a sent batch.
+   * @param future Completed CassFuture object
+   * @param data Pointer to the sent_batch object
+   */
+  static void on_sent(CassFuture* future, void* data);
+
+  /**
+   * @brief Posts the result to the handlers of the inserts.
+   * @param future Completed CassFuture object, shared by the handlers
+   * @param inserts Comments of the batch
+   */
+  static void complete(std::shared_ptr<CassFuture> future, std::vector<pending_insert>& inserts);
+
+  /**
+   * @brief Asynchronously adds the number of inserted comments to the comment counter.
+   * @param entity Entity
+   * @param count Number of inserted comments
+   */
+  void update_comment_count(const std::string& entity, std::size_t count);
+
+  /**
+   * @brief Driver callback of a counter update, logs errors.
+   * @param future Completed CassFuture object
+   * @param data Pointer to the counter_update object
+   */
+  static void on_counted(CassFuture* future, void* data);
+
+  //! Shared db session
+  std::shared_ptr<db_session> db_;
+  //! Batching settings
+  insert_batch_config config_;
+  //! Type of the sent batches
+  CassBatchType batch_type_;
+  //! Shards
+  std::vector<std::unique_ptr<shard>> shards_;
+  //! Source of batch ids
+  std::atomic<std::uint64_t> next_id_{0};
+  //! Number of sent batches
+  std::atomic<std::uint64_t> batches_{0};
+  //! Number of comments sent in batches
+  std::atomic<std::uint64_t> batched_inserts_{0};
+};
+
+#endif // INSERT_BATCHER_HPP
@@ -0,0 +1,58 @@
+#ifndef JSON_WRITER_HPP
+#define JSON_WRITER_HPP
+
+#include <cassandra.h>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Appends the value as a quoted and escaped json string.
+ *
+ * Runs of characters that need no escaping are found eight bytes at a time
+ * and copied with a single append. Invalid UTF-8 sequences are replaced
+ * with U+FFFD, so a corrupted row still gives valid json.
+ * @param out Output buffer
+ * @param value UTF-8 string
+ */
+void append_json_string(std::string& out, std::string_view value);
+
+/**
+ * @brief Appends the number as a json number.
+ * @param out Output buffer
+ * @param value Number
+ */
+void append_json_number(std::string& out, std::int64_t value);
+
+/**
+ * @brief Comment written by the service, the fields of a comment row.
+ */
+struct comment_fields {
+  std::string_view entity;
+  CassUuid comment_id{};
+  std::string_view author;
+  std::int64_t created_by = 0;
+  std::string_view text;
+  std::int64_t created_time = 0;
+  std::int64_t updated_time = 0;
+};
+
+/**
+ * @brief Appends the comment as a json object with the keys of append_comment_row.
+ * @param out Output buffer
+ * @param comment Comment
+ */
+void append_comment(std::string& out, const comment_fields& comment);
+
+/**
+ * @brief Appends the comment row as a json object.
+ *
+ * The row must have the column layout of the get_comments queries:
+ * entity, created_time, comment_id, author, created_by, text, updated_time.
+ * Keys are written in alphabetical order.
+ * @param out Output buffer
+ * @param row Row of the get_comments result
+ */
+void append_comment_row(std::string& out, const CassRow* row);
+
+#endif // JSON_WRITER_HPP
@@ -2,68 +2,115 @@
 #define LOGS_HPP
 #pragma warning(push)
 #pragma warning(disable:4819)
-#   include <boost/shared_ptr.hpp>
-#   include <boost/date_time/posix_time/posix_time_types.hpp>
 #   include <boost/log/trivial.hpp>
-#   include <boost/log/core.hpp>
-#   include <boost/log/expressions.hpp>
-#   include <boost/log/sources/logger.hpp>
-#   include <boost/log/utility/setup/file.hpp>
-#   include <boost/log/utility/setup/console.hpp>
-#   include <boost/log/utility/setup/common_attributes.hpp>
-#   include <boost/log/support/date_time.hpp>
-#   include <boost/log/sinks/sync_frontend.hpp>
-#   include <boost/log/sinks/text_file_backend.hpp>
-#   include <boost/log/sinks/text_ostream_backend.hpp>
 #   include <boost/log/attributes/named_scope.hpp>
 #pragma warning(pop)
 #pragma warning(disable:4503)
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Format of log lines.
+ */
+enum class log_format {
+  //! [time] (thread) [severity] [scope] [request] message
+  text,
+  //! One json object per line
+  json
+};
+
+/**
+ * @brief Logging settings.
+ */
+struct log_config {
+  //! Minimum severity of written records
+  boost::log::trivial::severity_level level = boost::log::trivial::info;
+  //! Format of log lines
+  log_format format = log_format::text;
+  //! Directory of the log files
+  std::string directory = "logs";
+  //! Size of a log file before it is rotated in megabytes, 0 disables the file log
+  unsigned rotation_mb = 10;
+  //! Total size of the kept log files in megabytes
+  unsigned max_total_mb = 100;
+};
 
 /**
  * @brief Initialization of logging.
+ *
+ * Records are queued by the logging thread and written by a dedicated
+ * thread of every sink. When a queue is full the record is dropped and
+ * counted instead of blocking the caller.
+ * @param config Logging settings
+ */
+void init_log(const log_config& config = {});
+
+/**
+ * @brief Writes the queued records and stops the writer threads.
+ */
+void stop_log();
+
+/**
+ * @brief Changes the minimum severity of written records. Thread safe.
+ * @param level Minimum severity
+ */
+void set_log_level(boost::log::trivial::severity_level level);
+
+/**
+ * @brief Returns the minimum severity of written records.
+ */
+boost::log::trivial::severity_level log_level();
+
+/**
+ * @brief Parses a severity name: trace, debug, info, warning, error or fatal.
+ * Throws std::invalid_argument on unknown names.
+ * @param name Severity name
+ */
+boost::log::trivial::severity_level parse_log_level(std::string_view name);
+
+/**
+ * @brief Returns the number of records dropped because a sink queue was full.
  */
-static void init_log(void) {
-  namespace log = boost::log;
-  namespace keywords = boost::log::keywords;
-  namespace expr = boost::log::expressions;
+std::uint64_t log_dropped_records();
 
-  log::add_common_attributes();
-  log::core::get()->add_global_attribute("Scope", log::attributes::named_scope());
-  log::core::get()->set_filter(log::trivial::severity >= log::trivial::trace);
+/**
+ * @brief Marks the records logged by the current thread with the request id
+ * until the scope ends.
+ *
+ * Connections of one thread interleave, so the scope is opened by every
+ * handler that runs on behalf of a request.
+ */
+class log_request_scope {
+ public:
+  /**
+   * @brief Constructor of the log_request_scope class.
+   * @param request_id Request id, 0 for none
+   */
+  explicit log_request_scope(std::uint64_t request_id);
 
-  auto fmt_timestamp = expr::
-    format_date_time<boost::posix_time::ptime>("TimeStamp", "%Y-%m-%d %H:%M:%S.%f");
-  auto fmt_thread_id = expr::
-    attr<boost::log::attributes::current_thread_id::value_type>("ThreadID");
-  auto fmt_severity = expr::
-    attr<boost::log::trivial::severity_level>("Severity");
-  auto fmt_scope = expr::
-    format_named_scope("Scope",
-    keywords::format = "%n(%f:%l)",
-    keywords::iteration = expr::reverse,
-    keywords::depth = 2);
-  boost::log::formatter log_fmt =
-    expr::format("[%1%] (%2%) [%3%] [%4%] %5%")
-    % fmt_timestamp % fmt_thread_id % fmt_severity % fmt_scope % expr::smessage;
+  /**
+   * @brief Restores the request id of the enclosing scope.
+   */
+  ~log_request_scope();
 
-  auto console_sink = boost::log::add_console_log(std::clog);
-  console_sink->set_formatter(log_fmt);
+  log_request_scope(const log_request_scope&) = delete;
+  log_request_scope& operator=(const log_request_scope&) = delete;
 
-  // auto fs_sink = boost::log::add_file_log(
-  //   keywords::file_name = "test_%Y-%m-%d_%H-%M-%S.%N.log",
-  //   keywords::rotation_size = 10 * 1024 * 1024,
-  //   keywords::min_free_space = 30 * 1024 * 1024,
-  //   keywords::open_mode = std::ios_base::app);
-  // fs_sink->set_formatter(log_fmt);
-  // fs_sink->locked_backend()->auto_flush(true);
-}
+ private:
+  //! Request id of the enclosing scope
+  std::uint64_t previous_;
+};
 
-// /**
-//  * @brief Test log call.
-//  */
-// static void test(void) {
-//   BOOST_LOG_FUNCTION();
-//   BOOST_LOG_TRIVIAL(info) << "Info Log in Test()";
-// }
+/**
+ * @brief Returns the request id of the current scope, 0 outside of request scopes.
+ * Captured by asynchronous operations that log on behalf of the request.
+ */
+std::uint64_t log_request_id();
+
+/**
+ * @brief Returns a new process-wide unique request id.
+ */
+std::uint64_t next_request_id();
 
-#endif // LOGS_HPP
\ No newline at end of file
+#endif // LOGS_HPP
@@ -0,0 +1,166 @@
+#ifndef MEMORY_STORE_HPP
+#define MEMORY_STORE_HPP
+
+#include <cassandra.h>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "comment_store.hpp"
+
+/**
+ * @brief Comment store kept in process memory.
+ *
+ * Comments of an entity are ordered like the comments_live clustering key,
+ * newest first. Entities are spread over independently locked shards. Map
+ * nodes come from a pool of their shard and author and text strings from
+ * an arena of their shard, the arena is only released with the store.
+ *
+ * Operations run synchronously under the shard lock and post the handler,
+ * so the same calls always give the same results. Nothing is persisted,
+ * the store is meant for tests and as a baseline of benchmarks.
+ */
+class memory_store : public comment_store {
+ public:
+  /**
+   * @brief Constructor of the memory_store class.
+   * @param shards Number of independently locked shards
+   */
+  explicit memory_store(std::size_t shards = 64);
+
+  CassUuid new_comment_id() override;
+
+  void list_page(const page_request& request, boost::asio::any_io_executor executor,
+    page_handler handler) override;
+
+  void count(std::string_view entity, boost::asio::any_io_executor executor,
+    count_handler handler) override;
+
+  void insert(const comment_fields& comment, boost::asio::any_io_executor executor,
+    write_handler handler) override;
+
+  void update_text(const comment_key& key, std::string_view text,
+    boost::asio::any_io_executor executor, write_handler handler) override;
+
+  void soft_delete(const comment_key& key, boost::asio::any_io_executor executor,
+    write_handler handler) override;
+
+  /**
+   * @brief Appends the number of stored comments and the size of their strings.
+   * @param out Output buffer
+   */
+  void append_metrics(std::string& out) override;
+
+  /**
+   * @brief Returns 0, writes complete before their handlers.
+   */
+  std::size_t background_writes() const override;
+
+  /**
+   * @brief Does nothing, the comments stay in memory.
+   */
+  void close() override;
+
+ private:
+  /**
+   * @brief Clustering key of a comment.
+   */
+  struct comment_order {
+    long long created_time = 0;
+    CassUuid comment_id{};
+  };
+
+  /**
+   * @brief Orders comments by created_time and comment_id, both descending.
+   */
+  struct newest_first {
+    bool operator()(const comment_order& a, const comment_order& b) const;
+  };
+
+  /**
+   * @brief Stored comment, strings point into the arena of its shard.
+   */
+  struct stored_comment {
+    std::string_view author;
+    std::string_view text;
+    long long created_by = 0;
+    long long updated_time = 0;
+    bool deleted = false;
+  };
+
+  //! Comments of one entity
+  using comment_map = std::pmr::map<comment_order, stored_comment, newest_first>;
+
+  /**
+   * @brief Comments and comment counter of one entity.
+   */
+  struct entity_comments {
+    comment_map comments;
+    long long live = 0;
+
+    explicit entity_comments(std::pmr::memory_resource* pool) : comments(pool) {}
+  };
+
+  /**
+   * @brief Independently locked part of the store.
+   */
+  struct shard {
+    std::mutex mutex;
+    std::pmr::monotonic_buffer_resource arena;
+    std::pmr::unsynchronized_pool_resource pool;
+    std::unordered_map<std::string, entity_comments> entities;
+  };
+
+  /**
+   * @brief Returns the shard owning the entity.
+   * @param entity Entity
+   */
+  shard& shard_of(std::string_view entity);
+
+  /**
+   * @brief Copies the string into the arena of the shard. Called under the shard lock.
+   * @param s Shard
+   * @param value String
+   */
+  std::string_view store_string(shard& s, std::string_view value);
+
+  /**
+   * @brief Returns the live comment with the key or the status explaining why there is none.
+   * Called under the shard lock.
+   * @param s Shard
+   * @param key Comment key
+   * @param entity Set to the comments of the entity
+   * @param comment Set to the comment
+   */
+  store_status find_live(shard& s, const comment_key& key, entity_comments*& entity,
+    stored_comment*& comment);
+
+  /**
+   * @brief Encodes the key of the last comment of a page as a cursor.
+   * @param order Clustering key
+   */
+  static std::string encode_cursor(const comment_order& order);
+
+  /**
+   * @brief Decodes a cursor. Throws request_error on malformed cursors.
+   * @param cursor Cursor
+   */
+  static comment_order decode_cursor(std::string_view cursor);
+
+  //! Shards
+  std::vector<std::unique_ptr<shard>> shards_;
+  //! Generator of comment ids
+  std::unique_ptr<CassUuidGen, decltype(&cass_uuid_gen_free)> uuid_gen_;
+  //! Number of stored comments, deleted ones included
+  std::atomic<std::uint64_t> comments_{0};
+  //! Bytes of strings copied into the arenas
+  std::atomic<std::uint64_t> string_bytes_{0};
+};
+
+#endif // MEMORY_STORE_HPP
@@ -0,0 +1,89 @@
+#ifndef POOLED_ALLOCATOR_HPP
+#define POOLED_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <new>
+
+/**
+ * @brief Allocator that keeps freed single objects in a per-thread free list
+ * and hands them out again, connections are allocated with it so that
+ * accepting one reuses the memory of a closed one.
+ *
+ * Each thread keeps at most max_free blocks per object type, the others are
+ * returned to the heap. A block freed on another thread than the one that
+ * allocated it joins the free list of the freeing thread.
+ */
+template <class T, std::size_t max_free = 256>
+class pooled_allocator {
+ public:
+  using value_type = T;
+
+  template <class U>
+  struct rebind {
+    using other = pooled_allocator<U, max_free>;
+  };
+
+  pooled_allocator() noexcept = default;
+
+  template <class U>
+  pooled_allocator(const pooled_allocator<U, max_free>&) noexcept {}
+
+  /**
+   * @brief Takes a block from the free list or allocates a new one.
+   * @param n Number of objects
+   */
+  T* allocate(std::size_t n) {
+    auto& list = free_list();
+    if (n == 1 && list.size > 0) {
+      return static_cast<T*>(list.blocks[--list.size]);
+    }
+    return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+  }
+
+  /**
+   * @brief Puts a block back to the free list, or frees it when the list is full.
+   * @param p Block
+   * @param n Number of objects
+   */
+  void deallocate(T* p, std::size_t n) noexcept {
+    auto& list = free_list();
+    if (n == 1 && list.size < max_free) {
+      list.blocks[list.size++] = p;
+      return;
+    }
+    ::operator delete(p, std::align_val_t(alignof(T)));
+  }
+
+  template <class U>
+  bool operator==(const pooled_allocator<U, max_free>&) const noexcept { return true; }
+
+  template <class U>
+  bool operator!=(const pooled_allocator<U, max_free>&) const noexcept { return false; }
+
+ private:
+  /**
+   * @brief Free blocks of one thread, freed when the thread exits.
+   */
+  struct block_list {
+    //! Free blocks
+    void* blocks[max_free];
+    //! Number of free blocks
+    std::size_t size = 0;
+
+    ~block_list() {
+      while (size > 0) {
+        ::operator delete(blocks[--size], std::align_val_t(alignof(T)));
+      }
+    }
+  };
+
+  /**
+   * @brief Returns the free list of the calling thread.
+   */
+  static block_list& free_list() {
+    thread_local block_list list;
+    return list;
+  }
+};
+
+#endif // POOLED_ALLOCATOR_HPP
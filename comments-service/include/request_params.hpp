@@ -0,0 +1,155 @@
+#ifndef REQUEST_PARAMS_HPP
+#define REQUEST_PARAMS_HPP
+
+#include <boost/beast/http.hpp>
+#include <boost/log/trivial.hpp>
+#include <nlohmann/json.hpp>
+#include <cassandra.h>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "arena_allocator.hpp"
+
+/**
+ * @brief Malformed request, answered with 400 Bad Request.
+ */
+class request_error : public std::invalid_argument {
+ public:
+  using std::invalid_argument::invalid_argument;
+};
+
+/**
+ * @brief Header fields allocated from a memory resource, the connections
+ * keep them in a per-request arena.
+ */
+using request_fields = boost::beast::http::basic_fields<arena_allocator<char>>;
+
+/**
+ * @brief Parser of a request into request_fields and a string body.
+ */
+using request_parser = boost::beast::http::request_parser<boost::beast::http::string_body,
+  arena_allocator<char>>;
+
+/**
+ * @brief Headers of GET /comments.
+ *
+ * String members point into the request headers and are valid until the
+ * next request is read on the connection.
+ */
+struct get_comments_params {
+  //! Entity
+  std::string_view entity;
+  //! Page number, at least 1
+  long long page = 1;
+  //! Page size, 1 to 100
+  int per_page = 1;
+  //! Cursor of the page, empty if absent
+  std::string_view cursor;
+  //! True when the page starts after after_created_time and after_comment_id
+  bool has_keyset = false;
+  //! Created time of the last comment of the previous page
+  long long after_created_time = 0;
+  //! Id of the last comment of the previous page
+  CassUuid after_comment_id{};
+};
+
+/**
+ * @brief Primary key of a comment, taken from the headers of PATCH requests.
+ *
+ * String members point into the request headers and are valid until the
+ * next request is read on the connection.
+ */
+struct comment_key {
+  //! Entity
+  std::string_view entity;
+  //! Comment id as sent by the client
+  std::string_view comment_id_text;
+  //! Comment id
+  CassUuid comment_id{};
+  //! Created time
+  long long created_time = 0;
+};
+
+/**
+ * @brief Headers of POST /comments/make.
+ *
+ * String members point into the request headers and are valid until the
+ * next request is read on the connection.
+ */
+struct new_comment_params {
+  //! Entity
+  std::string_view entity;
+  //! Author
+  std::string_view author;
+  //! Id of the author
+  long long created_by = 0;
+};
+
+/**
+ * @brief Body of POST /comments/bulk.
+ */
+struct bulk_params {
+  //! Entities in request order, without duplicates
+  std::vector<std::string> entities;
+  //! Number of latest comments returned per entity, 0 to 100
+  std::size_t limit = 0;
+};
+
+/**
+ * @brief Parses the entity of GET /comments/stream from the entity query
+ * parameter, or from the Entity header when the target has no query.
+ * Throws request_error on missing or malformed entities.
+ * @param target Request target
+ * @param headers Request headers
+ */
+std::string parse_stream_entity(std::string_view target, const request_fields& headers);
+
+/**
+ * @brief Parses the Log-Level header of PATCH /admin/log-level.
+ * Throws request_error on missing or unknown levels.
+ * @param headers Request headers
+ */
+boost::log::trivial::severity_level parse_log_level_params(const request_fields& headers);
+
+/**
+ * @brief Parses the headers of GET /comments.
+ * Throws request_error on missing or malformed headers.
+ * @param headers Request headers
+ */
+get_comments_params parse_get_comments_params(const request_fields& headers);
+
+/**
+ * @brief Parses the comment key headers of PATCH requests.
+ * Throws request_error on missing or malformed headers.
+ * @param headers Request headers
+ */
+comment_key parse_comment_key(const request_fields& headers);
+
+/**
+ * @brief Parses the body of POST /comments/bulk.
+ * Throws request_error on missing or malformed members.
+ * @param body Request body
+ * @param max_entities Largest number of entities allowed
+ */
+bulk_params parse_bulk_params(const nlohmann::json& body, std::size_t max_entities);
+
+/**
+ * @brief Returns the text member of a POST /comments/make or PATCH
+ * /comments/change body, empty when it is missing. The body is parsed with
+ * a SAX handler that only keeps the text, other members are skipped
+ * without building a json tree.
+ * Throws request_error on malformed json, on a body that is not an object
+ * and on a text that is not a string.
+ * @param body Request body
+ */
+std::string parse_comment_text(std::string_view body);
+
+/**
+ * @brief Parses the headers of POST /comments/make.
+ * Throws request_error on missing or malformed headers.
+ * @param headers Request headers
+ */
+new_comment_params parse_new_comment_params(const request_fields& headers);
+
+#endif // REQUEST_PARAMS_HPP
@@ -0,0 +1,178 @@
+#ifndef RESPONSE_CACHE_HPP
+#define RESPONSE_CACHE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Settings of the response cache.
+ */
+struct cache_config {
+  //! Upper bound of the cached bodies size in bytes, 0 disables the cache
+  std::size_t max_bytes = 64 * 1024 * 1024;
+  //! Number of independently locked shards
+  std::size_t shards = 16;
+  //! Time a cached page may be served after it was read from the db
+  std::chrono::milliseconds ttl{2000};
+  //! Only pages up to this number are cached
+  long long max_page = 3;
+};
+
+/**
+ * @brief Ready-to-send GET /comments response.
+ */
+struct cached_page {
+  //! Serialized json body
+  std::string body;
+  //! Total number of comments of the entity
+  long long total_rows = 0;
+  //! Cursor of the next page, empty on the last page
+  std::string next_cursor;
+};
+
+/**
+ * @brief Sharded, size-bounded LRU cache of GET /comments responses.
+ *
+ * Pages are grouped by entity, so a write invalidates all cached pages of
+ * its entity at once. Entities are evicted in least recently used order
+ * when the cache grows over max_bytes, pages expire after ttl.
+ */
+class response_cache {
+ public:
+  /**
+   * @brief Constructor of the response_cache class.
+   * @param config Cache settings
+   */
+  explicit response_cache(cache_config config);
+
+  /**
+   * @brief Returns true if the page may be cached.
+   * @param page Page number
+   * @param per_page Page size
+   */
+  bool cacheable(long long page, std::size_t per_page) const;
+
+  /**
+   * @brief Returns the cached page or nullptr.
+   * @param entity Entity
+   * @param page Page number
+   * @param per_page Page size
+   */
+  std::shared_ptr<const cached_page> find(std::string_view entity, long long page,
+    std::size_t per_page);
+
+  /**
+   * @brief Returns the invalidation generation of the shard owning the entity.
+   * Taken before reading the page from the db and passed to insert.
+   * @param entity Entity
+   */
+  std::uint64_t generation(std::string_view entity);
+
+  /**
+   * @brief Caches the page unless the entity was invalidated after the generation was taken.
+   * @param entity Entity
+   * @param page Page number
+   * @param per_page Page size
+   * @param generation Generation taken before reading the page
+   * @param value Page
+   */
+  void insert(std::string_view entity, long long page, std::size_t per_page,
+    std::uint64_t generation, std::shared_ptr<const cached_page> value);
+
+  /**
+   * @brief Drops all cached pages of the entity.
+   * @param entity Entity
+   */
+  void invalidate(std::string_view entity);
+
+  /**
+   * @brief Returns the number of lookups served from the cache.
+   */
+  std::uint64_t hits() const;
+
+  /**
+   * @brief Returns the number of lookups that missed the cache.
+   */
+  std::uint64_t misses() const;
+
+  /**
+   * @brief Returns the number of entities evicted to stay under max_bytes.
+   */
+  std::uint64_t evictions() const;
+
+ private:
+  using clock = std::chrono::steady_clock;
+
+  /**
+   * @brief Cached page with its expiration time.
+   */
+  struct page_entry {
+    std::shared_ptr<const cached_page> value;
+    clock::time_point expires;
+  };
+
+  /**
+   * @brief All cached pages of one entity.
+   */
+  struct entity_entry {
+    std::string entity;
+    std::unordered_map<std::uint64_t, page_entry> pages;
+    std::size_t bytes = 0;
+  };
+
+  /**
+   * @brief Independently locked part of the cache.
+   */
+  struct shard {
+    std::mutex mutex;
+    //! Entities, most recently used first
+    std::list<entity_entry> lru;
+    //! Entity to its position in lru
+    std::unordered_map<std::string_view, std::list<entity_entry>::iterator> index;
+    std::size_t bytes = 0;
+    std::uint64_t generation = 0;
+  };
+
+  /**
+   * @brief Returns the shard owning the entity.
+   * @param entity Entity
+   */
+  shard& shard_of(std::string_view entity);
+
+  /**
+   * @brief Returns the key of the page inside its entity.
+   * @param page Page number
+   * @param per_page Page size
+   */
+  static std::uint64_t page_key(long long page, std::size_t per_page);
+
+  /**
+   * @brief Removes the entity from the shard. The shard must be locked.
+   * @param s Shard
+   * @param it Position of the entity
+   */
+  static void erase(shard& s, std::list<entity_entry>::iterator it);
+
+  //! Cache settings
+  cache_config config_;
+  //! Upper bound of one shard size in bytes
+  std::size_t shard_max_bytes_;
+  //! Shards
+  std::vector<std::unique_ptr<shard>> shards_;
+  //! Number of hits
+  std::atomic<std::uint64_t> hits_{0};
+  //! Number of misses
+  std::atomic<std::uint64_t> misses_{0};
+  //! Number of evictions
+  std::atomic<std::uint64_t> evictions_{0};
+};
+
+#endif // RESPONSE_CACHE_HPP
@@ -0,0 +1,182 @@
+#ifndef SCYLLA_STORE_HPP
+#define SCYLLA_STORE_HPP
+
+#include <cassandra.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include "comment_store.hpp"
+#include "db_session.hpp"
+#include "insert_batcher.hpp"
+#include "tracing.hpp"
+
+/**
+ * @brief Comment store backed by ScyllaDB.
+ *
+ * Uses the tables of the schema mode of the session: reads go to comments
+ * or comments_live, writes go to the primary table first and are mirrored
+ * to the other one in the background. Inserts may be grouped per entity by
+ * an insert_batcher. Cursors are hex encoded driver paging states.
+ */
+class scylla_store : public comment_store, public std::enable_shared_from_this<scylla_store> {
+ public:
+  /**
+   * @brief Constructor of the scylla_store class.
+   * @param db Connected db session
+   * @param batch Insert batching settings
+   */
+  scylla_store(std::shared_ptr<db_session> db, insert_batch_config batch);
+
+  CassUuid new_comment_id() override;
+
+  void list_page(const page_request& request, boost::asio::any_io_executor executor,
+    page_handler handler) override;
+
+  void count(std::string_view entity, boost::asio::any_io_executor executor,
+    count_handler handler) override;
+
+  void insert(const comment_fields& comment, boost::asio::any_io_executor executor,
+    write_handler handler) override;
+
+  void update_text(const comment_key& key, std::string_view text,
+    boost::asio::any_io_executor executor, write_handler handler) override;
+
+  void soft_delete(const comment_key& key, boost::asio::any_io_executor executor,
+    write_handler handler) override;
+
+  /**
+   * @brief Appends the prepared statement, insert batcher and driver metrics.
+   * @param out Output buffer
+   */
+  void append_metrics(std::string& out) override;
+
+  /**
+   * @brief Returns the number of mirror writes and counter updates in flight.
+   */
+  std::size_t background_writes() const override;
+
+  /**
+   * @brief Sends the pending insert batches and closes the db session, which
+   * waits for every query in flight.
+   */
+  void close() override;
+
+ private:
+  /**
+   * @brief Page being collected from one or more db pages.
+   */
+  struct page_state {
+    //! Statement of the page query, reused to fetch the following db pages
+    statement_ptr statement{nullptr, &cass_statement_free};
+    //! Query identifier
+    query_id id = query_id::get_comments;
+    //! True when the page is read after a keyset, its next cursor is then a keyset cursor
+    bool keyset = false;
+    //! Statement run once the first one has no more rows, the older comments
+    //! of a v1 keyset page, empty for none
+    statement_ptr next_statement{nullptr, &cass_statement_free};
+    //! Creation time of the last comment of the page
+    cass_int64_t last_created_time = 0;
+    //! Id of the last comment of the page
+    CassUuid last_comment_id{};
+    //! Number of rows to skip before the page
+    size_t to_skip = 0;
+    //! Number of rows in the page
+    size_t per_page = 0;
+    //! Collected page
+    page_result result;
+    //! Id of the request, attached to the log records
+    std::uint64_t request_id = 0;
+    //! Trace of the request, empty when the request is not traced
+    std::shared_ptr<request_trace> trace;
+    //! Executor to invoke the handler on
+    boost::asio::any_io_executor executor;
+    //! Page handler
+    page_handler handler;
+  };
+
+  /**
+   * @brief Asynchronously fetches db pages until the page is full or the
+   * partition ends.
+   * @param page Page being collected
+   */
+  void fetch_page(std::shared_ptr<page_state> page);
+
+  /**
+   * @brief Appends the rows of the db page to the page, skipping to_skip rows first.
+   * @param result CassResult object of the page query
+   * @param page Page being collected
+   */
+  static void append_rows(const CassResult* result, page_state& page);
+
+  /**
+   * @brief Binds the comment key to a delete or change query.
+   * @param id Query identifier
+   * @param key Comment key
+   * @param first Index of the first key parameter
+   */
+  statement_ptr bind_comment_key(query_id id, const comment_key& key, size_t first);
+
+  /**
+   * @brief Waits for the mutation and invokes the handler. When the mutation
+   * was applied, runs the mirror query and updates the comment counter.
+   * @param queries Mutation query and its mirror
+   * @param result_future CassFuture object of the mutation
+   * @param mirror Statement of the mirror query, empty when there is none
+   * @param entity Entity changed by the query
+   * @param executor Executor to invoke the handler on
+   * @param handler Write handler
+   */
+  void complete_mutation(mutation_queries queries, CassFuture* result_future,
+    statement_ptr mirror, std::string_view entity,
+    boost::asio::any_io_executor executor, write_handler handler);
+
+  /**
+   * @brief Returns the status of a completed mutation.
+   * @param id Query identifier
+   * @param result_future Completed CassFuture object
+   */
+  store_status mutation_status(query_id id, CassFuture* result_future);
+
+  /**
+   * @brief Returns ok if the conditional update was applied, otherwise
+   * not_found for a missing comment or deleted for a deleted one.
+   * @param result_future Completed CassFuture object of the conditional update
+   */
+  static store_status applied_status(CassFuture* result_future);
+
+  /**
+   * @brief Returns true if the query succeeded, otherwise logs the error.
+   * @param id Query identifier
+   * @param result_future Completed CassFuture object
+   */
+  bool query_succeeded(query_id id, CassFuture* result_future);
+
+  /**
+   * @brief Asynchronously runs the query without waiting for the result,
+   * only errors are logged.
+   * @param id Query identifier
+   * @param statement CQL statement
+   * @param entity Entity changed by the query
+   * @param executor Executor to log errors on
+   */
+  void run_in_background(query_id id, statement_ptr statement, std::string_view entity,
+    boost::asio::any_io_executor executor);
+
+  /**
+   * @brief Asynchronously updates the comment counter of the entity without
+   * waiting for the result.
+   * @param id increment_comment_count or decrement_comment_count
+   * @param entity Entity
+   * @param executor Executor to log errors on
+   */
+  void update_comment_count(query_id id, std::string_view entity,
+    boost::asio::any_io_executor executor);
+
+  //! Shared db session
+  std::shared_ptr<db_session> db_;
+  //! Batcher of inserts, nullptr when batching is disabled
+  std::shared_ptr<insert_batcher> batcher_;
+};
+
+#endif // SCYLLA_STORE_HPP
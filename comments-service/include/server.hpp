@@ -16,15 +16,164 @@
 #include <string>
 #include <cmath>
 #include <algorithm>
+#include <string_view>
 #include <unordered_map>
-#include <any>
+#include <functional>
+#include <optional>
+#include <memory_resource>
+#include <atomic>
+#include <mutex>
 #include "logs.hpp"
+#include "config.hpp"
+#include "response_cache.hpp"
+#include "json_writer.hpp"
+#include "request_params.hpp"
+#include "metrics.hpp"
+#include "comment_store.hpp"
+#include "comment_hub.hpp"
+#include "comment_stream.hpp"
+#include "admission.hpp"
+#include "pooled_allocator.hpp"
+#include "tracing.hpp"
 
 namespace beast = boost::beast;
 namespace http = beast::http;
 namespace net = boost::asio;
 using tcp = boost::asio::ip::tcp;
 
+//! Strand of a connection. It is kept as a concrete type because a strand
+//! wrapped in any_io_executor is copied to the heap by every asynchronous operation.
+using connection_executor = net::strand<net::io_context::executor_type>;
+
+//! Socket of a connection
+using connection_socket = tcp::socket::rebind_executor<connection_executor>::other;
+
+/**
+ * @brief Settings of connections that a reload can change. A connection
+ * keeps the settings that were current when it was accepted.
+ */
+struct connection_settings {
+  //! HTTP settings
+  http_config http;
+  //! Bulk fetch settings
+  bulk_config bulk;
+  //! Comment stream settings
+  stream_config stream;
+};
+
+/**
+ * @brief Objects shared by all connections.
+ */
+struct service_context {
+  //! Storage backend
+  std::shared_ptr<comment_store> store;
+  //! Cache of GET /comments responses
+  std::shared_ptr<response_cache> cache;
+  //! Hub of comment events
+  std::shared_ptr<comment_hub> hub;
+  //! Connection cap, concurrency limit and rate limits
+  std::shared_ptr<admission_control> admission;
+  //! Span writer of traced requests, null when tracing is disabled
+  std::shared_ptr<tracer> tracing;
+  //! Requests read and not answered yet, a draining service waits for them
+  std::atomic<unsigned> active_requests{0};
+  //! True once the service drains, responses then close their connections
+  std::atomic<bool> draining{false};
+
+  /**
+   * @brief Returns the settings of new connections.
+   */
+  std::shared_ptr<const connection_settings> settings() const;
+
+  /**
+   * @brief Replaces the settings of new connections.
+   * @param settings New settings
+   */
+  void update_settings(connection_settings settings);
+
+ private:
+  //! Guards settings_
+  mutable std::mutex settings_mutex_;
+  //! Settings of new connections
+  std::shared_ptr<const connection_settings> settings_ = std::make_shared<const connection_settings>();
+};
+
+/**
+ * @brief Page of comments and comment count of GET /comments.
+ */
+struct comments_page {
+  //! Listed page
+  page_result result;
+  //! Number of rows in the page
+  size_t per_page = 0;
+  //! Total number of comments of the entity
+  long long total_rows = 0;
+  //! Entity, points into the request headers
+  std::string_view entity;
+  //! Page number to cache the page under, 0 when the page is not cached
+  long long cache_page = 0;
+  //! Cache generation taken before the page was read
+  std::uint64_t cache_generation = 0;
+  //! Number of store operations in flight
+  int pending = 0;
+  //! True when one of the operations failed
+  bool failed = false;
+};
+
+/**
+ * @brief Latest comments and comment count of one entity of POST /comments/bulk.
+ */
+struct bulk_entity {
+  //! Entity
+  std::string entity;
+  //! Comments as a json array
+  std::string comments;
+  //! Cursor of the next page, kept for the cached GET /comments response
+  std::string next_cursor;
+  //! Total number of comments of the entity
+  long long total_rows = 0;
+  //! Cache generation taken before the page was read, valid when cacheable is set
+  std::uint64_t cache_generation = 0;
+  //! True when the page is inserted into the response cache
+  bool cacheable = false;
+  //! Number of store operations in flight
+  int pending = 0;
+  //! True when all operations are completed
+  bool done = false;
+  //! True when one of the operations failed
+  bool failed = false;
+};
+
+/**
+ * @brief State of one POST /comments/bulk request.
+ *
+ * Entities are fetched concurrently, at most concurrency of them at a time.
+ * Callbacks completed after the response was written only record their
+ * latency, with the route and trace the request had when it started.
+ */
+struct bulk_request {
+  //! Entities in request order
+  std::vector<bulk_entity> entities;
+  //! Number of comments per entity
+  size_t limit = 0;
+  //! Index of the next entity to fetch
+  size_t next = 0;
+  //! Number of entities not fetched yet
+  size_t remaining = 0;
+  //! Timer of the overall deadline
+  net::steady_timer deadline;
+  //! True once the response was written
+  bool finished = false;
+  //! Route of the request, late callbacks must not use the route of the next request
+  route_id route = route_id::other;
+  //! Request id of the request
+  std::uint64_t request_id = 0;
+  //! Trace of the request, empty when it is not traced
+  std::shared_ptr<request_trace> trace;
+
+  explicit bulk_request(const net::any_io_executor& executor) : deadline(executor) {}
+};
+
 /**
  * @brief Http connection class.
  */
@@ -33,8 +182,15 @@ class http_connection : public std::enable_shared_from_this<http_connection> {
     /**
    * @brief Constructor of the http_connection class.
    * @param socket Socket
+   * @param context Objects shared by all connections
    */
-  http_connection(tcp::socket socket);
+  http_connection(connection_socket socket, std::shared_ptr<service_context> context);
+
+  /**
+   * @brief Counts the closed connection.
+   */
+  ~http_connection();
+
   /**
    * @brief Calls read_request and check_deadline.
    */
@@ -42,10 +198,62 @@ class http_connection : public std::enable_shared_from_this<http_connection> {
 
  private:
   /**
-   * @brief Asynchronously reads the request and calls process_request.
+   * @brief Resets the state left by the previous request and waits for the
+   * first byte of the next one.
    */
   void read_request();
 
+  /**
+   * @brief Asynchronously reads the request and calls process_request.
+   */
+  void read_request_message();
+
+  /**
+   * @brief Takes the parsed request and counts it as active until its
+   * response is written.
+   */
+  void start_request();
+
+  /**
+   * @brief Stops counting the current request as active.
+   */
+  void end_request();
+
+  /**
+   * @brief Traces the current request when it carries a valid X-Trace-Id
+   * header or is sampled.
+   */
+  void start_trace();
+
+  /**
+   * @brief Records the latency of a phase of the current request, and its
+   * span when the request is traced.
+   * @param phase Phase
+   * @param start Start of the phase
+   * @param duration Duration of the phase
+   */
+  void record_phase(phase_id phase, std::chrono::steady_clock::time_point start,
+    std::chrono::steady_clock::duration duration) const;
+
+  /**
+   * @brief Records the latency of a phase of a request, and its span when the
+   * request is traced. Used by callbacks that may complete after the request.
+   * @param route Route of the request
+   * @param trace Trace of the request, may be empty
+   * @param phase Phase
+   * @param start Start of the phase
+   * @param duration Duration of the phase
+   */
+  static void record_phase(route_id route, const std::shared_ptr<request_trace>& trace,
+    phase_id phase, std::chrono::steady_clock::time_point start,
+    std::chrono::steady_clock::duration duration);
+
+  /**
+   * @brief Answers a request whose body exceeds the body limit with 413
+   * Payload Too Large and closes the connection, the rest of the body is not read.
+   */
+  void reject_oversized_request();
+
   /**
    * @brief Causes the request to be processed according to the corresponding 
    * GET POST PATCH type, and then calls write_response.
@@ -57,6 +265,27 @@ class http_connection : public std::enable_shared_from_this<http_connection> {
    */
   void setup_response();
 
+  /**
+   * @brief Takes a concurrency slot for a store request and a token for a new
+   * comment. Returns false and sets 503 Service Unavailable or 429 Too Many
+   * Requests with Retry-After when the request is turned away.
+   */
+  bool admit_request();
+
+  /**
+   * @brief Sets the response of a request turned away by admission control.
+   * @param status Response status
+   * @param retry_after Time after which the client may retry
+   * @param reason Reason of the rejection
+   */
+  void reject_request(http::status status, std::chrono::milliseconds retry_after,
+    reject_reason reason);
+
+  /**
+   * @brief Returns the client key of the make rate limit.
+   */
+  std::string rate_limit_client() const;
+
   /**
    * @brief Checks the target URL.
    */
@@ -73,15 +302,21 @@ class http_connection : public std::enable_shared_from_this<http_connection> {
   void handle_patch_request();
 
    /**
-   * @brief Writing from the buffer and sending a response.
+   * @brief Writing from the buffer and sending a response. Reads the next request
+   * if the connection is kept alive, otherwise closes it.
    */ 
   void write_response();
 
    /**
-   * @brief Checks the lifetime of current session.
+   * @brief Closes the connection when it stays idle for longer than the idle timeout.
    */ 
   void check_deadline();
 
+  /**
+   * @brief Shuts down and closes the socket.
+   */
+  void close();
+
   /**
    * @brief Retrieves data from the query and creates an sql query.
    */
@@ -103,9 +338,72 @@ class http_connection : public std::enable_shared_from_this<http_connection> {
   void change_comment();
 
   /**
-   * @brief Checks if the comment exists. Returns true if the comment exists otherwise returns false.
+   * @brief Fetches the latest comments and the comment counts of several
+   * entities concurrently and writes them as one response.
+   */
+  void bulk_comments();
+
+  /**
+   * @brief Starts fetching the next entity of the bulk request, entities
+   * found in the response cache are completed right away.
+   * @param bulk Bulk request
+   */
+  void start_bulk_entity(std::shared_ptr<bulk_request> bulk);
+
+  /**
+   * @brief Asynchronously lists the latest limit comments of the entity.
+   * @param bulk Bulk request
+   * @param index Index of the entity
+   */
+  void fetch_bulk_page(std::shared_ptr<bulk_request> bulk, size_t index);
+
+  /**
+   * @brief Asynchronously reads the comment counter of the entity.
+   * @param bulk Bulk request
+   * @param index Index of the entity
+   */
+  void count_bulk_entity(std::shared_ptr<bulk_request> bulk, size_t index);
+
+  /**
+   * @brief Completes one store operation of the entity. Once the entity is fetched,
+   * starts the next one or writes the response after the last one.
+   * @param bulk Bulk request
+   * @param index Index of the entity
+   */
+  void finish_bulk_query(std::shared_ptr<bulk_request> bulk, size_t index);
+
+  /**
+   * @brief Writes the fetched entities, the others are reported as timed out.
+   * @param bulk Bulk request
+   */
+  void write_bulk_response(std::shared_ptr<bulk_request> bulk);
+
+  /**
+   * @brief Hands the socket over to a comment_stream of the entity.
+   */
+  void stream_comments();
+
+  /**
+   * @brief Writes the service, cache, stream and storage backend metrics
+   * in the Prometheus text format.
    */
-  bool is_comment_exists();
+  void get_metrics();
+
+  /**
+   * @brief Returns true when the request carries the admin token, otherwise
+   * answers it with 403 Forbidden.
+   */
+  bool authorize_admin();
+
+  /**
+   * @brief Writes the current log level and the number of dropped log records.
+   */
+  void get_log_level();
+
+  /**
+   * @brief Changes the log level to the Log-Level header.
+   */
+  void change_log_level();
 
   /**
    * @brief Retrieves a json object from the request body.
@@ -113,58 +411,138 @@ class http_connection : public std::enable_shared_from_this<http_connection> {
   nlohmann::json get_request_json_body() const;
 
   /**
-   * @brief Creates a session and connects to the database.
-   * @param statement CQL statement
+   * @brief Retrieves the text member of the request body.
+   */
+  std::string get_request_text() const;
+
+  /**
+   * @brief Returns the handler of a store write that records its latency and
+   * calls finish_mutation.
+   * @param entity Entity changed by the write
+   * @param success Response status when the write is applied
+   */
+  comment_store::write_handler mutation_handler(std::string_view entity, http::status success);
+
+  /**
+   * @brief Handles the completed write and calls write_response. When the
+   * write was applied, invalidates the cached pages of the entity and
+   * publishes the event of the request.
+   * @param status Status of the write
+   * @param entity Entity changed by the write
+   * @param success Response status when the write is applied
    */
-  void connect(CassStatement* statement);
+  void finish_mutation(store_status status, std::string_view entity, http::status success);
 
   /**
-   * @brief Executes query.
-   * @param statement CQL statement
+   * @brief Returns true if the store operation succeeded, otherwise sets
+   * 404 Not Found for a missing comment, 409 Conflict for a deleted one or
+   * 400 Bad Request for a failed backend.
+   * @param status Status of the operation
    */
-  void execute_query(CassStatement* statement);
+  bool check_store_status(store_status status);
 
   /**
-   * @brief Processes the response from the database.
-   * @param result_future CassFuture object representing furure result of the query
+   * @brief Writes the page to the response once all its store operations are completed.
+   * @param page Page being collected
    */
-  void handle_query_result(CassFuture* result_future);
+  void finish_comments_page(std::shared_ptr<comments_page> page);
 
   /**
-   * @brief Returns json row from databas response.
-   * @param result CassResult object representing result of the query
-   * @param rows Iterator for the rows of the result 
+   * @brief Sets the pagination headers and the body of the response.
+   * @param page Serialized page
+   * @param per_page Page size
    */
-  nlohmann::json get_json_row(const CassResult* result, CassIterator* rows) const;
+  void write_comments_page(const cached_page& page, size_t per_page);
+
   
   //! Socker
-  tcp::socket socket_;
+  connection_socket socket_;
+
+  //! Buffer for request
+  beast::flat_static_buffer<8192> buffer_;
+
+  //! Initial block of the per-request arena, big enough for the header
+  //! fields of usual requests and responses
+  alignas(std::max_align_t) std::byte arena_buffer_[4096];
+
+  //! Per-request arena of the header fields, released before the next request is read
+  std::pmr::monotonic_buffer_resource arena_{arena_buffer_, sizeof(arena_buffer_)};
 
-  //! Buffer for response
-  beast::flat_buffer buffer_{8192};
+  //! Parser of the next request, limits the body size
+  std::optional<request_parser> parser_;
 
   //! Request
-  http::request<http::dynamic_body> request_;
+  http::request<http::string_body, request_fields> request_{
+    std::piecewise_construct, std::make_tuple(), std::make_tuple(&arena_)};
 
   //! Response
-  http::response<http::dynamic_body> response_;
+  http::response<http::string_body, request_fields> response_{
+    std::piecewise_construct, std::make_tuple(), std::make_tuple(&arena_)};
+
+  //! Serializer of the response being written
+  std::optional<http::response_serializer<http::string_body, request_fields>> serializer_;
   
-  //! Timer for session timeout
-  net::steady_timer deadline_{socket_.get_executor(), std::chrono::seconds(60)};
-
-  //! Request objects in unordered_map
-  std::unordered_map<std::string, std::any> request_un_map_;
-  //! Available ScyllaDB connection hosts
-  const char* hosts_ = "scylla-node1"; //scylla-node1 172.22.0.3, 172.22.0.2
-  //! db session
-  std::unique_ptr<CassSession, decltype(&cass_session_free)> session_ = std::unique_ptr<CassSession, decltype(&cass_session_free)>(cass_session_new(), &cass_session_free);
+  //! Timer for idle timeout
+  net::steady_timer::rebind_executor<connection_executor>::other deadline_{socket_.get_executor()};
+
+  //! Objects shared by all connections
+  std::shared_ptr<service_context> context_;
+  //! Settings current when the connection was accepted
+  std::shared_ptr<const connection_settings> settings_;
+  //! Number of requests served on this connection
+  unsigned requests_served_ = 0;
   //! Request target
   beast::string_view target_;
+  //! True when the response is written by a db completion handler
+  bool awaiting_db_ = false;
+  //! True when the socket was handed over and no response is written
+  bool detached_ = false;
+  //! True while the current request holds an admission slot
+  bool admitted_ = false;
+  //! True while the current request is counted in active_requests
+  bool active_ = false;
+  //! Event published when the current mutation is applied, empty when the
+  //! entity has no subscribers
+  std::string event_;
+  //! Id of the current request, attached to its log records
+  std::uint64_t request_id_ = 0;
+  //! Route of the current request
+  route_id route_ = route_id::other;
+  //! Trace of the current request, empty when it is not traced
+  std::shared_ptr<request_trace> trace_;
+  //! Time the first byte of the current request was available
+  std::chrono::steady_clock::time_point read_start_;
+  //! Time the current request was parsed
+  std::chrono::steady_clock::time_point request_start_;
 };
 
 /**
- * @brief Starts the server.
+ * @brief Opens an acceptor listening on the endpoint.
+ * @param ioc io_context of the acceptor
+ * @param endpoint Listen endpoint
+ * @param reuse_port Allows several acceptors to listen on the same port (SO_REUSEPORT)
+ */
+tcp::acceptor make_acceptor(net::io_context& ioc, const tcp::endpoint& endpoint, bool reuse_port);
+
+/**
+ * @brief Opens an acceptor on a duplicate of a listening socket inherited
+ * from the parent process.
+ * @param ioc io_context of the acceptor
+ * @param fd Listening socket
+ */
+tcp::acceptor adopt_acceptor(net::io_context& ioc, int fd);
+
+/**
+ * @brief Returns the listening socket passed by socket activation
+ * (LISTEN_FDS and LISTEN_PID, the first passed socket is fd 3), or -1.
+ */
+int inherited_listen_fd();
+
+/**
+ * @brief Starts the server. Every connection runs on its own strand.
+ * @param acceptor Acceptor
+ * @param context Objects shared by all connections
  */
-void http_server(tcp::acceptor& acceptor, tcp::socket& socket);
+void http_server(tcp::acceptor& acceptor, std::shared_ptr<service_context> context);
 
 #endif // SERVER_HPP
\ No newline at end of file
@@ -0,0 +1,195 @@
+#ifndef STATEMENTS_HPP
+#define STATEMENTS_HPP
+
+#include <cassandra.h>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include "logs.hpp"
+
+//! Owning pointer to a CQL statement
+using statement_ptr = std::unique_ptr<CassStatement, decltype(&cass_statement_free)>;
+//! Owning pointer to a query result
+using result_ptr = std::unique_ptr<const CassResult, decltype(&cass_result_free)>;
+
+/**
+ * @brief Identifiers of the CQL queries used by the service.
+ */
+enum class query_id : std::size_t {
+  get_comments,
+  get_comments_after,
+  get_comments_same_time,
+  get_live_comments,
+  get_live_comments_after,
+  get_comment_count,
+  increment_comment_count,
+  decrement_comment_count,
+  add_comment_count,
+  add_comment,
+  add_live_comment,
+  delete_comment,
+  delete_comment_mirror,
+  delete_live_comment,
+  delete_live_comment_mirror,
+  change_comment,
+  change_comment_mirror,
+  change_live_comment,
+  change_live_comment_mirror,
+  count
+};
+
+/**
+ * @brief Layout of the comment tables.
+ */
+enum class schema_mode {
+  //! comments table only, reads go through the deleted secondary index
+  v1,
+  //! Writes go to comments and comments_live, reads to comments
+  dual,
+  //! Reads go to comments_live, writes to both tables
+  v2
+};
+
+/**
+ * @brief Conditional mutation and its copy for the other comment table.
+ *
+ * The primary query is conditional and decides the response, the mirror
+ * query is run only when the primary one was applied.
+ */
+struct mutation_queries {
+  //! Conditional query
+  query_id primary;
+  //! Copy for the other table, query_id::count when there is none
+  query_id mirror;
+};
+
+/**
+ * @brief Returns the page query of the schema.
+ *
+ * comments is clustered by created_time DESC and comment_id ASC, so a v1
+ * keyset page first reads the comments created at the keyset time after its
+ * comment id with get_comments_same_time, then the older ones with
+ * get_comments_after.
+ * @param mode Schema mode
+ * @param keyset True when the page starts after a created time and comment id
+ */
+query_id page_query(schema_mode mode, bool keyset);
+
+/**
+ * @brief Returns the delete queries of the schema.
+ * @param mode Schema mode
+ */
+mutation_queries delete_queries(schema_mode mode);
+
+/**
+ * @brief Returns the change queries of the schema.
+ * @param mode Schema mode
+ */
+mutation_queries change_queries(schema_mode mode);
+
+/**
+ * @brief Registry of prepared statements.
+ *
+ * Every query is prepared once at startup and then bound from the cached
+ * CassPrepared object, so Scylla does not parse the query on every call
+ * and the driver can route requests to the replicas owning the partition.
+ * An entry that was invalidated (UNPREPARED error, schema change) is
+ * prepared again in the background while requests fall back to simple
+ * statements.
+ */
+class prepared_statements {
+ public:
+  /**
+   * @brief Constructor of the prepared_statements class.
+   * @param session Connected db session
+   */
+  explicit prepared_statements(CassSession* session);
+
+  prepared_statements(const prepared_statements&) = delete;
+  prepared_statements& operator=(const prepared_statements&) = delete;
+
+  /**
+   * @brief Prepares all queries used in the schema mode, blocking until done.
+   * Throws std::runtime_error when a query can not be prepared.
+   * @param mode Schema mode
+   */
+  void prepare_all(schema_mode mode);
+
+  /**
+   * @brief Returns a new statement for the query. Counter updates are not
+   * idempotent and are never retried by the driver, a retried update could
+   * be applied twice.
+   * @param id Query identifier
+   */
+  statement_ptr bind(query_id id);
+
+  /**
+   * @brief Drops the cached prepared statement and prepares it again.
+   * @param id Query identifier
+   */
+  void invalidate(query_id id);
+
+  /**
+   * @brief Drops the cached prepared statement on an UNPREPARED error, the
+   * only error that means it is stale.
+   * @param id Query identifier
+   * @param error Error code of the failed execution
+   */
+  void handle_error(query_id id, CassError error);
+
+  /**
+   * @brief Returns the number of statements bound from a cached prepared statement.
+   */
+  std::uint64_t hits() const;
+
+  /**
+   * @brief Returns the number of statements that fell back to a simple statement.
+   */
+  std::uint64_t misses() const;
+
+  /**
+   * @brief Returns the CQL text of the query.
+   * @param id Query identifier
+   */
+  static const char* text(query_id id);
+
+ private:
+  //! Shared pointer to a prepared statement
+  using prepared_ptr = std::shared_ptr<const CassPrepared>;
+
+  /**
+   * @brief Prepares the query in the background.
+   * @param id Query identifier
+   */
+  void prepare_async(query_id id);
+
+  /**
+   * @brief Stores the result of the background preparation.
+   * @param future Completed prepare future
+   * @param data Pointer to the pending_prepare object
+   */
+  static void on_prepared(CassFuture* future, void* data);
+
+  //! Number of queries
+  static constexpr std::size_t size_ = static_cast<std::size_t>(query_id::count);
+
+  //! Driver session
+  CassSession* session_;
+  //! Retry policy of the counter updates, returns every error to the caller
+  std::unique_ptr<CassRetryPolicy, decltype(&cass_retry_policy_free)> no_retry_{
+    cass_retry_policy_fallthrough_new(), &cass_retry_policy_free};
+  //! Guards prepared_ and preparing_
+  std::mutex mutex_;
+  //! Cached prepared statements
+  std::array<prepared_ptr, size_> prepared_;
+  //! Queries being prepared in the background
+  std::array<bool, size_> preparing_{};
+  //! Number of binds from cache
+  std::atomic<std::uint64_t> hits_{0};
+  //! Number of fallbacks to simple statements
+  std::atomic<std::uint64_t> misses_{0};
+};
+
+#endif // STATEMENTS_HPP
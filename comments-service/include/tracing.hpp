@@ -0,0 +1,223 @@
+#ifndef TRACING_HPP
+#define TRACING_HPP
+
+#include <cassandra.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+/**
+ * @brief Settings of request tracing.
+ */
+struct trace_config {
+  //! Trace event file, empty disables tracing
+  std::string file;
+  //! One in sample_rate requests is traced, 0 disables sampling
+  unsigned sample_rate = 0;
+  //! Traces every request with X-Trace-Id, otherwise they are sampled like the others
+  bool honor_header = false;
+  //! Largest time spans wait in memory before they are written
+  std::chrono::milliseconds flush_interval{1000};
+  //! Buffered size above which spans are written right away
+  std::size_t flush_bytes = 64 * 1024;
+  //! Buffered size above which new spans are dropped
+  std::size_t max_buffer_bytes = 16 * 1024 * 1024;
+};
+
+/**
+ * @brief Writes spans of traced requests to a file in the Chrome trace event
+ * format, which chrome://tracing and Perfetto open.
+ *
+ * Spans are appended to a buffer under a mutex and written in batches by a
+ * background thread, requests never wait for the file. Every traced request
+ * gets its own track, the request id.
+ */
+class tracer {
+ public:
+  /**
+   * @brief Constructor of the tracer class, opens the file and starts the writer thread.
+   * Throws std::runtime_error when the file can not be opened.
+   * @param config Tracing settings
+   */
+  explicit tracer(trace_config config);
+
+  /**
+   * @brief Writes the buffered spans and closes the file.
+   */
+  ~tracer();
+
+  tracer(const tracer&) = delete;
+  tracer& operator=(const tracer&) = delete;
+
+  /**
+   * @brief Returns true when the next request of the calling thread is sampled.
+   */
+  bool sample();
+
+  /**
+   * @brief Returns true when every request with an X-Trace-Id header is traced.
+   */
+  bool honors_header() const;
+
+  /**
+   * @brief Returns a new random trace id of 16 hex digits.
+   */
+  static std::string new_trace_id();
+
+  /**
+   * @brief Returns true when a trace id taken from a request header is
+   * short enough and only made of letters, digits, '-' and '_'.
+   * @param trace_id Trace id
+   */
+  static bool valid_trace_id(std::string_view trace_id);
+
+  /**
+   * @brief Records a complete span.
+   * @param trace_id Trace id of the request
+   * @param request_id Request id, the track of the span
+   * @param name Span name
+   * @param category Span category, the route of the request
+   * @param start Start of the span
+   * @param duration Duration of the span
+   */
+  void record_span(std::string_view trace_id, std::uint64_t request_id, std::string_view name,
+    std::string_view category, std::chrono::steady_clock::time_point start,
+    std::chrono::steady_clock::duration duration);
+
+  /**
+   * @brief Records the id of the Scylla tracing session of a query, the
+   * session is found in system_traces.sessions.
+   * @param trace_id Trace id of the request
+   * @param request_id Request id, the track of the event
+   * @param query Query text
+   * @param session_id Tracing session id
+   */
+  void record_db_session(std::string_view trace_id, std::uint64_t request_id,
+    std::string_view query, const CassUuid& session_id);
+
+  /**
+   * @brief Returns the number of recorded spans.
+   */
+  std::uint64_t spans() const;
+
+  /**
+   * @brief Returns the number of spans dropped because the buffer was full.
+   */
+  std::uint64_t dropped_spans() const;
+
+ private:
+  /**
+   * @brief Appends an event to the buffer, wakes the writer when the buffer is big enough.
+   * @param event Event as a json object
+   */
+  void append_event(const std::string& event);
+
+  /**
+   * @brief Writes the buffer every flush interval or once it is big enough.
+   */
+  void run_writer();
+
+  /**
+   * @brief Converts a steady clock time to microseconds since the epoch.
+   * @param time Steady clock time
+   */
+  std::int64_t to_micros(std::chrono::steady_clock::time_point time) const;
+
+  //! Tracing settings
+  trace_config config_;
+  //! Trace event file
+  std::unique_ptr<std::FILE, int (*)(std::FILE*)> file_;
+  //! Process id of the events
+  std::int64_t pid_;
+  //! System time minus steady time, converts span times to the epoch
+  std::chrono::microseconds epoch_offset_;
+  //! Guards buffer_ and stopping_
+  std::mutex mutex_;
+  //! Signals the writer thread
+  std::condition_variable wake_;
+  //! Events not written yet
+  std::string buffer_;
+  //! True once the writer thread has to stop
+  bool stopping_ = false;
+  //! Number of recorded spans
+  std::atomic<std::uint64_t> spans_{0};
+  //! Number of dropped spans
+  std::atomic<std::uint64_t> dropped_spans_{0};
+  //! Writer thread
+  std::thread writer_;
+};
+
+/**
+ * @brief Trace of one sampled request, shared with the store operations it starts.
+ */
+struct request_trace {
+  //! Span writer
+  std::shared_ptr<tracer> writer;
+  //! Trace id, returned in the X-Trace-Id header
+  std::string trace_id;
+  //! Request id, the track of the spans
+  std::uint64_t request_id = 0;
+};
+
+/**
+ * @brief Makes the trace of a request current on the calling thread for the
+ * lifetime of the scope. Store operations started meanwhile ask the driver
+ * to trace their queries.
+ */
+class trace_scope {
+ public:
+  /**
+   * @brief Constructor of the trace_scope class.
+   * @param trace Trace of the request, empty when the request is not traced
+   */
+  explicit trace_scope(const std::shared_ptr<request_trace>& trace);
+
+  /**
+   * @brief Restores the trace of the enclosing scope.
+   */
+  ~trace_scope();
+
+  trace_scope(const trace_scope&) = delete;
+  trace_scope& operator=(const trace_scope&) = delete;
+
+ private:
+  //! Trace of the enclosing scope
+  const std::shared_ptr<request_trace>* previous_;
+};
+
+/**
+ * @brief Returns the trace of the current scope, empty outside of traced
+ * requests. Captured by store operations that record their db tracing session.
+ */
+std::shared_ptr<request_trace> current_trace();
+
+/**
+ * @brief Asks the driver to trace the statement when the current request is traced.
+ * @param statement Statement
+ */
+void trace_statement(CassStatement* statement);
+
+/**
+ * @brief Asks the driver to trace the batch when the current request is traced.
+ * @param batch Batch
+ */
+void trace_batch(CassBatch* batch);
+
+/**
+ * @brief Records the tracing session of a completed query of a traced request.
+ * @param trace Trace of the request, may be empty
+ * @param query Query text
+ * @param result_future Completed future of the query
+ */
+void record_db_trace(const std::shared_ptr<request_trace>& trace, std::string_view query,
+  CassFuture* result_future);
+
+#endif // TRACING_HPP
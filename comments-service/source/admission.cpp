@@ -0,0 +1,166 @@
+#include "admission.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace {
+
+//! Number of independently locked bucket shards
+constexpr std::size_t bucket_shards = 16;
+
+//! Label values of the rejection reasons
+constexpr std::string_view reason_labels[] = {
+  "reason=\"connections\"", "reason=\"concurrency\"", "reason=\"rate\""};
+
+} // namespace
+
+admission_control::admission_control(admission_config config) : config_(std::move(config)) {
+  config_.min_in_flight = std::clamp(config_.min_in_flight, 1u, std::max(config_.max_in_flight, 1u));
+  config_.make_burst = std::max(config_.make_burst, 1.0);
+  limit_.store(config_.max_in_flight, std::memory_order_relaxed);
+
+  shards_.reserve(bucket_shards);
+  for (std::size_t i = 0; i < bucket_shards; ++i) {
+    shards_.push_back(std::make_unique<bucket_shard>());
+  }
+}
+
+bool admission_control::try_open_connection() {
+  if (config_.max_connections == 0) {
+    connections_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  auto current = connections_.load(std::memory_order_relaxed);
+  do {
+    if (current >= config_.max_connections) {
+      return false;
+    }
+  } while (!connections_.compare_exchange_weak(current, current + 1, std::memory_order_relaxed));
+  return true;
+}
+
+void admission_control::close_connection() {
+  connections_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+bool admission_control::try_acquire() {
+  if (config_.max_in_flight == 0) {
+    in_flight_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  auto limit = static_cast<unsigned>(limit_.load(std::memory_order_relaxed));
+  auto current = in_flight_.load(std::memory_order_relaxed);
+  do {
+    if (current >= limit) {
+      return false;
+    }
+  } while (!in_flight_.compare_exchange_weak(current, current + 1, std::memory_order_relaxed));
+  return true;
+}
+
+void admission_control::release(std::chrono::steady_clock::duration service_time) {
+  auto in_flight = in_flight_.fetch_sub(1, std::memory_order_relaxed);
+  if (config_.adaptive && config_.max_in_flight != 0) {
+    adapt_limit(service_time, in_flight);
+  }
+}
+
+void admission_control::cancel() {
+  in_flight_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void admission_control::adapt_limit(std::chrono::steady_clock::duration service_time,
+  unsigned in_flight) {
+  auto limit = limit_.load(std::memory_order_relaxed);
+
+  if (service_time > config_.target_latency) {
+    // One decrease per target latency, the requests that were already in
+    // process when the limit dropped would otherwise shrink it again.
+    auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+    auto last = last_decrease_.load(std::memory_order_relaxed);
+    auto window = std::chrono::duration_cast<std::chrono::nanoseconds>(config_.target_latency).count();
+    if (now - last < window ||
+        !last_decrease_.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+      return;
+    }
+    while (!limit_.compare_exchange_weak(limit,
+      std::max<double>(config_.min_in_flight, limit * 0.9), std::memory_order_relaxed)) {
+    }
+    return;
+  }
+
+  // An idle service says nothing about a higher limit.
+  if (in_flight * 2 < limit) {
+    return;
+  }
+  while (limit < config_.max_in_flight && !limit_.compare_exchange_weak(limit,
+    std::min<double>(config_.max_in_flight, limit + 1.0 / limit), std::memory_order_relaxed)) {
+  }
+}
+
+std::chrono::milliseconds admission_control::take_make_token(std::string_view client,
+  std::chrono::steady_clock::time_point now) {
+  if (config_.make_rate <= 0) {
+    return std::chrono::milliseconds(0);
+  }
+
+  const auto refill = [&](const bucket& b) {
+    return std::min(config_.make_burst, b.tokens + config_.make_rate *
+      std::chrono::duration<double>(now - b.updated).count());
+  };
+
+  auto& s = *shards_[std::hash<std::string_view>{}(client) % shards_.size()];
+  std::lock_guard lock(s.mutex);
+
+  // A full bucket behaves like a missing one, so dropping them changes nothing.
+  if (s.buckets.size() >= std::max<std::size_t>(config_.max_clients / shards_.size(), 1)) {
+    std::erase_if(s.buckets, [&](const auto& entry) {
+      return refill(entry.second) >= config_.make_burst;
+    });
+  }
+
+  auto [it, inserted] = s.buckets.try_emplace(std::string(client));
+  auto& b = it->second;
+  b.tokens = inserted ? config_.make_burst : refill(b);
+  b.updated = now;
+
+  if (b.tokens >= 1) {
+    b.tokens -= 1;
+    return std::chrono::milliseconds(0);
+  }
+  return std::chrono::milliseconds(static_cast<long long>(
+    std::ceil((1 - b.tokens) * 1000 / config_.make_rate)));
+}
+
+long long retry_after_seconds(std::chrono::milliseconds wait) {
+  return std::max<long long>(1, (wait.count() + 999) / 1000);
+}
+
+void admission_control::count_rejected(reject_reason reason) {
+  rejected_[static_cast<std::size_t>(reason)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void admission_control::append_metrics(std::string& out) const {
+  append_metric_header(out, "comments_admission_connections", "gauge",
+    "Open connections counted against the connection limit");
+  append_metric_value(out, "comments_admission_connections", "",
+    static_cast<double>(connections_.load(std::memory_order_relaxed)));
+  append_metric_header(out, "comments_admission_in_flight", "gauge",
+    "Requests in process");
+  append_metric_value(out, "comments_admission_in_flight", "",
+    static_cast<double>(in_flight_.load(std::memory_order_relaxed)));
+  append_metric_header(out, "comments_admission_limit", "gauge",
+    "Current limit of requests in process, 0 is unlimited");
+  append_metric_value(out, "comments_admission_limit", "",
+    std::floor(limit_.load(std::memory_order_relaxed)));
+  append_metric_header(out, "comments_admission_rejected_total", "counter",
+    "Connections and requests turned away by admission control");
+  for (std::size_t i = 0; i < static_cast<std::size_t>(reject_reason::count); ++i) {
+    append_metric_value(out, "comments_admission_rejected_total", reason_labels[i],
+      static_cast<double>(rejected_[i].load(std::memory_order_relaxed)));
+  }
+}
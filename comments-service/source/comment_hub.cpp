@@ -0,0 +1,92 @@
+#include "comment_hub.hpp"
+#include <algorithm>
+#include <functional>
+
+comment_hub::comment_hub(std::size_t shards) {
+  shards = std::max<std::size_t>(shards, 1);
+  shards_.reserve(shards);
+  for(std::size_t i = 0; i < shards; ++i) {
+    shards_.push_back(std::make_unique<shard>());
+  }
+}
+
+void comment_hub::subscribe(const std::string& entity, std::weak_ptr<comment_subscriber> subscriber) {
+  auto address = subscriber.lock().get();
+  if(address == nullptr) {
+    return;
+  }
+
+  auto& s = shard_of(entity);
+  std::lock_guard lock(s.mutex);
+  s.entities[entity].push_back(entry{address, std::move(subscriber)});
+  subscribers_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void comment_hub::unsubscribe(const std::string& entity, const comment_subscriber* subscriber) {
+  auto& s = shard_of(entity);
+  std::lock_guard lock(s.mutex);
+
+  auto it = s.entities.find(entity);
+  if(it == s.entities.end()) {
+    return;
+  }
+
+  auto& entries = it->second;
+  auto found = std::find_if(entries.begin(), entries.end(),
+    [subscriber](const entry& e) { return e.address == subscriber; });
+  if(found != entries.end()) {
+    *found = std::move(entries.back());
+    entries.pop_back();
+    subscribers_.fetch_sub(1, std::memory_order_relaxed);
+  }
+  if(entries.empty()) {
+    s.entities.erase(it);
+  }
+}
+
+bool comment_hub::has_subscribers(std::string_view entity) {
+  auto& s = shard_of(entity);
+  std::lock_guard lock(s.mutex);
+  return s.entities.find(std::string(entity)) != s.entities.end();
+}
+
+void comment_hub::publish(std::string_view entity, std::shared_ptr<const std::string> event) {
+  auto& s = shard_of(entity);
+  std::lock_guard lock(s.mutex);
+
+  auto it = s.entities.find(std::string(entity));
+  if(it == s.entities.end()) {
+    return;
+  }
+
+  // push never blocks, so the shard stays locked only for the queue appends.
+  auto& entries = it->second;
+  for(std::size_t i = 0; i < entries.size();) {
+    auto subscriber = entries[i].subscriber.lock();
+    if(subscriber && subscriber->push(event)) {
+      ++i;
+      continue;
+    }
+    if(subscriber) {
+      evictions_.fetch_add(1, std::memory_order_relaxed);
+    }
+    entries[i] = std::move(entries.back());
+    entries.pop_back();
+    subscribers_.fetch_sub(1, std::memory_order_relaxed);
+  }
+  if(entries.empty()) {
+    s.entities.erase(it);
+  }
+}
+
+std::uint64_t comment_hub::subscribers() const {
+  return subscribers_.load(std::memory_order_relaxed);
+}
+
+std::uint64_t comment_hub::evictions() const {
+  return evictions_.load(std::memory_order_relaxed);
+}
+
+comment_hub::shard& comment_hub::shard_of(std::string_view entity) {
+  return *shards_[std::hash<std::string_view>{}(entity) % shards_.size()];
+}
@@ -0,0 +1,130 @@
+#include "comment_stream.hpp"
+#include "logs.hpp"
+
+namespace net = boost::asio;
+
+comment_stream::comment_stream(net::ip::tcp::socket socket, std::shared_ptr<comment_hub> hub,
+  std::string entity, stream_config config) :
+  socket_(std::move(socket)),
+  heartbeat_timer_(socket_.get_executor()),
+  hub_(std::move(hub)),
+  entity_(std::move(entity)),
+  config_(std::move(config)) {}
+
+void comment_stream::start(std::uint64_t request_id) {
+  // The body is delimited by the end of the connection.
+  auto header = std::make_shared<std::string>(
+    "HTTP/1.1 200 OK\r\n"
+    "Server: presetshare.comments\r\n"
+    "Content-Type: text/event-stream\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: close\r\n"
+    "X-Request-Id: " + std::to_string(request_id) + "\r\n\r\n");
+
+  {
+    std::lock_guard lock(mutex_);
+    queue_.push_back(std::move(header));
+    writing_ = true;
+  }
+  hub_->subscribe(entity_, weak_from_this());
+
+  write_next();
+  wait_for_close();
+  heartbeat();
+}
+
+bool comment_stream::push(std::shared_ptr<const std::string> event) {
+  bool start_write = false;
+  {
+    std::lock_guard lock(mutex_);
+    if(closed_) {
+      return false;
+    }
+    if(queue_.size() >= config_.max_queue) {
+      closed_ = true;
+      net::post(socket_.get_executor(), [self = shared_from_this()] { self->close(); });
+      return false;
+    }
+    queue_.push_back(std::move(event));
+    start_write = !writing_;
+    writing_ = true;
+  }
+
+  if(start_write) {
+    net::post(socket_.get_executor(), [self = shared_from_this()] { self->write_next(); });
+  }
+  return true;
+}
+
+void comment_stream::write_next() {
+  std::shared_ptr<const std::string> event;
+  {
+    std::lock_guard lock(mutex_);
+    if(closed_ || queue_.empty()) {
+      writing_ = false;
+      return;
+    }
+    event = queue_.front();
+  }
+
+  net::async_write(socket_, net::buffer(*event),
+    [self = shared_from_this(), event](boost::system::error_code ec, std::size_t) {
+      if(ec) {
+        self->close();
+        return;
+      }
+      {
+        std::lock_guard lock(self->mutex_);
+        if(!self->queue_.empty()) {
+          self->queue_.pop_front();
+        }
+      }
+      self->write_next();
+    });
+}
+
+void comment_stream::wait_for_close() {
+  // Data sent by the client is discarded, the read fails when the client goes away.
+  socket_.async_read_some(net::buffer(read_buffer_),
+    [self = shared_from_this()](boost::system::error_code ec, std::size_t) {
+      if(ec) {
+        self->close();
+      } else {
+        self->wait_for_close();
+      }
+    });
+}
+
+void comment_stream::heartbeat() {
+  static const auto keep_alive = std::make_shared<const std::string>(":\n\n");
+
+  heartbeat_timer_.expires_after(config_.heartbeat);
+  heartbeat_timer_.async_wait([self = shared_from_this()](boost::system::error_code ec) {
+    if(ec || !self->socket_.is_open()) {
+      return;
+    }
+    if(self->push(keep_alive)) {
+      self->heartbeat();
+    }
+  });
+}
+
+void comment_stream::close() {
+  {
+    std::lock_guard lock(mutex_);
+    closed_ = true;
+    queue_.clear();
+  }
+  if(!socket_.is_open()) {
+    return;
+  }
+
+  BOOST_LOG_TRIVIAL(debug)
+    << "Comment stream of entity " << entity_ << " is closed";
+
+  hub_->unsubscribe(entity_, this);
+  boost::system::error_code ec;
+  socket_.shutdown(net::ip::tcp::socket::shutdown_both, ec);
+  socket_.close(ec);
+  heartbeat_timer_.cancel();
+}
@@ -0,0 +1,340 @@
+#include "config.hpp"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+
+namespace {
+
+/**
+ * @brief Converts an option value to an unsigned number.
+ * @param name Option name
+ * @param value Option value
+ */
+unsigned to_unsigned(std::string_view name, std::string_view value) {
+  unsigned result = 0;
+  auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+  if(ec != std::errc() || ptr != value.data() + value.size()) {
+    throw std::invalid_argument("Invalid value of " + std::string(name) + ": " + std::string(value));
+  }
+  return result;
+}
+
+/**
+ * @brief Converts an option value to a threading mode.
+ * @param value Option value
+ */
+thread_mode to_thread_mode(std::string_view value) {
+  if(value == "reuseport") {
+    return thread_mode::reuse_port;
+  }
+  if(value == "shared") {
+    return thread_mode::shared;
+  }
+  throw std::invalid_argument("Invalid value of --thread-mode: " + std::string(value));
+}
+
+/**
+ * @brief Converts an option value to a log line format.
+ * @param value Option value
+ */
+log_format to_log_format(std::string_view value) {
+  if(value == "text") {
+    return log_format::text;
+  }
+  if(value == "json") {
+    return log_format::json;
+  }
+  throw std::invalid_argument("Invalid value of --log-format: " + std::string(value));
+}
+
+/**
+ * @brief Converts an option value to a schema mode.
+ * @param value Option value
+ */
+schema_mode to_schema_mode(std::string_view value) {
+  if(value == "v1") {
+    return schema_mode::v1;
+  }
+  if(value == "dual") {
+    return schema_mode::dual;
+  }
+  if(value == "v2") {
+    return schema_mode::v2;
+  }
+  throw std::invalid_argument("Invalid value of --schema-mode: " + std::string(value));
+}
+
+/**
+ * @brief Converts an option value to a storage backend.
+ * @param value Option value
+ */
+store_backend to_store_backend(std::string_view value) {
+  if(value == "scylla") {
+    return store_backend::scylla;
+  }
+  if(value == "memory") {
+    return store_backend::memory;
+  }
+  throw std::invalid_argument("Invalid value of --store: " + std::string(value));
+}
+
+/**
+ * @brief Converts an option value to a rate limit key.
+ * @param value Option value
+ */
+rate_limit_key to_rate_limit_key(std::string_view value) {
+  if(value == "created_by") {
+    return rate_limit_key::created_by;
+  }
+  if(value == "ip") {
+    return rate_limit_key::ip;
+  }
+  throw std::invalid_argument("Invalid value of --make-rate-key: " + std::string(value));
+}
+
+//! Option setters by option name
+using option_map = std::unordered_map<std::string_view, std::function<void(std::string_view)>>;
+
+/**
+ * @brief Strips leading and trailing whitespace.
+ * @param text Text
+ */
+std::string_view trim(std::string_view text) {
+  while(!text.empty() && std::isspace(static_cast<unsigned char>(text.front()))) {
+    text.remove_prefix(1);
+  }
+  while(!text.empty() && std::isspace(static_cast<unsigned char>(text.back()))) {
+    text.remove_suffix(1);
+  }
+  return text;
+}
+
+/**
+ * @brief Applies one option.
+ * @param name Option name with the leading dashes
+ * @param value Option value
+ * @param options Option setters
+ * @param source Where the option comes from, for error messages
+ */
+void apply_option(std::string_view name, std::string_view value, const option_map& options,
+  const std::string& source) {
+  auto option = options.find(name);
+  if(option == options.end()) {
+    throw std::invalid_argument("Unknown option " + std::string(name) + " in " + source);
+  }
+  option->second(value);
+}
+
+/**
+ * @brief Applies the options of a config file. Every line is "name = value"
+ * with the option name without the leading dashes, # starts a comment.
+ * @param path Config file
+ * @param options Option setters
+ */
+void apply_config_file(const std::string& path, const option_map& options) {
+  std::ifstream file(path);
+  if(!file) {
+    throw std::invalid_argument("Unable to open config file " + path);
+  }
+
+  std::string line;
+  for(unsigned number = 1; std::getline(file, line); ++number) {
+    auto text = trim(std::string_view(line).substr(0, line.find('#')));
+    if(text.empty()) {
+      continue;
+    }
+    auto source = path + ":" + std::to_string(number);
+    auto equals = text.find('=');
+    if(equals == std::string_view::npos) {
+      throw std::invalid_argument("Expected name = value in " + source);
+    }
+    apply_option("--" + std::string(trim(text.substr(0, equals))), 
+      trim(text.substr(equals + 1)), options, source);
+  }
+}
+
+/**
+ * @brief Returns the environment variable of an option, --db-hosts is read
+ * from COMMENTS_DB_HOSTS.
+ * @param name Option name with the leading dashes
+ */
+std::string environment_name(std::string_view name) {
+  std::string result = "COMMENTS_";
+  for(char c : name.substr(2)) {
+    result.push_back(c == '-' ? '_' : static_cast<char>(std::toupper(static_cast<unsigned char>(c))));
+  }
+  return result;
+}
+
+/**
+ * @brief Applies the options set in COMMENTS_* environment variables.
+ * @param options Option setters
+ */
+void apply_environment(const option_map& options) {
+  for(const auto& [name, setter] : options) {
+    auto variable = environment_name(name);
+    if(const char* value = std::getenv(variable.c_str())) {
+      setter(value);
+    }
+  }
+}
+
+} // namespace
+
+service_config parse_command_line(int argc, char* argv[]) {
+  service_config config;
+
+  // The address and the port may be given before the options, as in earlier versions.
+  int first_option = 1;
+  if(argc >= 3 && argv[1][0] != '-') {
+    first_option = 3;
+  }
+
+  const option_map options = {
+    {"--address", [&](std::string_view v) { config.address = std::string(v); }},
+    {"--port", [&](std::string_view v) { config.port = static_cast<unsigned short>(to_unsigned("--port", v)); }},
+    {"--threads", [&](std::string_view v) { config.threads = to_unsigned("--threads", v); }},
+    {"--thread-mode", [&](std::string_view v) { config.mode = to_thread_mode(v); }},
+    {"--idle-timeout-s", [&](std::string_view v) { config.http.idle_timeout = std::chrono::seconds(to_unsigned("--idle-timeout-s", v)); }},
+    {"--max-requests-per-connection", [&](std::string_view v) { config.http.max_requests_per_connection = to_unsigned("--max-requests-per-connection", v); }},
+    {"--max-body-kb", [&](std::string_view v) { config.http.max_body_bytes = std::size_t(to_unsigned("--max-body-kb", v)) * 1024; }},
+    {"--admin-token", [&](std::string_view v) { config.http.admin_token = std::string(v); }},
+    {"--bulk-max-entities", [&](std::string_view v) { config.bulk.max_entities = to_unsigned("--bulk-max-entities", v); }},
+    {"--bulk-concurrency", [&](std::string_view v) { config.bulk.concurrency = std::max(1u, to_unsigned("--bulk-concurrency", v)); }},
+    {"--bulk-deadline-ms", [&](std::string_view v) { config.bulk.deadline = std::chrono::milliseconds(to_unsigned("--bulk-deadline-ms", v)); }},
+    {"--cache-max-mb", [&](std::string_view v) { config.cache.max_bytes = std::size_t(to_unsigned("--cache-max-mb", v)) * 1024 * 1024; }},
+    {"--cache-ttl-ms", [&](std::string_view v) { config.cache.ttl = std::chrono::milliseconds(to_unsigned("--cache-ttl-ms", v)); }},
+    {"--cache-max-page", [&](std::string_view v) { config.cache.max_page = to_unsigned("--cache-max-page", v); }},
+    {"--store", [&](std::string_view v) { config.store = to_store_backend(v); }},
+    {"--db-hosts", [&](std::string_view v) { config.db.contact_points = std::string(v); }},
+    {"--db-port", [&](std::string_view v) { config.db.port = static_cast<int>(to_unsigned("--db-port", v)); }},
+    {"--db-io-threads", [&](std::string_view v) { config.db.io_threads = to_unsigned("--db-io-threads", v); }},
+    {"--db-connections-per-host", [&](std::string_view v) { config.db.connections_per_host = to_unsigned("--db-connections-per-host", v); }},
+    {"--db-request-timeout-ms", [&](std::string_view v) { config.db.request_timeout_ms = to_unsigned("--db-request-timeout-ms", v); }},
+    {"--schema-mode", [&](std::string_view v) { config.db.schema = to_schema_mode(v); }},
+    {"--insert-batch-size", [&](std::string_view v) { config.batch.max_size = to_unsigned("--insert-batch-size", v); }},
+    {"--insert-batch-linger-ms", [&](std::string_view v) { config.batch.linger = std::chrono::milliseconds(to_unsigned("--insert-batch-linger-ms", v)); }},
+    {"--stream-max-queue", [&](std::string_view v) { config.stream.max_queue = to_unsigned("--stream-max-queue", v); }},
+    {"--stream-heartbeat-s", [&](std::string_view v) { config.stream.heartbeat = std::chrono::seconds(to_unsigned("--stream-heartbeat-s", v)); }},
+    {"--max-connections", [&](std::string_view v) { config.admission.max_connections = to_unsigned("--max-connections", v); }},
+    {"--max-in-flight", [&](std::string_view v) { config.admission.max_in_flight = to_unsigned("--max-in-flight", v); }},
+    {"--adaptive-limit", [&](std::string_view v) { config.admission.adaptive = to_unsigned("--adaptive-limit", v) != 0; }},
+    {"--min-in-flight", [&](std::string_view v) { config.admission.min_in_flight = to_unsigned("--min-in-flight", v); }},
+    {"--target-latency-ms", [&](std::string_view v) { config.admission.target_latency = std::chrono::milliseconds(to_unsigned("--target-latency-ms", v)); }},
+    {"--retry-after-s", [&](std::string_view v) { config.admission.retry_after = std::chrono::seconds(to_unsigned("--retry-after-s", v)); }},
+    {"--make-rate-per-min", [&](std::string_view v) { config.admission.make_rate = to_unsigned("--make-rate-per-min", v) / 60.0; }},
+    {"--make-burst", [&](std::string_view v) { config.admission.make_burst = to_unsigned("--make-burst", v); }},
+    {"--make-rate-key", [&](std::string_view v) { config.admission.make_key = to_rate_limit_key(v); }},
+    {"--log-level", [&](std::string_view v) { config.log.level = parse_log_level(v); }},
+    {"--log-format", [&](std::string_view v) { config.log.format = to_log_format(v); }},
+    {"--log-dir", [&](std::string_view v) { config.log.directory = std::string(v); }},
+    {"--log-rotation-mb", [&](std::string_view v) { config.log.rotation_mb = to_unsigned("--log-rotation-mb", v); }},
+    {"--log-max-total-mb", [&](std::string_view v) { config.log.max_total_mb = to_unsigned("--log-max-total-mb", v); }},
+    {"--trace-file", [&](std::string_view v) { config.trace.file = std::string(v); }},
+    {"--trace-sample-rate", [&](std::string_view v) { config.trace.sample_rate = to_unsigned("--trace-sample-rate", v); }},
+    {"--trace-honor-header", [&](std::string_view v) { config.trace.honor_header = to_unsigned("--trace-honor-header", v) != 0; }},
+    {"--trace-flush-ms", [&](std::string_view v) { config.trace.flush_interval = std::chrono::milliseconds(to_unsigned("--trace-flush-ms", v)); }},
+    {"--drain-timeout-s", [&](std::string_view v) { config.drain_timeout = std::chrono::seconds(to_unsigned("--drain-timeout-s", v)); }}
+  };
+
+  for(int i = first_option; i < argc; i += 2) {
+    if(i + 1 >= argc) {
+      throw std::invalid_argument("Missing value of " + std::string(argv[i]));
+    }
+  }
+
+  // The config file is read first, so that the environment and the command line override it.
+  std::string config_file;
+  if(const char* value = std::getenv("COMMENTS_CONFIG")) {
+    config_file = value;
+  }
+  for(int i = first_option; i < argc; i += 2) {
+    if(std::string_view(argv[i]) == "--config") {
+      config_file = argv[i + 1];
+    }
+  }
+  if(!config_file.empty()) {
+    apply_config_file(config_file, options);
+  }
+
+  apply_environment(options);
+
+  if(first_option == 3) {
+    config.address = argv[1];
+    config.port = static_cast<unsigned short>(to_unsigned("port", argv[2]));
+  }
+  for(int i = first_option; i < argc; i += 2) {
+    if(std::string_view(argv[i]) != "--config") {
+      apply_option(argv[i], argv[i + 1], options, "the command line");
+    }
+  }
+
+  if(config.address.empty() || config.port == 0) {
+    throw std::invalid_argument("Address and port are required");
+  }
+  return config;
+}
+
+void print_usage(const char* program) {
+  std::cerr << "Usage: " << program << " <address> <port> [options]\n";
+  std::cerr << "       " << program << " --config <file> [options]\n";
+  std::cerr << "  For IPv4, try:\n";
+  std::cerr << "    receiver 0.0.0.0 80\n";
+  std::cerr << "  For IPv6, try:\n";
+  std::cerr << "    receiver 0::0 80\n";
+  std::cerr << "Every option can also be set in the config file as \"threads = 4\"\n";
+  std::cerr << "or in the environment as COMMENTS_THREADS=4.\n";
+  std::cerr << "Options:\n";
+  std::cerr << "  --config <file>                  Config file, also COMMENTS_CONFIG\n";
+  std::cerr << "  --address <address>              Listen address\n";
+  std::cerr << "  --port <port>                    Listen port\n";
+  std::cerr << "  --threads <n>                    Number of server threads, 0 is one per core\n";
+  std::cerr << "  --thread-mode <reuseport|shared> Io_context and acceptor per thread or one shared\n";
+  std::cerr << "  --idle-timeout-s <s>             Idle timeout of keep-alive connections\n";
+  std::cerr << "  --max-requests-per-connection <n> Requests served on one connection\n";
+  std::cerr << "  --max-body-kb <kb>                Largest request body, larger ones are answered with 413\n";
+  std::cerr << "  --admin-token <token>            Admin-Token of /admin requests, empty disables them\n";
+  std::cerr << "  --bulk-max-entities <n>          Entities allowed in one POST /comments/bulk\n";
+  std::cerr << "  --bulk-concurrency <n>           Entities of one bulk request fetched at the same time\n";
+  std::cerr << "  --bulk-deadline-ms <ms>          Time after which a bulk response is written with the entities fetched so far\n";
+  std::cerr << "  --cache-max-mb <mb>              Size of the response cache, 0 disables it\n";
+  std::cerr << "  --cache-ttl-ms <ms>              Time a cached page may be served\n";
+  std::cerr << "  --cache-max-page <n>             Only pages up to this number are cached\n";
+  std::cerr << "  --store <scylla|memory>          Storage backend, memory keeps comments in the process\n";
+  std::cerr << "  --db-hosts <list>                Comma separated ScyllaDB contact points\n";
+  std::cerr << "  --db-port <port>                 ScyllaDB CQL port\n";
+  std::cerr << "  --db-io-threads <n>              Number of driver I/O threads\n";
+  std::cerr << "  --db-connections-per-host <n>    Connections per host and I/O thread\n";
+  std::cerr << "  --db-request-timeout-ms <ms>     Timeout of a single db request\n";
+  std::cerr << "  --schema-mode <v1|dual|v2>       Layout of the comment tables, see comments-migrate\n";
+  std::cerr << "  --insert-batch-size <n>          Comments of one entity sent in one batch, 0 disables batching\n";
+  std::cerr << "  --insert-batch-linger-ms <ms>    Time the first comment of a batch waits for more\n";
+  std::cerr << "  --stream-max-queue <n>           Events queued for a stream subscriber before it is closed\n";
+  std::cerr << "  --stream-heartbeat-s <s>         Interval of keep-alive comments on idle streams\n";
+  std::cerr << "  --max-connections <n>            Open connections, more are answered with 503, 0 is unlimited\n";
+  std::cerr << "  --max-in-flight <n>              Requests in process, more are answered with 503, 0 is unlimited\n";
+  std::cerr << "  --adaptive-limit <0|1>           Adjusts the in-flight limit to the service time (AIMD)\n";
+  std::cerr << "  --min-in-flight <n>              Lower bound of the adaptive limit\n";
+  std::cerr << "  --target-latency-ms <ms>         Service time above which the adaptive limit shrinks\n";
+  std::cerr << "  --retry-after-s <s>              Retry-After of 503 responses\n";
+  std::cerr << "  --make-rate-per-min <n>          Comments a client may add per minute, 0 is unlimited\n";
+  std::cerr << "  --make-burst <n>                 Comments a client may add at once\n";
+  std::cerr << "  --make-rate-key <created_by|ip>  Client of the make rate limit\n";
+  std::cerr << "  --log-level <level>              trace, debug, info, warning, error or fatal\n";
+  std::cerr << "  --log-format <text|json>         Format of log lines\n";
+  std::cerr << "  --log-dir <dir>                  Directory of the log files\n";
+  std::cerr << "  --log-rotation-mb <mb>           Size of a log file before rotation, 0 disables the file log\n";
+  std::cerr << "  --log-max-total-mb <mb>          Total size of the kept log files\n";
+  std::cerr << "  --trace-file <path>              Chrome trace event file of traced requests, empty disables tracing\n";
+  std::cerr << "  --trace-sample-rate <n>          Traces one in n requests, 0 disables sampling\n";
+  std::cerr << "  --trace-honor-header <0|1>       Traces every request with X-Trace-Id, for trusted clients only\n";
+  std::cerr << "  --trace-flush-ms <ms>            Time spans wait in memory before they are written\n";
+  std::cerr << "  --drain-timeout-s <s>            Time SIGTERM waits for requests in process\n";
+}
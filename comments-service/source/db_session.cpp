@@ -0,0 +1,139 @@
+#include "db_session.hpp"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+db_session::db_session(db_config config) :
+  config_(std::move(config)),
+  cluster_(cass_cluster_new(), &cass_cluster_free),
+  session_(cass_session_new(), &cass_session_free),
+  uuid_gen_(cass_uuid_gen_new(), &cass_uuid_gen_free) {
+  auto cluster = cluster_.get();
+  cass_cluster_set_contact_points(cluster, config_.contact_points.c_str());
+  cass_cluster_set_port(cluster, config_.port);
+  cass_cluster_set_num_threads_io(cluster, config_.io_threads);
+  cass_cluster_set_core_connections_per_host(cluster, config_.connections_per_host);
+  cass_cluster_set_connect_timeout(cluster, config_.connect_timeout_ms);
+  cass_cluster_set_request_timeout(cluster, config_.request_timeout_ms);
+  cass_cluster_set_exponential_reconnect(cluster,
+    config_.reconnect_base_delay_ms, config_.reconnect_max_delay_ms);
+  cass_cluster_set_tcp_keepalive(cluster, cass_true, 60);
+  cass_cluster_set_token_aware_routing(cluster, cass_true);
+}
+
+db_session::~db_session() {
+  close();
+}
+
+void db_session::close() {
+  if(connected_) {
+    connected_ = false;
+    auto close_future = std::unique_ptr<CassFuture,
+      decltype(&cass_future_free)>(cass_session_close(session_.get()), &cass_future_free);
+    cass_future_wait(close_future.get());
+  }
+}
+
+void db_session::background_started() {
+  background_queries_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void db_session::background_finished() {
+  background_queries_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+std::size_t db_session::background_queries() const {
+  return background_queries_.load(std::memory_order_relaxed);
+}
+
+void db_session::connect() {
+  auto delay = std::chrono::milliseconds(config_.reconnect_base_delay_ms);
+  const auto max_delay = std::chrono::milliseconds(config_.reconnect_max_delay_ms);
+  const auto start = std::chrono::steady_clock::now();
+
+  for(unsigned attempt = 1; attempt <= config_.startup_attempts; ++attempt) {
+    auto connect_future = std::unique_ptr<CassFuture,
+      decltype(&cass_future_free)>(cass_session_connect(
+        session_.get(), cluster_.get()), &cass_future_free);
+
+    if(cass_future_error_code(connect_future.get()) == CASS_OK) {
+      connected_ = true;
+      connect_time_ = std::chrono::steady_clock::now() - start;
+      BOOST_LOG_TRIVIAL(info)
+        << "Connected to db: " << config_.contact_points;
+
+      statements_ = std::make_unique<prepared_statements>(session_.get());
+      statements_->prepare_all(config_.schema);
+      return;
+    }
+
+    BOOST_LOG_TRIVIAL(warning)
+      << "Unable to connect to db (attempt " << attempt << "/"
+      << config_.startup_attempts << "): " << error_message(connect_future.get());
+
+    std::this_thread::sleep_for(delay);
+    delay = std::min(delay * 2, max_delay);
+  }
+
+  throw std::runtime_error("Unable to connect to db: " + config_.contact_points);
+}
+
+void db_session::warm_up() {
+  const char* query = "SELECT release_version FROM system.local";
+  const auto hosts = 1 + std::count(config_.contact_points.begin(), config_.contact_points.end(), ',');
+  const auto requests = config_.io_threads * config_.connections_per_host * hosts;
+
+  auto statement = std::unique_ptr<CassStatement,
+    decltype(&cass_statement_free)>(cass_statement_new(query, 0), &cass_statement_free);
+
+  // All queries are in flight at once, the driver spreads them over the hosts
+  // and sends each to the least busy connection of its host. Queries sent one
+  // after another would all reuse the same idle connection.
+  std::vector<std::unique_ptr<CassFuture, decltype(&cass_future_free)>> futures;
+  futures.reserve(requests);
+  for(std::size_t i = 0; i < requests; ++i) {
+    futures.emplace_back(cass_session_execute(session_.get(), statement.get()), &cass_future_free);
+  }
+
+  for(auto& result_future : futures) {
+    if(cass_future_error_code(result_future.get()) != CASS_OK) {
+      BOOST_LOG_TRIVIAL(warning)
+        << "Unable to warm up db session: " << error_message(result_future.get());
+      return;
+    }
+  }
+
+  BOOST_LOG_TRIVIAL(info)
+    << "Db session is warmed up";
+}
+
+CassSession* db_session::get() const {
+  return session_.get();
+}
+
+prepared_statements& db_session::statements() {
+  return *statements_;
+}
+
+std::chrono::steady_clock::duration db_session::connect_time() const {
+  return connect_time_;
+}
+
+schema_mode db_session::schema() const {
+  return config_.schema;
+}
+
+CassUuid db_session::new_comment_id() {
+  CassUuid id;
+  cass_uuid_gen_time(uuid_gen_.get(), &id);
+  return id;
+}
+
+std::string db_session::error_message(CassFuture* future) {
+  const char* message;
+  size_t message_length;
+  cass_future_error_message(future, &message, &message_length);
+  return std::string(message, message_length);
+}
@@ -0,0 +1,182 @@
+#include "insert_batcher.hpp"
+#include <algorithm>
+
+namespace {
+
+using future_ptr = std::unique_ptr<CassFuture, decltype(&cass_future_free)>;
+
+/**
+ * @brief Returns the error message of the future.
+ * @param future Completed CassFuture object
+ */
+std::string error_message(CassFuture* future) {
+  const char* message;
+  size_t message_length;
+  cass_future_error_message(future, &message, &message_length);
+  return std::string(message, message_length);
+}
+
+} // namespace
+
+insert_batcher::insert_batcher(std::shared_ptr<db_session> db, insert_batch_config config,
+  CassBatchType batch_type) :
+  db_(std::move(db)), config_(std::move(config)), batch_type_(batch_type) {
+  config_.shards = std::max<std::size_t>(config_.shards, 1);
+  shards_.reserve(config_.shards);
+  for(std::size_t i = 0; i < config_.shards; ++i) {
+    shards_.push_back(std::make_unique<shard>());
+  }
+}
+
+void insert_batcher::add(std::string_view entity, std::vector<statement_ptr> statements,
+  boost::asio::any_io_executor executor, handler_type handler) {
+  auto& s = shard_of(entity);
+  std::vector<pending_insert> full;
+  std::uint64_t opened = 0;
+
+  {
+    std::lock_guard lock(s.mutex);
+    auto it = s.batches.try_emplace(std::string(entity)).first;
+    auto& batch = it->second;
+    if(batch.inserts.empty()) {
+      batch.id = next_id_.fetch_add(1, std::memory_order_relaxed) + 1;
+      opened = batch.id;
+    }
+    batch.inserts.push_back(pending_insert{std::move(statements), executor, std::move(handler)});
+    if(batch.inserts.size() >= config_.max_size) {
+      full = std::move(batch.inserts);
+      s.batches.erase(it);
+    }
+  }
+
+  if(!full.empty()) {
+    send(std::string(entity), std::move(full));
+    return;
+  }
+
+  // The timer is not cancelled when the batch is sent because it is full,
+  // flush ignores batches that were already sent.
+  if(opened != 0) {
+    auto timer = std::make_shared<boost::asio::steady_timer>(executor, config_.linger);
+    timer->async_wait([self = shared_from_this(), timer, entity = std::string(entity), opened](
+      boost::system::error_code) {
+        self->flush(entity, opened);
+      });
+  }
+}
+
+void insert_batcher::flush_all() {
+  for(auto& s : shards_) {
+    std::unordered_map<std::string, pending_batch> batches;
+    {
+      std::lock_guard lock(s->mutex);
+      batches.swap(s->batches);
+    }
+    for(auto& [entity, batch] : batches) {
+      send(entity, std::move(batch.inserts));
+    }
+  }
+}
+
+std::uint64_t insert_batcher::batches() const {
+  return batches_.load(std::memory_order_relaxed);
+}
+
+std::uint64_t insert_batcher::batched_inserts() const {
+  return batched_inserts_.load(std::memory_order_relaxed);
+}
+
+insert_batcher::shard& insert_batcher::shard_of(std::string_view entity) {
+  return *shards_[std::hash<std::string_view>{}(entity) % shards_.size()];
+}
+
+void insert_batcher::flush(const std::string& entity, std::uint64_t id) {
+  auto& s = shard_of(entity);
+  std::vector<pending_insert> inserts;
+
+  {
+    std::lock_guard lock(s.mutex);
+    auto it = s.batches.find(entity);
+    if(it == s.batches.end() || it->second.id != id) {
+      return;
+    }
+    inserts = std::move(it->second.inserts);
+    s.batches.erase(it);
+  }
+
+  send(entity, std::move(inserts));
+}
+
+void insert_batcher::send(std::string entity, std::vector<pending_insert> inserts) {
+  auto batch = std::unique_ptr<CassBatch, decltype(&cass_batch_free)>(
+    cass_batch_new(batch_type_), &cass_batch_free);
+  for(const auto& insert : inserts) {
+    for(const auto& statement : insert.statements) {
+      cass_batch_add_statement(batch.get(), statement.get());
+    }
+  }
+
+  batches_.fetch_add(1, std::memory_order_relaxed);
+  batched_inserts_.fetch_add(inserts.size(), std::memory_order_relaxed);
+
+  // Statements are kept until the batch is completed, they are sent again
+  // one by one when the batch fails.
+  auto future = cass_session_execute_batch(db_->get(), batch.get());
+  auto sent = new sent_batch{shared_from_this(), std::move(entity), std::move(inserts)};
+  cass_future_set_callback(future, &insert_batcher::on_sent, sent);
+}
+
+void insert_batcher::on_sent(CassFuture* future, void* data) {
+  std::unique_ptr<sent_batch> sent(static_cast<sent_batch*>(data));
+  std::shared_ptr<CassFuture> result(future, &cass_future_free);
+
+  auto error = cass_future_error_code(future);
+  if(error != CASS_OK && sent->inserts.size() > 1) {
+    BOOST_LOG_TRIVIAL(warning)
+      << "Batch of " << sent->inserts.size() << " comments for entity " << sent->entity
+      << " failed, retrying one by one: " << error_message(future);
+    for(auto& insert : sent->inserts) {
+      std::vector<pending_insert> single;
+      single.push_back(std::move(insert));
+      sent->batcher->send(sent->entity, std::move(single));
+    }
+    return;
+  }
+
+  if(error == CASS_OK) {
+    sent->batcher->update_comment_count(sent->entity, sent->inserts.size());
+  }
+  complete(std::move(result), sent->inserts);
+}
+
+void insert_batcher::complete(std::shared_ptr<CassFuture> future, std::vector<pending_insert>& inserts) {
+  for(auto& insert : inserts) {
+    boost::asio::post(insert.executor, [future, handler = std::move(insert.handler)] {
+      handler(future.get());
+    });
+  }
+}
+
+void insert_batcher::update_comment_count(const std::string& entity, std::size_t count) {
+  auto statement = db_->statements().bind(query_id::add_comment_count);
+  cass_statement_bind_int64(statement.get(), 0, static_cast<cass_int64_t>(count));
+  cass_statement_bind_string_n(statement.get(), 1, entity.data(), entity.size());
+
+  db_->background_started();
+  auto future = cass_session_execute(db_->get(), statement.get());
+  cass_future_set_callback(future, &insert_batcher::on_counted, new counter_update{db_, entity});
+}
+
+void insert_batcher::on_counted(CassFuture* future, void* data) {
+  std::unique_ptr<counter_update> update(static_cast<counter_update*>(data));
+  future_ptr result(future, &cass_future_free);
+  update->db->background_finished();
+
+  auto error = cass_future_error_code(future);
+  if(error != CASS_OK) {
+    BOOST_LOG_TRIVIAL(error)
+      << "Unable to update comment counter of entity " << update->entity
+      << ": " << error_message(future);
+    update->db->statements().handle_error(query_id::add_comment_count, error);
+  }
+}
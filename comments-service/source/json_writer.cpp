@@ -0,0 +1,236 @@
+#include "json_writer.hpp"
+#include <array>
+#include <charconv>
+#include <cstring>
+
+namespace {
+
+/**
+ * @brief How a column is read and written.
+ */
+enum class column_kind {
+  text,
+  bigint,
+  uuid
+};
+
+/**
+ * @brief Column of the comment row.
+ */
+struct column {
+  //! Quoted key with the separator, written as is
+  std::string_view key;
+  //! Index of the column in the get_comments queries
+  std::size_t index;
+  //! Column type
+  column_kind kind;
+};
+
+//! Columns of the comment row in output order
+constexpr std::array<column, 7> comment_columns = {{
+  {"{\"author\":", 3, column_kind::text},
+  {",\"comment_id\":", 2, column_kind::uuid},
+  {",\"created_by\":", 4, column_kind::bigint},
+  {",\"created_time\":", 1, column_kind::bigint},
+  {",\"entity\":", 0, column_kind::text},
+  {",\"text\":", 5, column_kind::text},
+  {",\"updated_time\":", 6, column_kind::bigint}
+}};
+
+//! 0x01 in every byte
+constexpr std::uint64_t ones = 0x0101010101010101ULL;
+//! 0x80 in every byte
+constexpr std::uint64_t highs = 0x8080808080808080ULL;
+
+//! U+FFFD replacement character in UTF-8
+constexpr std::string_view replacement_character = "\xef\xbf\xbd";
+
+/**
+ * @brief Returns true if one of the eight bytes is a control character, a
+ * quote, a backslash or a non-ASCII byte.
+ * @param word Eight bytes of the string
+ */
+constexpr bool has_special_byte(std::uint64_t word) {
+  auto zero_byte = [](std::uint64_t v) { return (v - ones) & ~v & highs; };
+  auto control = (word - ones * 0x20) & ~word & highs;
+  return (control | (word & highs) | zero_byte(word ^ (ones * '"')) |
+    zero_byte(word ^ (ones * '\\'))) != 0;
+}
+
+/**
+ * @brief Checks the UTF-8 sequence starting with a non-ASCII byte. Returns
+ * the length of a valid sequence, otherwise the length of its longest
+ * invalid prefix, at least 1, which is replaced by one U+FFFD.
+ * Overlong forms, surrogates and code points above U+10FFFF are invalid.
+ * @param p First byte of the sequence
+ * @param end End of the string
+ * @param valid Set to true if the sequence is valid
+ */
+std::size_t check_utf8_sequence(const unsigned char* p, const unsigned char* end, bool& valid) {
+  valid = false;
+  std::size_t length = 0;
+  unsigned char low = 0x80;
+  unsigned char high = 0xbf;
+  if (*p >= 0xc2 && *p <= 0xdf) {
+    length = 2;
+  } else if (*p >= 0xe0 && *p <= 0xef) {
+    length = 3;
+    low = *p == 0xe0 ? 0xa0 : low;
+    high = *p == 0xed ? 0x9f : high;
+  } else if (*p >= 0xf0 && *p <= 0xf4) {
+    length = 4;
+    low = *p == 0xf0 ? 0x90 : low;
+    high = *p == 0xf4 ? 0x8f : high;
+  } else {
+    return 1;
+  }
+
+  for (std::size_t i = 1; i < length; ++i) {
+    if (p + i == end || p[i] < low || p[i] > high) {
+      return i;
+    }
+    low = 0x80;
+    high = 0xbf;
+  }
+  valid = true;
+  return length;
+}
+
+/**
+ * @brief Appends the uuid as a quoted json string.
+ * @param out Output buffer
+ * @param uuid Uuid
+ */
+void append_json_uuid(std::string& out, CassUuid uuid) {
+  char uuid_str[CASS_UUID_STRING_LENGTH];
+  cass_uuid_string(uuid, uuid_str);
+  out.push_back('"');
+  out.append(uuid_str, CASS_UUID_STRING_LENGTH - 1);
+  out.push_back('"');
+}
+
+/**
+ * @brief Appends the escape sequence of the character.
+ * @param out Output buffer
+ * @param c Character that needs escaping
+ */
+void append_escape(std::string& out, unsigned char c) {
+  static constexpr char hex[] = "0123456789abcdef";
+  switch (c) {
+    case '"': out.append("\\\""); break;
+    case '\\': out.append("\\\\"); break;
+    case '\b': out.append("\\b"); break;
+    case '\f': out.append("\\f"); break;
+    case '\n': out.append("\\n"); break;
+    case '\r': out.append("\\r"); break;
+    case '\t': out.append("\\t"); break;
+    default: {
+      char escape[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0x0f]};
+      out.append(escape, sizeof(escape));
+      break;
+    }
+  }
+}
+
+} // namespace
+
+void append_json_string(std::string& out, std::string_view value) {
+  const char* p = value.data();
+  const char* end = p + value.size();
+  const char* run = p;
+
+  out.push_back('"');
+  while (p < end) {
+    if (end - p >= 8) {
+      std::uint64_t word;
+      std::memcpy(&word, p, sizeof(word));
+      if (!has_special_byte(word)) {
+        p += 8;
+        continue;
+      }
+    }
+
+    auto c = static_cast<unsigned char>(*p);
+    if (c >= 0x80) {
+      // Invalid UTF-8 would make the whole response invalid json.
+      bool valid = false;
+      auto length = check_utf8_sequence(reinterpret_cast<const unsigned char*>(p),
+        reinterpret_cast<const unsigned char*>(end), valid);
+      if (!valid) {
+        out.append(run, p);
+        out.append(replacement_character);
+        run = p + length;
+      }
+      p += length;
+      continue;
+    }
+    if (c < 0x20 || c == '"' || c == '\\') {
+      out.append(run, p);
+      append_escape(out, c);
+      run = p + 1;
+    }
+    ++p;
+  }
+  out.append(run, end);
+  out.push_back('"');
+}
+
+void append_json_number(std::string& out, std::int64_t value) {
+  char buffer[24];
+  auto [ptr, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+  out.append(buffer, ptr);
+}
+
+void append_comment(std::string& out, const comment_fields& comment) {
+  // Same keys in the same order as comment_columns.
+  out.append(comment_columns[0].key);
+  append_json_string(out, comment.author);
+  out.append(comment_columns[1].key);
+  append_json_uuid(out, comment.comment_id);
+  out.append(comment_columns[2].key);
+  append_json_number(out, comment.created_by);
+  out.append(comment_columns[3].key);
+  append_json_number(out, comment.created_time);
+  out.append(comment_columns[4].key);
+  append_json_string(out, comment.entity);
+  out.append(comment_columns[5].key);
+  append_json_string(out, comment.text);
+  out.append(comment_columns[6].key);
+  append_json_number(out, comment.updated_time);
+  out.push_back('}');
+}
+
+void append_comment_row(std::string& out, const CassRow* row) {
+  for (const auto& column : comment_columns) {
+    out.append(column.key);
+
+    const CassValue* value = cass_row_get_column(row, column.index);
+    if (value == nullptr || cass_value_is_null(value)) {
+      out.append("null");
+      continue;
+    }
+
+    switch (column.kind) {
+      case column_kind::text: {
+        const char* text;
+        size_t text_length;
+        cass_value_get_string(value, &text, &text_length);
+        append_json_string(out, std::string_view(text, text_length));
+        break;
+      }
+      case column_kind::bigint: {
+        cass_int64_t number;
+        cass_value_get_int64(value, &number);
+        append_json_number(out, number);
+        break;
+      }
+      case column_kind::uuid: {
+        CassUuid uuid;
+        cass_value_get_uuid(value, &uuid);
+        append_json_uuid(out, uuid);
+        break;
+      }
+    }
+  }
+  out.push_back('}');
+}
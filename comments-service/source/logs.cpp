@@ -0,0 +1,310 @@
+#include "logs.hpp"
+#include "json_writer.hpp"
+#pragma warning(push)
+#pragma warning(disable:4819)
+#   include <boost/shared_ptr.hpp>
+#   include <boost/core/null_deleter.hpp>
+#   include <boost/make_shared.hpp>
+#   include <boost/date_time/posix_time/posix_time.hpp>
+#   include <boost/log/core.hpp>
+#   include <boost/log/expressions.hpp>
+#   include <boost/log/attributes/function.hpp>
+#   include <boost/log/utility/setup/common_attributes.hpp>
+#   include <boost/log/support/date_time.hpp>
+#   include <boost/log/sinks/async_frontend.hpp>
+#   include <boost/log/sinks/text_file_backend.hpp>
+#   include <boost/log/sinks/text_ostream_backend.hpp>
+#   include <boost/lockfree/queue.hpp>
+#pragma warning(pop)
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+namespace log = boost::log;
+namespace sinks = boost::log::sinks;
+namespace keywords = boost::log::keywords;
+namespace expr = boost::log::expressions;
+
+//! Number of records a sink queue holds before records are dropped, a fixed
+//! size lock-free queue has at most 65535 nodes and one of them is its own
+constexpr std::size_t queue_capacity = 65534;
+
+//! Records dropped by all sinks
+std::atomic<std::uint64_t> dropped_records{0};
+
+//! Minimum severity of written records
+std::atomic<log::trivial::severity_level> current_level{log::trivial::info};
+
+//! Source of request ids
+std::atomic<std::uint64_t> last_request_id{0};
+
+//! Request id of the records logged by this thread
+thread_local std::uint64_t current_request_id = 0;
+
+/**
+ * @brief Queueing strategy of the sinks: a fixed size lock-free queue.
+ *
+ * Logging threads push records without taking a lock and never wait for
+ * the writer thread, a record that does not fit is dropped and counted.
+ * The writer sleeps on a condition variable when the queue is empty, a
+ * logging thread only takes the mutex to wake it.
+ */
+class lockfree_record_queue {
+ protected:
+  lockfree_record_queue() : queue_(queue_capacity) {}
+
+  template<typename ArgsT>
+  explicit lockfree_record_queue(const ArgsT&) : queue_(queue_capacity) {}
+
+  ~lockfree_record_queue() {
+    log::record_view* record;
+    while (queue_.pop(record)) {
+      delete record;
+    }
+  }
+
+  void enqueue(const log::record_view& record) {
+    if (!try_enqueue(record)) {
+      dropped_records.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  bool try_enqueue(const log::record_view& record) {
+    auto queued = new log::record_view(record);
+    if (!queue_.bounded_push(queued)) {
+      delete queued;
+      return false;
+    }
+    if (sleeping_.load()) {
+      std::lock_guard lock(mutex_);
+      wake_.notify_one();
+    }
+    return true;
+  }
+
+  bool try_dequeue_ready(log::record_view& record) {
+    return try_dequeue(record);
+  }
+
+  bool try_dequeue(log::record_view& record) {
+    log::record_view* queued;
+    if (!queue_.pop(queued)) {
+      return false;
+    }
+    record.swap(*queued);
+    delete queued;
+    return true;
+  }
+
+  bool dequeue_ready(log::record_view& record) {
+    while (!try_dequeue(record)) {
+      // sleeping_ is set under the mutex before the last check, so a record
+      // pushed meanwhile either is found or wakes the writer.
+      std::unique_lock lock(mutex_);
+      if (interrupted_) {
+        interrupted_ = false;
+        return false;
+      }
+      sleeping_.store(true);
+      if (try_dequeue(record)) {
+        sleeping_.store(false);
+        return true;
+      }
+      wake_.wait(lock);
+      sleeping_.store(false);
+    }
+    return true;
+  }
+
+  void interrupt_dequeue() {
+    std::lock_guard lock(mutex_);
+    interrupted_ = true;
+    wake_.notify_one();
+  }
+
+ private:
+  //! Queued records, owned by the queue
+  boost::lockfree::queue<log::record_view*, boost::lockfree::fixed_sized<true>> queue_;
+  //! True while the writer waits for records
+  std::atomic<bool> sleeping_{false};
+  //! Guards interrupted_ and the sleep of the writer
+  std::mutex mutex_;
+  //! Wakes the writer
+  std::condition_variable wake_;
+  //! True once the writer has to stop waiting
+  bool interrupted_ = false;
+};
+
+//! Queue of the sinks
+using sink_queue = lockfree_record_queue;
+//! Console sink
+using console_sink = sinks::asynchronous_sink<sinks::text_ostream_backend, sink_queue>;
+//! File sink
+using file_sink = sinks::asynchronous_sink<sinks::text_file_backend, sink_queue>;
+
+//! Remove the sinks added by init_log and stop their writer threads
+std::vector<std::function<void()>> stop_sinks;
+
+/**
+ * @brief Adds the sink to the logging core.
+ * @param sink Asynchronous sink
+ * @param formatter Formatter of the log lines
+ */
+template<typename Sink>
+void add_sink(boost::shared_ptr<Sink> sink, const log::formatter& formatter) {
+  sink->set_formatter(formatter);
+  log::core::get()->add_sink(sink);
+  stop_sinks.push_back([sink] {
+    log::core::get()->remove_sink(sink);
+    sink->stop();
+    sink->flush();
+  });
+}
+
+/**
+ * @brief Writes the record as one json object.
+ * @param record Log record
+ * @param stream Output stream
+ */
+void format_json(const log::record_view& record, log::formatting_ostream& stream) {
+  std::string line;
+  line.reserve(256);
+
+  line.append("{\"time\":\"");
+  if (auto time = log::extract<boost::posix_time::ptime>("TimeStamp", record)) {
+    line.append(boost::posix_time::to_iso_extended_string(*time));
+  }
+  line.append("\",\"level\":\"");
+  if (auto level = log::extract<log::trivial::severity_level>("Severity", record)) {
+    line.append(log::trivial::to_string(*level));
+  }
+  line.append("\",\"thread\":");
+  if (auto thread = log::extract<log::attributes::current_thread_id::value_type>("ThreadID", record)) {
+    std::ostringstream id;
+    id << *thread;
+    append_json_string(line, id.str());
+  } else {
+    line.append("null");
+  }
+  if (auto request_id = log::extract<std::uint64_t>("RequestID", record); request_id && *request_id != 0) {
+    line.append(",\"request_id\":");
+    append_json_number(line, static_cast<std::int64_t>(*request_id));
+  }
+  line.append(",\"message\":");
+  auto message = log::extract<std::string>("Message", record);
+  append_json_string(line, message ? std::string_view(*message) : std::string_view());
+  line.push_back('}');
+
+  stream << line;
+}
+
+/**
+ * @brief Returns the formatter of the log lines.
+ * @param format Format of log lines
+ */
+log::formatter make_formatter(log_format format) {
+  if (format == log_format::json) {
+    return &format_json;
+  }
+
+  auto fmt_timestamp = expr::
+    format_date_time<boost::posix_time::ptime>("TimeStamp", "%Y-%m-%d %H:%M:%S.%f");
+  auto fmt_thread_id = expr::
+    attr<boost::log::attributes::current_thread_id::value_type>("ThreadID");
+  auto fmt_severity = expr::
+    attr<boost::log::trivial::severity_level>("Severity");
+  auto fmt_scope = expr::
+    format_named_scope("Scope",
+    keywords::format = "%n(%f:%l)",
+    keywords::iteration = expr::reverse,
+    keywords::depth = 2);
+  auto fmt_request_id = expr::
+    attr<std::uint64_t>("RequestID");
+  return expr::format("[%1%] (%2%) [%3%] [%4%] [%5%] %6%")
+    % fmt_timestamp % fmt_thread_id % fmt_severity % fmt_scope % fmt_request_id % expr::smessage;
+}
+
+} // namespace
+
+void init_log(const log_config& config) {
+  auto core = log::core::get();
+
+  log::add_common_attributes();
+  core->add_global_attribute("Scope", log::attributes::named_scope());
+  core->add_global_attribute("RequestID", log::attributes::make_function(
+    [] { return current_request_id; }));
+  set_log_level(config.level);
+
+  auto formatter = make_formatter(config.format);
+
+  auto console_backend = boost::make_shared<sinks::text_ostream_backend>();
+  console_backend->add_stream(boost::shared_ptr<std::ostream>(&std::clog, boost::null_deleter()));
+  add_sink(boost::make_shared<console_sink>(console_backend), formatter);
+
+  if (config.rotation_mb > 0) {
+    auto file_backend = boost::make_shared<sinks::text_file_backend>(
+      keywords::file_name = config.directory + "/comments-service_%Y-%m-%d_%H-%M-%S.%N.log",
+      keywords::rotation_size = std::size_t(config.rotation_mb) * 1024 * 1024,
+      keywords::time_based_rotation = sinks::file::rotation_at_time_point(0, 0, 0),
+      keywords::open_mode = std::ios_base::app);
+    file_backend->set_file_collector(sinks::file::make_collector(
+      keywords::target = config.directory,
+      keywords::max_size = std::size_t(config.max_total_mb) * 1024 * 1024,
+      keywords::min_free_space = 30 * 1024 * 1024));
+    file_backend->scan_for_files();
+    file_backend->auto_flush(true);
+
+    add_sink(boost::make_shared<file_sink>(file_backend), formatter);
+  }
+}
+
+void stop_log() {
+  for (auto& stop : stop_sinks) {
+    stop();
+  }
+  stop_sinks.clear();
+}
+
+void set_log_level(log::trivial::severity_level level) {
+  current_level.store(level, std::memory_order_relaxed);
+  log::core::get()->set_filter(log::trivial::severity >= level);
+}
+
+log::trivial::severity_level log_level() {
+  return current_level.load(std::memory_order_relaxed);
+}
+
+log::trivial::severity_level parse_log_level(std::string_view name) {
+  log::trivial::severity_level level;
+  if (!log::trivial::from_string(name.data(), name.size(), level)) {
+    throw std::invalid_argument("Invalid log level: " + std::string(name));
+  }
+  return level;
+}
+
+std::uint64_t log_dropped_records() {
+  return dropped_records.load(std::memory_order_relaxed);
+}
+
+log_request_scope::log_request_scope(std::uint64_t request_id) :
+  previous_(current_request_id) {
+  current_request_id = request_id;
+}
+
+log_request_scope::~log_request_scope() {
+  current_request_id = previous_;
+}
+
+std::uint64_t log_request_id() {
+  return current_request_id;
+}
+
+std::uint64_t next_request_id() {
+  return last_request_id.fetch_add(1, std::memory_order_relaxed) + 1;
+}
@@ -1,38 +1,271 @@
 #include "server.hpp"
+#include "config.hpp"
+#include "memory_store.hpp"
+#include "scylla_store.hpp"
+#include <csignal>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+namespace {
+
+/**
+ * @brief Io_contexts, acceptors and shared objects of the running service.
+ */
+struct service_runtime {
+  //! Io_contexts, the first one is run by the main thread
+  std::vector<std::unique_ptr<net::io_context>> iocs;
+  //! Acceptors, one per io_context
+  std::vector<tcp::acceptor> acceptors;
+  //! Objects shared by all connections
+  std::shared_ptr<service_context> context;
+  //! Time the drain waits for the requests in process
+  std::chrono::seconds drain_timeout{10};
+  //! Number of arguments, a reload parses them again
+  int argc = 0;
+  //! Arguments
+  char** argv = nullptr;
+};
+
+/**
+ * @brief Stops all io_contexts, the connections still open are dropped.
+ * @param runtime Running service
+ */
+void stop_service(service_runtime& runtime) {
+  for(auto& ioc : runtime.iocs) {
+    ioc->stop();
+  }
+}
+
+//! Time a drain gives keep-alive connections to send one more request, which
+//! is answered with Connection: close, before idle connections are dropped
+constexpr std::chrono::seconds idle_grace{1};
+
+/**
+ * @brief Stops the service once no request and no background write is in
+ * process and the connections are closed or idle for idle_grace, or the
+ * drain timeout is over.
+ * @param timer Timer of the checks
+ * @param start Start of the drain
+ * @param runtime Running service
+ */
+void wait_for_requests(std::shared_ptr<net::steady_timer> timer,
+  std::chrono::steady_clock::time_point start, service_runtime& runtime) {
+  const auto now = std::chrono::steady_clock::now();
+  const auto active = runtime.context->active_requests.load(std::memory_order_relaxed);
+  const auto background = runtime.context->store->background_writes();
+  const bool idle = runtime.context->admission->connections() == 0 || now >= start + idle_grace;
+  if((active == 0 && background == 0 && idle) || now >= start + runtime.drain_timeout) {
+    if(active > 0 || background > 0) {
+      BOOST_LOG_TRIVIAL(warning)
+        << "Drain timeout is over, dropping " << active << " requests and "
+        << background << " background writes in process";
+    }
+    BOOST_LOG_TRIVIAL(info) << "Stopping the server";
+    stop_service(runtime);
+    return;
+  }
+
+  timer->expires_after(std::chrono::milliseconds(50));
+  timer->async_wait([timer, start, &runtime](beast::error_code ec) {
+    if(!ec) {
+      wait_for_requests(timer, start, runtime);
+    }
+  });
+}
+
+/**
+ * @brief Stops accepting connections and stops the service once the
+ * requests in process are answered. Responses written meanwhile close
+ * their connections.
+ * @param runtime Running service
+ */
+void drain(service_runtime& runtime) {
+  if(runtime.context->draining.exchange(true)) {
+    return;
+  }
+  BOOST_LOG_TRIVIAL(info)
+    << "Draining, waiting up to " << runtime.drain_timeout.count() << " s for requests in process";
+
+  for(auto& acceptor : runtime.acceptors) {
+    net::post(acceptor.get_executor(), [&acceptor] {
+      beast::error_code ec;
+      acceptor.close(ec);
+    });
+  }
+
+  auto timer = std::make_shared<net::steady_timer>(*runtime.iocs[0]);
+  wait_for_requests(timer, std::chrono::steady_clock::now(), runtime);
+}
+
+/**
+ * @brief Parses the settings again and applies the log level and the
+ * connection settings, which new connections take. The other settings
+ * need a restart.
+ * @param runtime Running service
+ */
+void reload(service_runtime& runtime) {
+  try {
+    auto config = parse_command_line(runtime.argc, runtime.argv);
+    set_log_level(config.log.level);
+    runtime.context->update_settings({config.http, config.bulk, config.stream});
+    runtime.drain_timeout = config.drain_timeout;
+    BOOST_LOG_TRIVIAL(warning)
+      << "Settings reloaded, log level " << boost::log::trivial::to_string(config.log.level);
+  }
+  catch(std::exception const& e) {
+    BOOST_LOG_TRIVIAL(error)
+      << "Unable to reload the settings: " << e.what();
+  }
+}
+
+/**
+ * @brief Waits for SIGHUP, which reloads the settings, and SIGTERM or
+ * SIGINT, which drain the service. A second SIGTERM or SIGINT stops it right away.
+ * @param signals Signals
+ * @param runtime Running service
+ */
+void handle_signals(net::signal_set& signals, service_runtime& runtime) {
+  signals.async_wait([&signals, &runtime](beast::error_code ec, int signal) {
+    if(ec) {
+      return;
+    }
+    if(signal == SIGHUP) {
+      reload(runtime);
+    } else if(runtime.context->draining.load()) {
+      BOOST_LOG_TRIVIAL(warning) << "Stopping the server without waiting for requests";
+      stop_service(runtime);
+      return;
+    } else {
+      drain(runtime);
+    }
+    handle_signals(signals, runtime);
+  });
+}
+
+} // namespace
 
 /**
- * @brief Sets the IP address and port, starts the server.
+ * @brief Sets the IP address and port, starts the server and runs it until
+ * it is drained by SIGTERM.
  */
 int main(int argc, char* argv[]) {
+  service_config config;
+  try {
+    config = parse_command_line(argc, argv);
+  }
+  catch(std::exception const& e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
   try {
-    if(argc != 3) {
-      std::cerr << "Usage: " << argv[0] << " <address> <port>\n";
-      std::cerr << "  For IPv4, try:\n";
-      std::cerr << "    receiver 0.0.0.0 80\n";
-      std::cerr << "  For IPv6, try:\n";
-      std::cerr << "    receiver 0::0 80\n";
-      return EXIT_FAILURE;
+    auto const address = net::ip::make_address(config.address);
+    unsigned short port = config.port;
+    const tcp::endpoint endpoint{address, port};
+    const unsigned threads = config.threads != 0 ?
+      config.threads : std::max(1u, std::thread::hardware_concurrency());
+
+    init_log(config.log);
+    BOOST_LOG_TRIVIAL(info)
+      << "Starting the server with " << threads << " threads...";
+
+    service_runtime runtime;
+    runtime.argc = argc;
+    runtime.argv = argv;
+    runtime.drain_timeout = config.drain_timeout;
+
+    auto context = std::make_shared<service_context>();
+    runtime.context = context;
+    if(config.store == store_backend::memory) {
+      BOOST_LOG_TRIVIAL(warning)
+        << "Comments are kept in memory and lost when the server stops";
+      context->store = std::make_shared<memory_store>();
+    } else {
+      auto db = std::make_shared<db_session>(config.db);
+      db->connect();
+      db->warm_up();
+      context->store = std::make_shared<scylla_store>(db, config.batch);
+    }
+    context->update_settings({config.http, config.bulk, config.stream});
+    context->cache = std::make_shared<response_cache>(config.cache);
+    context->hub = std::make_shared<comment_hub>();
+    context->admission = std::make_shared<admission_control>(config.admission);
+    if(!config.trace.file.empty()) {
+      context->tracing = std::make_shared<tracer>(config.trace);
+      BOOST_LOG_TRIVIAL(info)
+        << "Tracing " << (config.trace.sample_rate > 0 ?
+          "one in " + std::to_string(config.trace.sample_rate) + " requests" :
+          std::string("no sampled requests"))
+        << (config.trace.honor_header ? " and requests with X-Trace-Id" : "")
+        << " to " << config.trace.file;
+    }
+
+    // reuseport: every thread runs its own io_context and acceptor, the kernel
+    // balances incoming connections between them.
+    // shared: all threads run one io_context, connections are serialized on strands.
+    const bool reuse_port = config.mode == thread_mode::reuse_port;
+    const unsigned contexts = reuse_port ? threads : 1;
+    const int concurrency_hint = reuse_port ? 1 : static_cast<int>(threads);
+
+    // A listening socket passed by the parent process is shared by all acceptors.
+    // Otherwise the port is bound with SO_REUSEPORT in both modes, so a new
+    // process can listen on it while this one drains.
+    const int inherited_fd = inherited_listen_fd();
+    if(inherited_fd >= 0) {
+      BOOST_LOG_TRIVIAL(info)
+        << "Accepting on the inherited listening socket " << inherited_fd;
     }
 
-    auto const address = net::ip::make_address(argv[1]);
-    unsigned short port = static_cast<unsigned short>(std::atoi(argv[2]));
-    
-    net::io_context ioc{1};
+    auto& iocs = runtime.iocs;
+    auto& acceptors = runtime.acceptors;
+    iocs.reserve(contexts);
+    acceptors.reserve(contexts);
 
-    tcp::acceptor acceptor{ioc, {address, port}};
+    for(unsigned i = 0; i < contexts; ++i) {
+      iocs.push_back(std::make_unique<net::io_context>(concurrency_hint));
+      acceptors.push_back(inherited_fd >= 0 ? adopt_acceptor(*iocs.back(), inherited_fd) :
+        make_acceptor(*iocs.back(), endpoint, true));
+      http_server(acceptors.back(), context);
+    }
+    if(inherited_fd >= 0) {
+      ::close(inherited_fd);
+    }
 
-    tcp::socket socket{ioc};
+    std::optional<net::signal_set> signals;
+    signals.emplace(*iocs[0], SIGTERM, SIGINT, SIGHUP);
+    handle_signals(*signals, runtime);
 
-    init_log();
-    BOOST_LOG_TRIVIAL(info) 
-      << "Starting the server...";
-    
-    http_server(acceptor, socket);
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for(unsigned i = 1; i < threads; ++i) {
+      auto& ioc = *iocs[reuse_port ? i : 0];
+      workers.emplace_back([&ioc] { ioc.run(); });
+    }
+
+    iocs[0]->run();
+
+    for(auto& worker : workers) {
+      worker.join();
+    }
 
-    ioc.run();
+    // Queries still in flight, of requests cut off by the drain timeout or of
+    // background writes, post their handlers to the io_contexts: the store is
+    // closed while they exist. The posted handlers and the connections left
+    // open are dropped with the io_contexts.
+    signals.reset();
+    acceptors.clear();
+    context->store->close();
+    iocs.clear();
+    context.reset();
+    runtime.context.reset();
+    BOOST_LOG_TRIVIAL(info) << "Server stopped";
+    stop_log();
   }
   catch(std::exception const& e) {
+    stop_log();
     std::cerr << "Error: " << e.what() << std::endl;
     return EXIT_FAILURE;
   }
-}
\ No newline at end of file
+}
@@ -0,0 +1,264 @@
+#include "memory_store.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <tuple>
+
+namespace net = boost::asio;
+
+bool memory_store::newest_first::operator()(const comment_order& a, const comment_order& b) const {
+  return std::tie(b.created_time, b.comment_id.time_and_version, b.comment_id.clock_seq_and_node) <
+    std::tie(a.created_time, a.comment_id.time_and_version, a.comment_id.clock_seq_and_node);
+}
+
+memory_store::memory_store(std::size_t shards) :
+  uuid_gen_(cass_uuid_gen_new(), &cass_uuid_gen_free) {
+  shards = std::max<std::size_t>(shards, 1);
+  shards_.reserve(shards);
+  for(std::size_t i = 0; i < shards; ++i) {
+    shards_.push_back(std::make_unique<shard>());
+  }
+}
+
+CassUuid memory_store::new_comment_id() {
+  CassUuid id;
+  cass_uuid_gen_time(uuid_gen_.get(), &id);
+  return id;
+}
+
+void memory_store::list_page(const page_request& request, net::any_io_executor executor,
+  page_handler handler) {
+  comment_order after;
+  bool has_after = false;
+  if (!request.cursor.empty()) {
+    after = decode_cursor(request.cursor);
+    has_after = true;
+  } else if (request.has_keyset) {
+    after = {request.after_created_time, request.after_comment_id};
+    has_after = true;
+  }
+
+  page_result result;
+  auto serialization_start = std::chrono::steady_clock::now();
+  {
+    auto& s = shard_of(request.entity);
+    std::lock_guard lock(s.mutex);
+
+    auto found = s.entities.find(std::string(request.entity));
+    if (found != s.entities.end()) {
+      const auto& comments = found->second.comments;
+      auto it = has_after ? comments.upper_bound(after) : comments.begin();
+      auto to_skip = has_after ? 0 : request.to_skip;
+
+      const comment_order* last = nullptr;
+      comment_fields fields;
+      fields.entity = request.entity;
+      for (; it != comments.end(); ++it) {
+        if (it->second.deleted) {
+          continue;
+        }
+        if (to_skip > 0) {
+          --to_skip;
+          continue;
+        }
+        if (result.row_count == request.per_page) {
+          // A live comment follows the page.
+          if (last != nullptr) {
+            result.next_cursor = encode_cursor(*last);
+          }
+          break;
+        }
+
+        fields.comment_id = it->first.comment_id;
+        fields.created_time = it->first.created_time;
+        fields.author = it->second.author;
+        fields.created_by = it->second.created_by;
+        fields.text = it->second.text;
+        fields.updated_time = it->second.updated_time;
+        result.comments.push_back(result.row_count++ == 0 ? '[' : ',');
+        append_comment(result.comments, fields);
+        last = &it->first;
+      }
+    }
+  }
+  result.comments.append(result.row_count == 0 ? "[]" : "]");
+  result.serialization = std::chrono::steady_clock::now() - serialization_start;
+
+  net::post(executor, [handler = std::move(handler), result = std::move(result)]() mutable {
+    handler(store_status::ok, std::move(result));
+  });
+}
+
+void memory_store::count(std::string_view entity, net::any_io_executor executor,
+  count_handler handler) {
+  long long live = 0;
+  {
+    auto& s = shard_of(entity);
+    std::lock_guard lock(s.mutex);
+    auto found = s.entities.find(std::string(entity));
+    if (found != s.entities.end()) {
+      live = found->second.live;
+    }
+  }
+
+  net::post(executor, [handler = std::move(handler), live] {
+    handler(store_status::ok, live);
+  });
+}
+
+void memory_store::insert(const comment_fields& comment, net::any_io_executor executor,
+  write_handler handler) {
+  {
+    auto& s = shard_of(comment.entity);
+    std::lock_guard lock(s.mutex);
+    auto& entity = s.entities.try_emplace(std::string(comment.entity), &s.pool).first->second;
+
+    // Like a CQL insert, an existing comment with the same key is overwritten.
+    auto [it, inserted] = entity.comments.try_emplace(
+      comment_order{comment.created_time, comment.comment_id});
+    if (inserted) {
+      comments_.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (inserted || it->second.deleted) {
+      ++entity.live;
+    }
+    it->second.author = store_string(s, comment.author);
+    it->second.text = store_string(s, comment.text);
+    it->second.created_by = comment.created_by;
+    it->second.updated_time = comment.updated_time;
+    it->second.deleted = false;
+  }
+
+  net::post(executor, [handler = std::move(handler)] { handler(store_status::ok); });
+}
+
+void memory_store::update_text(const comment_key& key, std::string_view text,
+  net::any_io_executor executor, write_handler handler) {
+  store_status status;
+  {
+    auto& s = shard_of(key.entity);
+    std::lock_guard lock(s.mutex);
+    entity_comments* entity;
+    stored_comment* comment;
+    status = find_live(s, key, entity, comment);
+    if (status == store_status::ok) {
+      // The previous text stays in the arena until the store is destroyed.
+      comment->text = store_string(s, text);
+      comment->updated_time = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+  }
+
+  net::post(executor, [handler = std::move(handler), status] { handler(status); });
+}
+
+void memory_store::soft_delete(const comment_key& key, net::any_io_executor executor,
+  write_handler handler) {
+  store_status status;
+  {
+    auto& s = shard_of(key.entity);
+    std::lock_guard lock(s.mutex);
+    entity_comments* entity;
+    stored_comment* comment;
+    status = find_live(s, key, entity, comment);
+    if (status == store_status::ok) {
+      comment->deleted = true;
+      --entity->live;
+    }
+  }
+
+  net::post(executor, [handler = std::move(handler), status] { handler(status); });
+}
+
+void memory_store::append_metrics(std::string& out) {
+  append_metric_header(out, "comments_memory_store_comments", "gauge",
+    "Comments kept by the memory store, deleted ones included");
+  append_metric_value(out, "comments_memory_store_comments", "",
+    static_cast<double>(comments_.load(std::memory_order_relaxed)));
+  append_metric_header(out, "comments_memory_store_string_bytes", "gauge",
+    "Bytes of authors and texts allocated from the memory store arenas");
+  append_metric_value(out, "comments_memory_store_string_bytes", "",
+    static_cast<double>(string_bytes_.load(std::memory_order_relaxed)));
+}
+
+std::size_t memory_store::background_writes() const {
+  return 0;
+}
+
+void memory_store::close() {}
+
+memory_store::shard& memory_store::shard_of(std::string_view entity) {
+  return *shards_[std::hash<std::string_view>{}(entity) % shards_.size()];
+}
+
+std::string_view memory_store::store_string(shard& s, std::string_view value) {
+  if (value.empty()) {
+    return {};
+  }
+  auto data = static_cast<char*>(s.arena.allocate(value.size(), 1));
+  std::copy(value.begin(), value.end(), data);
+  string_bytes_.fetch_add(value.size(), std::memory_order_relaxed);
+  return std::string_view(data, value.size());
+}
+
+store_status memory_store::find_live(shard& s, const comment_key& key, entity_comments*& entity,
+  stored_comment*& comment) {
+  auto found = s.entities.find(std::string(key.entity));
+  if (found == s.entities.end()) {
+    return store_status::not_found;
+  }
+  auto it = found->second.comments.find(comment_order{key.created_time, key.comment_id});
+  if (it == found->second.comments.end()) {
+    return store_status::not_found;
+  }
+  if (it->second.deleted) {
+    return store_status::deleted;
+  }
+  entity = &found->second;
+  comment = &it->second;
+  return store_status::ok;
+}
+
+std::string memory_store::encode_cursor(const comment_order& order) {
+  static constexpr char digits[] = "0123456789abcdef";
+  const std::uint64_t values[] = {static_cast<std::uint64_t>(order.created_time),
+    order.comment_id.time_and_version, order.comment_id.clock_seq_and_node};
+
+  std::string cursor;
+  cursor.reserve(48);
+  for (auto value : values) {
+    for (int shift = 60; shift >= 0; shift -= 4) {
+      cursor.push_back(digits[(value >> shift) & 0x0f]);
+    }
+  }
+  return cursor;
+}
+
+memory_store::comment_order memory_store::decode_cursor(std::string_view cursor) {
+  if (cursor.size() != 48) {
+    throw request_error("Invalid pagination cursor");
+  }
+
+  std::uint64_t values[3] = {};
+  for (std::size_t i = 0; i < cursor.size(); ++i) {
+    auto c = cursor[i];
+    std::uint64_t nibble;
+    if (c >= '0' && c <= '9') {
+      nibble = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      nibble = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      nibble = c - 'A' + 10;
+    } else {
+      throw request_error("Invalid pagination cursor");
+    }
+    values[i / 16] = (values[i / 16] << 4) | nibble;
+  }
+
+  comment_order order;
+  order.created_time = static_cast<long long>(values[0]);
+  order.comment_id.time_and_version = values[1];
+  order.comment_id.clock_seq_and_node = values[2];
+  return order;
+}
@@ -0,0 +1,343 @@
+#include "metrics.hpp"
+#include <array>
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t route_count = static_cast<std::size_t>(route_id::count);
+constexpr std::size_t phase_count = static_cast<std::size_t>(phase_id::count);
+//! Status classes 1xx to 5xx, index 0 holds unknown codes
+constexpr std::size_t status_classes = 6;
+
+//! Labels of the routes
+constexpr std::array<std::string_view, route_count> route_labels = {
+  "/comments", "/comments/make", "/comments/delete", "/comments/change", "/comments/stream", "/comments/bulk", "other"
+};
+
+//! Labels of the phases
+constexpr std::array<std::string_view, phase_count> phase_labels = {
+  "http_read", "json_parse", "db_execute", "serialization", "write", "request"
+};
+
+//! Sub-buckets of every power of two, relative error of a bucket is 1/8
+constexpr unsigned sub_bucket_bits = 3;
+constexpr std::uint64_t sub_buckets = 1 << sub_bucket_bits;
+//! Largest recorded power of two in microseconds, about 19 hours
+constexpr unsigned max_exponent = 35;
+constexpr std::size_t bucket_count = (max_exponent - sub_bucket_bits + 2) * sub_buckets;
+
+//! Exported bucket bounds are powers of two in microseconds, from 16us to about 16s
+constexpr unsigned first_exported_exponent = 4;
+constexpr unsigned last_exported_exponent = 24;
+
+//! Exported quantiles
+constexpr std::array<double, 4> quantiles = {0.5, 0.9, 0.99, 0.999};
+
+/**
+ * @brief Returns the histogram bucket of the value.
+ *
+ * Values below sub_buckets have a bucket each, larger values are split into
+ * sub_buckets linear buckets per power of two.
+ * @param value Value in microseconds
+ */
+constexpr std::size_t bucket_of(std::uint64_t value) {
+  if (value < sub_buckets) {
+    return static_cast<std::size_t>(value);
+  }
+  unsigned exponent = std::bit_width(value) - 1;
+  if (exponent > max_exponent) {
+    return bucket_count - 1;
+  }
+  auto sub_bucket = (value >> (exponent - sub_bucket_bits)) & (sub_buckets - 1);
+  return static_cast<std::size_t>((exponent - sub_bucket_bits + 1) * sub_buckets + sub_bucket);
+}
+
+/**
+ * @brief Returns the smallest value above the bucket.
+ * @param bucket Bucket index
+ */
+constexpr std::uint64_t bucket_upper_bound(std::size_t bucket) {
+  if (bucket < sub_buckets) {
+    return bucket + 1;
+  }
+  unsigned exponent = static_cast<unsigned>(bucket / sub_buckets) - 1 + sub_bucket_bits;
+  std::uint64_t sub_bucket = bucket % sub_buckets;
+  return (sub_buckets + sub_bucket + 1) << (exponent - sub_bucket_bits);
+}
+
+static_assert(bucket_of(7) == 7 && bucket_of(8) == 8 && bucket_of(15) == 15 && bucket_of(16) == 16);
+static_assert(bucket_upper_bound(bucket_of(1000)) > 1000 && bucket_upper_bound(bucket_of(1000) - 1) <= 1000);
+
+/**
+ * @brief Latency histogram of one route and phase.
+ */
+struct histogram_cells {
+  //! Number of samples per bucket
+  std::array<std::atomic<std::uint64_t>, bucket_count> buckets{};
+  //! Sum of the samples in microseconds
+  std::atomic<std::uint64_t> sum{0};
+};
+
+/**
+ * @brief Metrics written by one thread.
+ *
+ * Only the owning thread writes a shard, so increments are plain loads and
+ * stores. The scrape reads all shards with relaxed loads.
+ */
+struct metrics_shard {
+  //! Histograms indexed by route and phase
+  std::array<histogram_cells, route_count * phase_count> histograms{};
+  //! Responses indexed by route and status class
+  std::array<std::atomic<std::uint64_t>, route_count * status_classes> responses{};
+  //! Accepted connections
+  std::atomic<std::uint64_t> connections_opened{0};
+  //! Closed connections
+  std::atomic<std::uint64_t> connections_closed{0};
+};
+
+/**
+ * @brief Shards of all threads that recorded metrics.
+ * Shards are never freed, so samples of finished threads are kept.
+ */
+struct shard_registry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<metrics_shard>> shards;
+};
+
+shard_registry& registry() {
+  static shard_registry instance;
+  return instance;
+}
+
+/**
+ * @brief Returns the shard of the calling thread, registering it on first use.
+ */
+metrics_shard& local_shard() {
+  thread_local metrics_shard* shard = [] {
+    auto& r = registry();
+    std::lock_guard lock(r.mutex);
+    r.shards.push_back(std::make_unique<metrics_shard>());
+    return r.shards.back().get();
+  }();
+  return *shard;
+}
+
+/**
+ * @brief Adds to a cell written only by the calling thread.
+ * @param cell Cell of the shard of the calling thread
+ * @param value Increment
+ */
+void add(std::atomic<std::uint64_t>& cell, std::uint64_t value = 1) {
+  cell.store(cell.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Appends the number in the shortest form that reads back exactly.
+ * @param out Output buffer
+ * @param value Number
+ */
+void append_number(std::string& out, double value) {
+  char buffer[32];
+  auto [ptr, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+  out.append(buffer, ptr);
+}
+
+/**
+ * @brief Returns the labels of a route and phase.
+ * @param route Route index
+ * @param phase Phase index
+ */
+std::string route_phase_labels(std::size_t route, std::size_t phase) {
+  std::string labels;
+  labels.append("route=\"").append(route_labels[route]);
+  labels.append("\",phase=\"").append(phase_labels[phase]).append("\"");
+  return labels;
+}
+
+} // namespace
+
+route_id route_of(std::string_view target) {
+  target = target.substr(0, target.find('?'));
+  if (target == "/comments") {
+    return route_id::get_comments;
+  }
+  if (target == "/comments/make") {
+    return route_id::add_comment;
+  }
+  if (target == "/comments/delete") {
+    return route_id::delete_comment;
+  }
+  if (target == "/comments/change") {
+    return route_id::change_comment;
+  }
+  if (target == "/comments/stream") {
+    return route_id::stream_comments;
+  }
+  if (target == "/comments/bulk") {
+    return route_id::bulk_comments;
+  }
+  return route_id::other;
+}
+
+std::string_view route_label(route_id route) {
+  return route_labels[static_cast<std::size_t>(route)];
+}
+
+std::string_view phase_label(phase_id phase) {
+  return phase_labels[static_cast<std::size_t>(phase)];
+}
+
+void record_latency(route_id route, phase_id phase, std::chrono::steady_clock::duration duration) {
+  auto micros = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+  auto value = static_cast<std::uint64_t>(micros > 0 ? micros : 0);
+
+  auto& cells = local_shard().histograms[
+    static_cast<std::size_t>(route) * phase_count + static_cast<std::size_t>(phase)];
+  add(cells.buckets[bucket_of(value)]);
+  add(cells.sum, value);
+}
+
+void count_response(route_id route, unsigned status) {
+  auto status_class = status / 100 < status_classes ? status / 100 : 0;
+  add(local_shard().responses[static_cast<std::size_t>(route) * status_classes + status_class]);
+}
+
+void count_connection_opened() {
+  add(local_shard().connections_opened);
+}
+
+void count_connection_closed() {
+  add(local_shard().connections_closed);
+}
+
+void append_service_metrics(std::string& out) {
+  // Sums of all shards.
+  std::vector<std::array<std::uint64_t, bucket_count>> buckets(route_count * phase_count);
+  std::vector<std::uint64_t> sums(route_count * phase_count);
+  std::array<std::uint64_t, route_count * status_classes> responses{};
+  std::uint64_t opened = 0;
+  std::uint64_t closed = 0;
+
+  {
+    auto& r = registry();
+    std::lock_guard lock(r.mutex);
+    for (const auto& shard : r.shards) {
+      for (std::size_t h = 0; h < buckets.size(); ++h) {
+        const auto& cells = shard->histograms[h];
+        for (std::size_t b = 0; b < bucket_count; ++b) {
+          buckets[h][b] += cells.buckets[b].load(std::memory_order_relaxed);
+        }
+        sums[h] += cells.sum.load(std::memory_order_relaxed);
+      }
+      for (std::size_t i = 0; i < responses.size(); ++i) {
+        responses[i] += shard->responses[i].load(std::memory_order_relaxed);
+      }
+      opened += shard->connections_opened.load(std::memory_order_relaxed);
+      closed += shard->connections_closed.load(std::memory_order_relaxed);
+    }
+  }
+
+  append_metric_header(out, "comments_connections_in_flight", "gauge",
+    "Open HTTP connections");
+  append_metric_value(out, "comments_connections_in_flight", "",
+    static_cast<double>(opened >= closed ? opened - closed : 0));
+  append_metric_header(out, "comments_connections_total", "counter",
+    "Accepted HTTP connections");
+  append_metric_value(out, "comments_connections_total", "", static_cast<double>(opened));
+
+  append_metric_header(out, "comments_responses_total", "counter",
+    "Written responses by route and status class");
+  for (std::size_t route = 0; route < route_count; ++route) {
+    for (std::size_t status_class = 1; status_class < status_classes; ++status_class) {
+      auto count = responses[route * status_classes + status_class];
+      if (count == 0) {
+        continue;
+      }
+      std::string labels;
+      labels.append("route=\"").append(route_labels[route]).append("\",code=\"");
+      labels.push_back(static_cast<char>('0' + status_class));
+      labels.append("xx\"");
+      append_metric_value(out, "comments_responses_total", labels, static_cast<double>(count));
+    }
+  }
+
+  append_metric_header(out, "comments_phase_duration_seconds", "histogram",
+    "Duration of request phases by route");
+  std::string quantile_samples;
+  for (std::size_t route = 0; route < route_count; ++route) {
+    for (std::size_t phase = 0; phase < phase_count; ++phase) {
+      const auto& histogram = buckets[route * phase_count + phase];
+      std::uint64_t count = 0;
+      for (auto samples : histogram) {
+        count += samples;
+      }
+      if (count == 0) {
+        continue;
+      }
+
+      auto labels = route_phase_labels(route, phase);
+      std::uint64_t cumulative = 0;
+      std::size_t bucket = 0;
+      for (unsigned exponent = first_exported_exponent; exponent <= last_exported_exponent; ++exponent) {
+        // Powers of two are bucket bounds, so the exported counts are exact.
+        for (auto end = bucket_of(std::uint64_t(1) << exponent); bucket < end; ++bucket) {
+          cumulative += histogram[bucket];
+        }
+        std::string bucket_labels = labels;
+        bucket_labels.append(",le=\"");
+        append_number(bucket_labels, static_cast<double>(std::uint64_t(1) << exponent) / 1e6);
+        bucket_labels.push_back('"');
+        append_metric_value(out, "comments_phase_duration_seconds_bucket", bucket_labels,
+          static_cast<double>(cumulative));
+      }
+      append_metric_value(out, "comments_phase_duration_seconds_bucket", labels + ",le=\"+Inf\"",
+        static_cast<double>(count));
+      append_metric_value(out, "comments_phase_duration_seconds_sum", labels,
+        static_cast<double>(sums[route * phase_count + phase]) / 1e6);
+      append_metric_value(out, "comments_phase_duration_seconds_count", labels,
+        static_cast<double>(count));
+
+      // Quantiles are read from the full resolution buckets, as their upper bounds.
+      cumulative = 0;
+      bucket = 0;
+      for (auto q : quantiles) {
+        auto rank = static_cast<std::uint64_t>(q * static_cast<double>(count - 1)) + 1;
+        while (cumulative + histogram[bucket] < rank) {
+          cumulative += histogram[bucket++];
+        }
+        std::string quantile_labels = labels;
+        quantile_labels.append(",quantile=\"");
+        append_number(quantile_labels, q);
+        quantile_labels.push_back('"');
+        append_metric_value(quantile_samples, "comments_phase_duration_quantile_seconds",
+          quantile_labels, static_cast<double>(bucket_upper_bound(bucket)) / 1e6);
+      }
+    }
+  }
+
+  append_metric_header(out, "comments_phase_duration_quantile_seconds", "gauge",
+    "Quantiles of the duration of request phases, relative error 1/8");
+  out.append(quantile_samples);
+}
+
+void append_metric_header(std::string& out, std::string_view name,
+  std::string_view type, std::string_view help) {
+  out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+  out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+void append_metric_value(std::string& out, std::string_view name,
+  std::string_view labels, double value) {
+  out.append(name);
+  if (!labels.empty()) {
+    out.append("{").append(labels).append("}");
+  }
+  out.push_back(' ');
+  append_number(out, value);
+  out.push_back('\n');
+}
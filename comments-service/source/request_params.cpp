@@ -0,0 +1,297 @@
+#include "request_params.hpp"
+#include "logs.hpp"
+#include <algorithm>
+#include <charconv>
+
+namespace {
+
+/**
+ * @brief SAX handler keeping the text member of a json object.
+ */
+class comment_text_handler : public nlohmann::json_sax<nlohmann::json> {
+ public:
+  //! Text member, empty when it is missing
+  std::string text;
+
+  bool null() override { return scalar(); }
+  bool boolean(bool) override { return scalar(); }
+  bool number_integer(number_integer_t) override { return scalar(); }
+  bool number_unsigned(number_unsigned_t) override { return scalar(); }
+  bool number_float(number_float_t, const string_t&) override { return scalar(); }
+  bool binary(binary_t&) override { return scalar(); }
+
+  bool string(string_t& value) override {
+    if (at_text_) {
+      // Like the json tree, the last of duplicated members wins.
+      text = std::move(value);
+      at_text_ = false;
+      return true;
+    }
+    return scalar();
+  }
+
+  bool start_object(std::size_t) override {
+    check_container();
+    ++depth_;
+    return true;
+  }
+
+  bool key(string_t& name) override {
+    at_text_ = depth_ == 1 && name == "text";
+    return true;
+  }
+
+  bool end_object() override {
+    --depth_;
+    return true;
+  }
+
+  bool start_array(std::size_t) override {
+    if (depth_ == 0) {
+      throw request_error("Request body must be a json object");
+    }
+    check_container();
+    ++depth_;
+    return true;
+  }
+
+  bool end_array() override {
+    --depth_;
+    return true;
+  }
+
+  bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& e) override {
+    throw request_error(std::string("Invalid json body: ") + e.what());
+  }
+
+ private:
+  /**
+   * @brief Handles a value that is neither a string nor a container.
+   */
+  bool scalar() {
+    if (depth_ == 0) {
+      throw request_error("Request body must be a json object");
+    }
+    if (at_text_) {
+      throw request_error("Invalid member: text");
+    }
+    return true;
+  }
+
+  /**
+   * @brief Rejects an object or array as the text member.
+   */
+  void check_container() {
+    if (at_text_) {
+      throw request_error("Invalid member: text");
+    }
+  }
+
+  //! Nesting depth of the current value
+  std::size_t depth_ = 0;
+  //! True when the next value at depth 1 is the text member
+  bool at_text_ = false;
+};
+
+/**
+ * @brief Returns the header value or an empty view if the header is absent.
+ * @param headers Request headers
+ * @param name Header name
+ */
+std::string_view optional_header(const request_fields& headers, std::string_view name) {
+  auto it = headers.find(boost::beast::string_view(name.data(), name.size()));
+  if (it == headers.end()) {
+    return {};
+  }
+  auto value = it->value();
+  return std::string_view(value.data(), value.size());
+}
+
+/**
+ * @brief Returns the header value.
+ * Throws request_error if the header is absent or empty.
+ * @param headers Request headers
+ * @param name Header name
+ */
+std::string_view required_header(const request_fields& headers, std::string_view name) {
+  auto value = optional_header(headers, name);
+  if (value.empty()) {
+    throw request_error("Missing header: " + std::string(name));
+  }
+  return value;
+}
+
+/**
+ * @brief Parses the header value as a decimal integer.
+ * Throws request_error if the value is not a number.
+ * @param name Header name
+ * @param value Header value
+ */
+long long to_integer(std::string_view name, std::string_view value) {
+  long long result = 0;
+  auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+  if (ec != std::errc() || ptr != value.data() + value.size()) {
+    throw request_error("Invalid header " + std::string(name) + ": " + std::string(value));
+  }
+  return result;
+}
+
+/**
+ * @brief Parses the header value as a uuid.
+ * Throws request_error if the value is not a uuid.
+ * @param name Header name
+ * @param value Header value
+ */
+CassUuid to_uuid(std::string_view name, std::string_view value) {
+  // Fits the canonical form with its terminating zero.
+  char text[CASS_UUID_STRING_LENGTH] = {};
+  CassUuid uuid{};
+  if (value.size() != CASS_UUID_STRING_LENGTH - 1) {
+    throw request_error("Invalid header " + std::string(name) + ": " + std::string(value));
+  }
+  std::copy(value.begin(), value.end(), text);
+  if (cass_uuid_from_string(text, &uuid) != CASS_OK) {
+    throw request_error("Invalid header " + std::string(name) + ": " + std::string(value));
+  }
+  return uuid;
+}
+
+/**
+ * @brief Decodes a percent-encoded query parameter value.
+ * Throws request_error on malformed escapes.
+ * @param value Encoded value
+ */
+std::string decode_query_value(std::string_view value) {
+  auto nibble = [](char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    throw request_error("Invalid query parameter escape");
+  };
+
+  std::string result;
+  result.reserve(value.size());
+  for (std::size_t i = 0; i < value.size(); ++i) {
+    if (value[i] == '+') {
+      result.push_back(' ');
+    } else if (value[i] == '%') {
+      if (i + 2 >= value.size()) {
+        throw request_error("Invalid query parameter escape");
+      }
+      result.push_back(static_cast<char>((nibble(value[i + 1]) << 4) | nibble(value[i + 2])));
+      i += 2;
+    } else {
+      result.push_back(value[i]);
+    }
+  }
+  return result;
+}
+
+} // namespace
+
+boost::log::trivial::severity_level parse_log_level_params(const request_fields& headers) {
+  auto level = required_header(headers, "Log-Level");
+  try {
+    return parse_log_level(level);
+  } catch (const std::invalid_argument& e) {
+    throw request_error(e.what());
+  }
+}
+
+std::string parse_stream_entity(std::string_view target, const request_fields& headers) {
+  auto query_start = target.find('?');
+  if (query_start == std::string_view::npos) {
+    return std::string(required_header(headers, "Entity"));
+  }
+
+  auto query = target.substr(query_start + 1);
+  while (!query.empty()) {
+    auto end = query.find('&');
+    auto parameter = query.substr(0, end);
+    if (parameter.substr(0, 7) == "entity=") {
+      auto entity = decode_query_value(parameter.substr(7));
+      if (entity.empty()) {
+        break;
+      }
+      return entity;
+    }
+    query = end == std::string_view::npos ? std::string_view() : query.substr(end + 1);
+  }
+  throw request_error("Missing query parameter: entity");
+}
+
+get_comments_params parse_get_comments_params(const request_fields& headers) {
+  get_comments_params params;
+  params.entity = required_header(headers, "Entity");
+
+  auto page = optional_header(headers, "Pagination-Page");
+  if (!page.empty()) {
+    params.page = std::max(to_integer("Pagination-Page", page), 1LL);
+  }
+  params.per_page = static_cast<int>(std::clamp(to_integer("Pagination-Per-Page",
+    required_header(headers, "Pagination-Per-Page")), 1LL, 100LL));
+
+  params.cursor = optional_header(headers, "Pagination-Cursor");
+
+  auto after_created_time = optional_header(headers, "Pagination-After-Created-Time");
+  if (params.cursor.empty() && !after_created_time.empty()) {
+    params.has_keyset = true;
+    params.after_created_time = to_integer("Pagination-After-Created-Time", after_created_time);
+    params.after_comment_id = to_uuid("Pagination-After-Comment-Id",
+      required_header(headers, "Pagination-After-Comment-Id"));
+  }
+
+  return params;
+}
+
+comment_key parse_comment_key(const request_fields& headers) {
+  comment_key key;
+  key.entity = required_header(headers, "Entity");
+  key.comment_id_text = required_header(headers, "Comment_id");
+  key.comment_id = to_uuid("Comment_id", key.comment_id_text);
+  key.created_time = to_integer("Created_time", required_header(headers, "Created_time"));
+  return key;
+}
+
+new_comment_params parse_new_comment_params(const request_fields& headers) {
+  new_comment_params params;
+  params.entity = required_header(headers, "Entity");
+  params.author = required_header(headers, "Author");
+  params.created_by = to_integer("Created_by", required_header(headers, "Created_by"));
+  return params;
+}
+
+std::string parse_comment_text(std::string_view body) {
+  comment_text_handler handler;
+  nlohmann::json::sax_parse(body.begin(), body.end(), &handler);
+  return std::move(handler.text);
+}
+
+bulk_params parse_bulk_params(const nlohmann::json& body, std::size_t max_entities) {
+  auto entities = body.find("entities");
+  if (entities == body.end() || !entities->is_array() || entities->empty()) {
+    throw request_error("Missing or empty member: entities");
+  }
+  if (entities->size() > max_entities) {
+    throw request_error("Too many entities, at most " + std::to_string(max_entities) + " are allowed");
+  }
+
+  auto limit = body.find("limit");
+  if (limit == body.end() || !limit->is_number_integer()) {
+    throw request_error("Missing or invalid member: limit");
+  }
+
+  bulk_params params;
+  params.limit = static_cast<std::size_t>(std::clamp(limit->get<long long>(), 0LL, 100LL));
+  params.entities.reserve(entities->size());
+  for (const auto& entity : *entities) {
+    if (!entity.is_string() || entity.get_ref<const std::string&>().empty()) {
+      throw request_error("Invalid entity in member: entities");
+    }
+    const auto& name = entity.get_ref<const std::string&>();
+    if (std::find(params.entities.begin(), params.entities.end(), name) == params.entities.end()) {
+      params.entities.push_back(name);
+    }
+  }
+  return params;
+}
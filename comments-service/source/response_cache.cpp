@@ -0,0 +1,130 @@
+#include "response_cache.hpp"
+#include <algorithm>
+#include <functional>
+
+response_cache::response_cache(cache_config config) :
+  config_(std::move(config)) {
+  config_.shards = std::max<std::size_t>(config_.shards, 1);
+  shard_max_bytes_ = config_.max_bytes / config_.shards;
+  shards_.reserve(config_.shards);
+  for(std::size_t i = 0; i < config_.shards; ++i) {
+    shards_.push_back(std::make_unique<shard>());
+  }
+}
+
+bool response_cache::cacheable(long long page, std::size_t per_page) const {
+  return config_.max_bytes > 0 && page >= 1 && page <= config_.max_page && per_page < 256;
+}
+
+std::shared_ptr<const cached_page> response_cache::find(std::string_view entity,
+  long long page, std::size_t per_page) {
+  auto& s = shard_of(entity);
+  std::lock_guard lock(s.mutex);
+
+  auto it = s.index.find(entity);
+  if(it != s.index.end()) {
+    auto& pages = it->second->pages;
+    auto page_it = pages.find(page_key(page, per_page));
+    if(page_it != pages.end()) {
+      if(page_it->second.expires > clock::now()) {
+        s.lru.splice(s.lru.begin(), s.lru, it->second);
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        return page_it->second.value;
+      }
+
+      auto bytes = page_it->second.value->body.size();
+      it->second->bytes -= bytes;
+      s.bytes -= bytes;
+      pages.erase(page_it);
+      if(pages.empty()) {
+        erase(s, it->second);
+      }
+    }
+  }
+
+  misses_.fetch_add(1, std::memory_order_relaxed);
+  return nullptr;
+}
+
+std::uint64_t response_cache::generation(std::string_view entity) {
+  auto& s = shard_of(entity);
+  std::lock_guard lock(s.mutex);
+  return s.generation;
+}
+
+void response_cache::insert(std::string_view entity, long long page, std::size_t per_page,
+  std::uint64_t generation, std::shared_ptr<const cached_page> value) {
+  auto bytes = value->body.size();
+  if(bytes > shard_max_bytes_) {
+    return;
+  }
+
+  auto& s = shard_of(entity);
+  std::lock_guard lock(s.mutex);
+
+  // The entity was changed while the page was read from the db.
+  if(s.generation != generation) {
+    return;
+  }
+
+  auto it = s.index.find(entity);
+  if(it == s.index.end()) {
+    s.lru.push_front(entity_entry{std::string(entity), {}, 0});
+    it = s.index.emplace(s.lru.front().entity, s.lru.begin()).first;
+  } else {
+    s.lru.splice(s.lru.begin(), s.lru, it->second);
+  }
+
+  auto& entry = *it->second;
+  auto& slot = entry.pages[page_key(page, per_page)];
+  if(slot.value) {
+    entry.bytes -= slot.value->body.size();
+    s.bytes -= slot.value->body.size();
+  }
+  slot.value = std::move(value);
+  slot.expires = clock::now() + config_.ttl;
+  entry.bytes += bytes;
+  s.bytes += bytes;
+
+  while(s.bytes > shard_max_bytes_ && s.lru.size() > 1) {
+    erase(s, std::prev(s.lru.end()));
+    evictions_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void response_cache::invalidate(std::string_view entity) {
+  auto& s = shard_of(entity);
+  std::lock_guard lock(s.mutex);
+
+  ++s.generation;
+  auto it = s.index.find(entity);
+  if(it != s.index.end()) {
+    erase(s, it->second);
+  }
+}
+
+std::uint64_t response_cache::hits() const {
+  return hits_.load(std::memory_order_relaxed);
+}
+
+std::uint64_t response_cache::misses() const {
+  return misses_.load(std::memory_order_relaxed);
+}
+
+std::uint64_t response_cache::evictions() const {
+  return evictions_.load(std::memory_order_relaxed);
+}
+
+response_cache::shard& response_cache::shard_of(std::string_view entity) {
+  return *shards_[std::hash<std::string_view>{}(entity) % shards_.size()];
+}
+
+std::uint64_t response_cache::page_key(long long page, std::size_t per_page) {
+  return (static_cast<std::uint64_t>(page) << 8) | per_page;
+}
+
+void response_cache::erase(shard& s, std::list<entity_entry>::iterator it) {
+  s.bytes -= it->bytes;
+  s.index.erase(it->entity);
+  s.lru.erase(it);
+}
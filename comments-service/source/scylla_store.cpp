@@ -0,0 +1,603 @@
+#include "scylla_store.hpp"
+#include "db_future.hpp"
+#include "logs.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+namespace net = boost::asio;
+
+namespace {
+
+/**
+ * @brief Encodes a db paging state as an opaque cursor.
+ * @param data Paging state
+ * @param size Paging state size
+ */
+std::string encode_cursor(const char* data, size_t size) {
+  static constexpr char digits[] = "0123456789abcdef";
+  std::string cursor(size * 2, '0');
+  for (size_t i = 0; i < size; ++i) {
+    auto byte = static_cast<unsigned char>(data[i]);
+    cursor[2 * i] = digits[byte >> 4];
+    cursor[2 * i + 1] = digits[byte & 0x0f];
+  }
+  return cursor;
+}
+
+/**
+ * @brief Decodes a cursor into a db paging state.
+ * Throws request_error on malformed cursors.
+ * @param cursor Cursor
+ */
+std::string decode_cursor(std::string_view cursor) {
+  auto nibble = [](char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    throw request_error("Invalid pagination cursor");
+  };
+
+  if (cursor.empty() || cursor.size() % 2 != 0) {
+    throw request_error("Invalid pagination cursor");
+  }
+
+  std::string paging_state(cursor.size() / 2, '\0');
+  for (size_t i = 0; i < paging_state.size(); ++i) {
+    paging_state[i] = static_cast<char>((nibble(cursor[2 * i]) << 4) | nibble(cursor[2 * i + 1]));
+  }
+  return paging_state;
+}
+
+//! Size of the checksum that ends a paging state cursor
+constexpr size_t cursor_checksum_size = 4;
+
+/**
+ * @brief Returns the FNV-1a hash of a paging state, appended to its cursor
+ * so that cursors not issued by the service are rejected before they reach the db.
+ * @param paging_state Paging state
+ */
+std::uint32_t cursor_checksum(std::string_view paging_state) {
+  std::uint32_t hash = 2166136261u;
+  for (char c : paging_state) {
+    hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+  }
+  return hash;
+}
+
+/**
+ * @brief Encodes a db paging state and its checksum as a cursor.
+ * @param data Paging state
+ * @param size Paging state size
+ */
+std::string encode_paging_cursor(const char* data, size_t size) {
+  std::string fields(data, size);
+  auto checksum = cursor_checksum(fields);
+  for (size_t i = 0; i < cursor_checksum_size; ++i) {
+    fields.push_back(static_cast<char>(checksum >> (24 - 8 * i)));
+  }
+  return encode_cursor(fields.data(), fields.size());
+}
+
+/**
+ * @brief Decodes a paging state cursor and checks its checksum.
+ * Throws request_error on malformed cursors.
+ * @param cursor Cursor
+ */
+std::string decode_paging_cursor(std::string_view cursor) {
+  auto fields = decode_cursor(cursor);
+  if (fields.size() <= cursor_checksum_size) {
+    throw request_error("Invalid pagination cursor");
+  }
+  auto paging_state = fields.substr(0, fields.size() - cursor_checksum_size);
+  std::uint32_t checksum = 0;
+  for (size_t i = paging_state.size(); i < fields.size(); ++i) {
+    checksum = (checksum << 8) | static_cast<unsigned char>(fields[i]);
+  }
+  if (checksum != cursor_checksum(paging_state)) {
+    throw request_error("Invalid pagination cursor");
+  }
+  return paging_state;
+}
+
+//! First character of a keyset cursor, other cursors are hex encoded paging states
+constexpr char keyset_cursor_prefix = 'k';
+
+/**
+ * @brief Encodes the created time and comment id of the last comment of a
+ * page as a cursor, the next page is read like a keyset page.
+ * @param created_time Creation time
+ * @param comment_id Comment id
+ */
+std::string encode_keyset_cursor(cass_int64_t created_time, const CassUuid& comment_id) {
+  char fields[24];
+  for (int i = 0; i < 8; ++i) {
+    fields[i] = static_cast<char>(static_cast<std::uint64_t>(created_time) >> (56 - 8 * i));
+    fields[8 + i] = static_cast<char>(comment_id.time_and_version >> (56 - 8 * i));
+    fields[16 + i] = static_cast<char>(comment_id.clock_seq_and_node >> (56 - 8 * i));
+  }
+  return keyset_cursor_prefix + encode_cursor(fields, sizeof(fields));
+}
+
+/**
+ * @brief Decodes a keyset cursor.
+ * Throws request_error on malformed cursors.
+ * @param cursor Cursor with the keyset prefix
+ * @param created_time Decoded creation time
+ * @param comment_id Decoded comment id
+ */
+void decode_keyset_cursor(std::string_view cursor, cass_int64_t& created_time,
+  CassUuid& comment_id) {
+  auto fields = decode_cursor(cursor.substr(1));
+  if (fields.size() != 24) {
+    throw request_error("Invalid pagination cursor");
+  }
+  auto field = [&](size_t first) {
+    std::uint64_t value = 0;
+    for (size_t i = first; i < first + 8; ++i) {
+      value = (value << 8) | static_cast<unsigned char>(fields[i]);
+    }
+    return value;
+  };
+  created_time = static_cast<cass_int64_t>(field(0));
+  comment_id.time_and_version = field(8);
+  comment_id.clock_seq_and_node = field(16);
+}
+
+} // namespace
+
+scylla_store::scylla_store(std::shared_ptr<db_session> db, insert_batch_config batch) :
+  db_(std::move(db)) {
+  if (batch.max_size > 1) {
+    // A comment written to both tables must not exist in one of them only.
+    batcher_ = std::make_shared<insert_batcher>(db_, batch,
+      db_->schema() == schema_mode::v1 ? CASS_BATCH_TYPE_UNLOGGED : CASS_BATCH_TYPE_LOGGED);
+  }
+}
+
+CassUuid scylla_store::new_comment_id() {
+  return db_->new_comment_id();
+}
+
+void scylla_store::list_page(const page_request& request, net::any_io_executor executor,
+  page_handler handler) {
+  auto page = std::make_shared<page_state>();
+  page->per_page = request.per_page;
+  page->request_id = log_request_id();
+  page->trace = current_trace();
+  page->executor = std::move(executor);
+  page->handler = std::move(handler);
+
+  // A cursor or a keyset continues right after the previous page, only the
+  // page number fallback has to skip the rows of the previous pages. A paging
+  // state cursor continues in table order, the keyset is then not needed.
+  std::string paging_state;
+  bool keyset = request.has_keyset;
+  cass_int64_t after_created_time = request.after_created_time;
+  CassUuid after_comment_id = request.after_comment_id;
+  if (!request.cursor.empty() && request.cursor.front() == keyset_cursor_prefix) {
+    decode_keyset_cursor(request.cursor, after_created_time, after_comment_id);
+    keyset = true;
+  } else if (!request.cursor.empty()) {
+    paging_state = decode_paging_cursor(request.cursor);
+    keyset = false;
+  } else if (!keyset) {
+    page->to_skip = request.to_skip;
+  }
+
+  page->keyset = keyset;
+  page->id = page_query(db_->schema(), keyset);
+  page->statement = db_->statements().bind(page->id);
+  trace_statement(page->statement.get());
+  cass_statement_bind_string_n(page->statement.get(), 0,
+    request.entity.data(), request.entity.size());
+
+  if (keyset) {
+    cass_statement_bind_int64(page->statement.get(), 1, after_created_time);
+    cass_statement_bind_uuid(page->statement.get(), 2, after_comment_id);
+  }
+
+  if (page->id == query_id::get_comments_same_time) {
+    page->next_statement = db_->statements().bind(query_id::get_comments_after);
+    trace_statement(page->next_statement.get());
+    cass_statement_bind_string_n(page->next_statement.get(), 0,
+      request.entity.data(), request.entity.size());
+    cass_statement_bind_int64(page->next_statement.get(), 1, after_created_time);
+  }
+
+  if (!paging_state.empty()) {
+    cass_statement_set_paging_state_token(page->statement.get(),
+      paging_state.data(), paging_state.size());
+  }
+
+  page->result.comments.reserve(page->per_page * 256);
+  fetch_page(page);
+}
+
+void scylla_store::fetch_page(std::shared_ptr<page_state> page) {
+  auto self = shared_from_this();
+
+  // Never fetch more rows than the page needs, so that the paging state of the
+  // last db page points right after the last returned comment.
+  auto rows_needed = page->to_skip + page->per_page - page->result.row_count;
+  cass_statement_set_paging_size(page->statement.get(), static_cast<int>(
+    std::min<size_t>(rows_needed, std::numeric_limits<int>::max())));
+
+  async_wait_future(cass_session_execute(db_->get(), page->statement.get()),
+    page->executor, [self, page](CassFuture* result_future) {
+      log_request_scope log_scope(page->request_id);
+      record_db_trace(page->trace, prepared_statements::text(page->id), result_future);
+      if (!self->query_succeeded(page->id, result_future)) {
+        page->handler(store_status::failed, {});
+        return;
+      }
+
+      auto result = result_ptr(cass_future_get_result(result_future), &cass_result_free);
+      bool has_more_pages = cass_result_has_more_pages(result.get()) == cass_true;
+
+      try {
+        auto serialization_start = std::chrono::steady_clock::now();
+        append_rows(result.get(), *page);
+        page->result.serialization += std::chrono::steady_clock::now() - serialization_start;
+      } catch (const std::exception &e) {
+        BOOST_LOG_TRIVIAL(error)
+          << "Error with query result handling: " << e.what();
+        page->handler(store_status::failed, {});
+        return;
+      }
+
+      if (has_more_pages && page->result.row_count < page->per_page) {
+        cass_statement_set_paging_state(page->statement.get(), result.get());
+        self->fetch_page(page);
+        return;
+      }
+
+      if (page->next_statement && page->result.row_count < page->per_page) {
+        page->statement = std::move(page->next_statement);
+        page->id = query_id::get_comments_after;
+        self->fetch_page(page);
+        return;
+      }
+
+      if (page->next_statement || (page->keyset && has_more_pages)) {
+        // The paging state of a keyset query only fits that query, the next
+        // page starts after the last comment like a keyset page. In v1 the
+        // older comments may also not be read yet.
+        page->result.next_cursor = encode_keyset_cursor(
+          page->last_created_time, page->last_comment_id);
+      } else if (has_more_pages) {
+        const char* paging_state;
+        size_t paging_state_size;
+        cass_result_paging_state_token(result.get(), &paging_state, &paging_state_size);
+        page->result.next_cursor = encode_paging_cursor(paging_state, paging_state_size);
+      }
+
+      page->result.comments.append(page->result.row_count == 0 ? "[]" : "]");
+      page->handler(store_status::ok, std::move(page->result));
+    });
+}
+
+void scylla_store::append_rows(const CassResult* result, page_state& page) {
+  auto rows = std::unique_ptr<CassIterator,
+    decltype(&cass_iterator_free)>(cass_iterator_from_result(result), &cass_iterator_free);
+
+  auto& out = page.result.comments;
+  const CassRow* last = nullptr;
+  while (cass_iterator_next(rows.get()) && page.result.row_count < page.per_page) {
+    if (page.to_skip > 0) {
+      --page.to_skip;
+    } else {
+      last = cass_iterator_get_row(rows.get());
+      out.push_back(page.result.row_count++ == 0 ? '[' : ',');
+      append_comment_row(out, last);
+    }
+  }
+
+  if (last != nullptr) {
+    cass_value_get_int64(cass_row_get_column(last, 1), &page.last_created_time);
+    cass_value_get_uuid(cass_row_get_column(last, 2), &page.last_comment_id);
+  }
+}
+
+void scylla_store::count(std::string_view entity, net::any_io_executor executor,
+  count_handler handler) {
+  auto self = shared_from_this();
+
+  auto statement = db_->statements().bind(query_id::get_comment_count);
+  cass_statement_bind_string_n(statement.get(), 0, entity.data(), entity.size());
+  trace_statement(statement.get());
+
+  async_wait_future(cass_session_execute(db_->get(), statement.get()),
+    std::move(executor), [self, handler = std::move(handler),
+      request_id = log_request_id(), trace = current_trace()](CassFuture* result_future) {
+      log_request_scope log_scope(request_id);
+      record_db_trace(trace, prepared_statements::text(query_id::get_comment_count), result_future);
+      if (!self->query_succeeded(query_id::get_comment_count, result_future)) {
+        handler(store_status::failed, 0);
+        return;
+      }
+
+      auto result = result_ptr(cass_future_get_result(result_future), &cass_result_free);
+      cass_int64_t total_rows = 0;
+      if (auto row = cass_result_first_row(result.get())) {
+        cass_value_get_int64(cass_row_get_column(row, 0), &total_rows);
+      }
+      // The counter is not clamped, a negative count shows that it drifted.
+      if (total_rows < 0) {
+        BOOST_LOG_TRIVIAL(warning)
+          << "Comment counter is negative: " << total_rows;
+      }
+      handler(store_status::ok, total_rows);
+    });
+}
+
+void scylla_store::insert(const comment_fields& comment, net::any_io_executor executor,
+  write_handler handler) {
+  auto bind = [&](query_id id) {
+    auto statement = db_->statements().bind(id);
+    cass_statement_bind_uuid(statement.get(), 0, comment.comment_id);
+    cass_statement_bind_string_n(statement.get(), 1, comment.entity.data(), comment.entity.size());
+    cass_statement_bind_string_n(statement.get(), 2, comment.author.data(), comment.author.size());
+    cass_statement_bind_string_n(statement.get(), 3, comment.text.data(), comment.text.size());
+    cass_statement_bind_int64(statement.get(), 4, comment.created_by);
+    cass_statement_bind_int64(statement.get(), 5, comment.created_time);
+    cass_statement_bind_int64(statement.get(), 6, comment.updated_time);
+    return statement;
+  };
+
+  auto statement = bind(query_id::add_comment);
+  const mutation_queries queries{query_id::add_comment, query_id::count};
+  statement_ptr no_mirror(nullptr, &cass_statement_free);
+
+  if (batcher_) {
+    std::vector<statement_ptr> statements;
+    statements.push_back(std::move(statement));
+    if (db_->schema() != schema_mode::v1) {
+      statements.push_back(bind(query_id::add_live_comment));
+    }
+
+    // The counter is updated by the insert batcher.
+    batcher_->add(comment.entity, std::move(statements), std::move(executor),
+      [self = shared_from_this(), handler = std::move(handler),
+        request_id = log_request_id()](CassFuture* result_future) {
+        log_request_scope log_scope(request_id);
+        handler(self->mutation_status(query_id::add_comment, result_future));
+      });
+    return;
+  }
+
+  if (db_->schema() == schema_mode::v1) {
+    trace_statement(statement.get());
+    complete_mutation(queries, cass_session_execute(db_->get(), statement.get()),
+      std::move(no_mirror), comment.entity, std::move(executor), std::move(handler));
+    return;
+  }
+
+  // Both inserts target the entity partition, the logged batch makes sure
+  // a comment never exists in one table only.
+  auto live_statement = bind(query_id::add_live_comment);
+  auto batch = std::unique_ptr<CassBatch, decltype(&cass_batch_free)>(
+    cass_batch_new(CASS_BATCH_TYPE_LOGGED), &cass_batch_free);
+  cass_batch_add_statement(batch.get(), statement.get());
+  cass_batch_add_statement(batch.get(), live_statement.get());
+  trace_batch(batch.get());
+
+  complete_mutation(queries, cass_session_execute_batch(db_->get(), batch.get()),
+    std::move(no_mirror), comment.entity, std::move(executor), std::move(handler));
+}
+
+void scylla_store::update_text(const comment_key& key, std::string_view text,
+  net::any_io_executor executor, write_handler handler) {
+  auto queries = change_queries(db_->schema());
+  auto statement = bind_comment_key(queries.primary, key, 1);
+  cass_statement_bind_string_n(statement.get(), 0, text.data(), text.size());
+  trace_statement(statement.get());
+
+  statement_ptr mirror(nullptr, &cass_statement_free);
+  if (queries.mirror != query_id::count) {
+    mirror = bind_comment_key(queries.mirror, key, 1);
+    cass_statement_bind_string_n(mirror.get(), 0, text.data(), text.size());
+  }
+
+  complete_mutation(queries, cass_session_execute(db_->get(), statement.get()),
+    std::move(mirror), key.entity, std::move(executor), std::move(handler));
+}
+
+void scylla_store::soft_delete(const comment_key& key, net::any_io_executor executor,
+  write_handler handler) {
+  auto queries = delete_queries(db_->schema());
+  auto statement = bind_comment_key(queries.primary, key, 0);
+  trace_statement(statement.get());
+  auto mirror = queries.mirror != query_id::count ?
+    bind_comment_key(queries.mirror, key, 0) : statement_ptr(nullptr, &cass_statement_free);
+
+  complete_mutation(queries, cass_session_execute(db_->get(), statement.get()),
+    std::move(mirror), key.entity, std::move(executor), std::move(handler));
+}
+
+statement_ptr scylla_store::bind_comment_key(query_id id, const comment_key& key, size_t first) {
+  auto statement = db_->statements().bind(id);
+  cass_statement_bind_string_n(statement.get(), first, key.entity.data(), key.entity.size());
+  cass_statement_bind_uuid(statement.get(), first + 1, key.comment_id);
+  cass_statement_bind_int64(statement.get(), first + 2, key.created_time);
+  return statement;
+}
+
+void scylla_store::complete_mutation(mutation_queries queries, CassFuture* result_future,
+  statement_ptr mirror, std::string_view entity, net::any_io_executor executor,
+  write_handler handler) {
+  async_wait_future(result_future, executor,
+    [self = shared_from_this(), queries, mirror = std::move(mirror), entity = std::string(entity),
+      executor, handler = std::move(handler), request_id = log_request_id(),
+      trace = current_trace()](CassFuture* result_future) mutable {
+      log_request_scope log_scope(request_id);
+      record_db_trace(trace, prepared_statements::text(queries.primary), result_future);
+      auto status = self->mutation_status(queries.primary, result_future);
+      if (status == store_status::ok) {
+        if (mirror) {
+          self->run_in_background(queries.mirror, std::move(mirror), entity, executor);
+        }
+        if (queries.primary == query_id::add_comment) {
+          self->update_comment_count(query_id::increment_comment_count, entity, executor);
+        } else if (queries.primary == query_id::delete_comment ||
+          queries.primary == query_id::delete_live_comment) {
+          self->update_comment_count(query_id::decrement_comment_count, entity, executor);
+        }
+      }
+      handler(status);
+    });
+}
+
+store_status scylla_store::mutation_status(query_id id, CassFuture* result_future) {
+  if (!query_succeeded(id, result_future)) {
+    return store_status::failed;
+  }
+  // Change and delete are conditional on the comment being alive.
+  return id == query_id::add_comment ? store_status::ok : applied_status(result_future);
+}
+
+store_status scylla_store::applied_status(CassFuture* result_future) {
+  auto result = result_ptr(cass_future_get_result(result_future), &cass_result_free);
+  auto row = cass_result_first_row(result.get());
+
+  cass_bool_t applied = cass_false;
+  if (row != nullptr) {
+    cass_value_get_bool(cass_row_get_column(row, 0), &applied);
+  }
+  if (applied == cass_true) {
+    return store_status::ok;
+  }
+
+  // A failed condition returns the current value of deleted, which is null
+  // when the comment does not exist at all. Conditions on comments_live are
+  // IF EXISTS and return no columns, deleted comments are not found there.
+  cass_bool_t deleted = cass_false;
+  auto deleted_value = row != nullptr && cass_result_column_count(result.get()) > 1 ?
+    cass_row_get_column(row, 1) : nullptr;
+  if (deleted_value != nullptr && !cass_value_is_null(deleted_value)) {
+    cass_value_get_bool(deleted_value, &deleted);
+  }
+  return deleted == cass_true ? store_status::deleted : store_status::not_found;
+}
+
+bool scylla_store::query_succeeded(query_id id, CassFuture* result_future) {
+  auto error = cass_future_error_code(result_future);
+  if (error == CASS_OK) {
+    return true;
+  }
+
+  const char* message;
+  size_t message_length;
+  cass_future_error_message(result_future, &message, &message_length);
+  BOOST_LOG_TRIVIAL(error)
+    << "Unable to run query: " << std::string(message, message_length);
+  db_->statements().handle_error(id, error);
+  return false;
+}
+
+void scylla_store::run_in_background(query_id id, statement_ptr statement, std::string_view entity,
+  net::any_io_executor executor) {
+  // The caller does not wait for the query, the db session outlives the request.
+  // It is counted so that a draining service waits for it.
+  db_->background_started();
+  async_wait_future(cass_session_execute(db_->get(), statement.get()),
+    std::move(executor), [db = db_, id, entity = std::string(entity),
+      request_id = log_request_id()](CassFuture* result_future) {
+      log_request_scope log_scope(request_id);
+      db->background_finished();
+      auto error = cass_future_error_code(result_future);
+      if (error != CASS_OK) {
+        const char* message;
+        size_t message_length;
+        cass_future_error_message(result_future, &message, &message_length);
+        BOOST_LOG_TRIVIAL(error)
+          << "Unable to run background query for entity " << entity
+          << ": " << prepared_statements::text(id)
+          << ": " << std::string(message, message_length);
+        db->statements().handle_error(id, error);
+      }
+    });
+}
+
+void scylla_store::update_comment_count(query_id id, std::string_view entity,
+  net::any_io_executor executor) {
+  auto statement = db_->statements().bind(id);
+  cass_statement_bind_string_n(statement.get(), 0, entity.data(), entity.size());
+  run_in_background(id, std::move(statement), entity, std::move(executor));
+}
+
+std::size_t scylla_store::background_writes() const {
+  return db_->background_queries();
+}
+
+void scylla_store::close() {
+  if (batcher_) {
+    batcher_->flush_all();
+  }
+  db_->close();
+}
+
+void scylla_store::append_metrics(std::string& out) {
+  auto& statements = db_->statements();
+  append_metric_header(out, "comments_prepared_statements_total", "counter",
+    "Statements bound from a prepared query or built from the query text");
+  append_metric_value(out, "comments_prepared_statements_total", "result=\"hit\"",
+    static_cast<double>(statements.hits()));
+  append_metric_value(out, "comments_prepared_statements_total", "result=\"miss\"",
+    static_cast<double>(statements.misses()));
+
+  if (batcher_) {
+    append_metric_header(out, "comments_insert_batches_total", "counter",
+      "Batches sent by the insert batcher");
+    append_metric_value(out, "comments_insert_batches_total", "",
+      static_cast<double>(batcher_->batches()));
+    append_metric_header(out, "comments_batched_inserts_total", "counter",
+      "Comments sent by the insert batcher");
+    append_metric_value(out, "comments_batched_inserts_total", "",
+      static_cast<double>(batcher_->batched_inserts()));
+  }
+
+  append_metric_header(out, "comments_db_connect_seconds", "gauge",
+    "Time taken to connect the db session at startup");
+  append_metric_value(out, "comments_db_connect_seconds", "",
+    std::chrono::duration<double>(db_->connect_time()).count());
+
+  CassMetrics db_metrics;
+  cass_session_get_metrics(db_->get(), &db_metrics);
+
+  append_metric_header(out, "comments_db_request_latency_seconds", "gauge",
+    "Driver request latency quantiles");
+  const std::pair<const char*, cass_uint64_t> latencies[] = {
+    {"0.5", db_metrics.requests.median},
+    {"0.75", db_metrics.requests.percentile_75th},
+    {"0.95", db_metrics.requests.percentile_95th},
+    {"0.98", db_metrics.requests.percentile_98th},
+    {"0.99", db_metrics.requests.percentile_99th},
+    {"0.999", db_metrics.requests.percentile_999th}
+  };
+  for (const auto& [quantile, micros] : latencies) {
+    append_metric_value(out, "comments_db_request_latency_seconds",
+      std::string("quantile=\"") + quantile + "\"", static_cast<double>(micros) / 1e6);
+  }
+  append_metric_header(out, "comments_db_request_rate", "gauge",
+    "Driver requests per second over the last minute");
+  append_metric_value(out, "comments_db_request_rate", "",
+    db_metrics.requests.one_minute_rate);
+
+  append_metric_header(out, "comments_db_connections", "gauge",
+    "Driver connections");
+  append_metric_value(out, "comments_db_connections", "state=\"total\"",
+    static_cast<double>(db_metrics.stats.total_connections));
+  append_metric_value(out, "comments_db_connections", "state=\"available\"",
+    static_cast<double>(db_metrics.stats.available_connections));
+
+  append_metric_header(out, "comments_db_timeouts_total", "counter",
+    "Driver timeouts");
+  append_metric_value(out, "comments_db_timeouts_total", "kind=\"connection\"",
+    static_cast<double>(db_metrics.errors.connection_timeouts));
+  append_metric_value(out, "comments_db_timeouts_total", "kind=\"pending_request\"",
+    static_cast<double>(db_metrics.errors.pending_request_timeouts));
+  append_metric_value(out, "comments_db_timeouts_total", "kind=\"request\"",
+    static_cast<double>(db_metrics.errors.request_timeouts));
+}
@@ -1,7 +1,31 @@
 #include "server.hpp"
+#include <sys/socket.h>
+#include <unistd.h>
 
-http_connection::http_connection(tcp::socket socket) : 
-  socket_(std::move(socket)) {}
+std::shared_ptr<const connection_settings> service_context::settings() const {
+  std::lock_guard lock(settings_mutex_);
+  return settings_;
+}
+
+void service_context::update_settings(connection_settings settings) {
+  auto updated = std::make_shared<const connection_settings>(std::move(settings));
+  std::lock_guard lock(settings_mutex_);
+  settings_ = std::move(updated);
+}
+
+http_connection::http_connection(connection_socket socket, std::shared_ptr<service_context> context) : 
+  socket_(std::move(socket)), context_(std::move(context)), settings_(context_->settings()) {
+  count_connection_opened();
+}
+
+http_connection::~http_connection() {
+  if (admitted_) {
+    context_->admission->release(std::chrono::steady_clock::now() - request_start_);
+  }
+  end_request();
+  context_->admission->close_connection();
+  count_connection_closed();
+}
 
 void http_connection::start() {
   read_request();
@@ -9,56 +33,258 @@ void http_connection::start() {
 }
 
 void http_connection::read_request() {
+  // Everything drawing from the arena is dropped before it is released, the
+  // response body keeps its capacity for the next response.
+  request_ = {};
+  response_.base() = {};
+  response_.body().clear();
+  serializer_.reset();
+  parser_.reset();
+  arena_.release();
+  event_.clear();
+  parser_.emplace(std::piecewise_construct, std::make_tuple(), std::make_tuple(&arena_));
+  parser_->body_limit(settings_->http.max_body_bytes);
+  deadline_.expires_after(settings_->http.idle_timeout);
+
+  // Pipelined requests are already in buffer_ and are served one by one in order.
+  if (buffer_.size() > 0) {
+    read_request_message();
+    return;
+  }
+
+  // Idle time of keep-alive connections is not part of the read phase.
   auto self = shared_from_this();
+  socket_.async_wait(tcp::socket::wait_read, [self](beast::error_code ec) {
+    if(!ec) {
+      self->read_request_message();
+    } else {
+      self->close();
+    }
+  });
+}
+
+void http_connection::read_request_message() {
+  auto self = shared_from_this();
+  read_start_ = std::chrono::steady_clock::now();
 
-  http::async_read(socket_, buffer_, request_,
+  http::async_read(socket_, buffer_, *parser_,
     [self](beast::error_code ec, std::size_t bytes_transferred) {
       boost::ignore_unused(bytes_transferred);
       if(!ec) {
+        self->deadline_.expires_at(net::steady_timer::time_point::max());
+        self->start_request();
         self->process_request();
+      } else if(ec == http::error::body_limit) {
+        self->reject_oversized_request();
+      } else {
+        self->close();
       }
     });
 }
 
+void http_connection::start_request() {
+  request_ = parser_->release();
+  request_id_ = next_request_id();
+  request_start_ = std::chrono::steady_clock::now();
+  active_ = true;
+  context_->active_requests.fetch_add(1, std::memory_order_relaxed);
+
+  // Without tracing a request costs a null check and the reset of an empty pointer.
+  trace_.reset();
+  if (context_->tracing) {
+    start_trace();
+  }
+}
+
+void http_connection::end_request() {
+  if (active_) {
+    active_ = false;
+    context_->active_requests.fetch_sub(1, std::memory_order_relaxed);
+  }
+}
+
+void http_connection::start_trace() {
+  std::string_view trace_id;
+  auto header = request_.find("X-Trace-Id");
+  if (header != request_.end()) {
+    trace_id = std::string_view(header->value().data(), header->value().size());
+  }
+
+  // Clients can only force tracing when they are trusted to, otherwise
+  // their trace id is kept but the request is sampled like the others.
+  const bool requested = tracer::valid_trace_id(trace_id);
+  if (!(requested && context_->tracing->honors_header()) && !context_->tracing->sample()) {
+    return;
+  }
+
+  trace_ = std::make_shared<request_trace>();
+  trace_->writer = context_->tracing;
+  trace_->trace_id = requested ? std::string(trace_id) : tracer::new_trace_id();
+  trace_->request_id = request_id_;
+}
+
+void http_connection::record_phase(phase_id phase, std::chrono::steady_clock::time_point start,
+  std::chrono::steady_clock::duration duration) const {
+  record_phase(route_, trace_, phase, start, duration);
+}
+
+void http_connection::record_phase(route_id route, const std::shared_ptr<request_trace>& trace,
+  phase_id phase, std::chrono::steady_clock::time_point start,
+  std::chrono::steady_clock::duration duration) {
+  record_latency(route, phase, duration);
+  if (trace) {
+    trace->writer->record_span(trace->trace_id, trace->request_id, phase_label(phase),
+      route_label(route), start, duration);
+  }
+}
+
+void http_connection::reject_oversized_request() {
+  // With a Content-Length the limit is checked as soon as the header is parsed.
+  start_request();
+
+  log_request_scope log_scope(request_id_);
+  setup_response();
+  BOOST_LOG_TRIVIAL(warning) 
+    << "Request body exceeds " << settings_->http.max_body_bytes << " bytes";
+
+  response_.keep_alive(false);
+  response_.result(http::status::payload_too_large);
+  write_response();
+}
+
 void http_connection::process_request() {
+  log_request_scope log_scope(request_id_);
+  trace_scope trace(trace_);
   setup_response();
+  awaiting_db_ = false;
+
+  if (!admit_request()) {
+    write_response();
+    return;
+  }
 
   try {
-    const std::unordered_map<http::verb, std::function<void()>> method_handlers = {
-      {http::verb::get, std::bind(&http_connection::handle_get_request, this)},
-      {http::verb::post, std::bind(&http_connection::handle_post_request, this)},
-      {http::verb::patch, std::bind(&http_connection::handle_patch_request, this)}
+    static const std::unordered_map<http::verb, void (http_connection::*)()> method_handlers = {
+      {http::verb::get, &http_connection::handle_get_request},
+      {http::verb::post, &http_connection::handle_post_request},
+      {http::verb::patch, &http_connection::handle_patch_request}
     };
 
     auto handler = method_handlers.find(request_.method());
     if (handler != method_handlers.end()) {
-      handler->second();
+      (this->*handler->second)();
     } else {
       BOOST_LOG_TRIVIAL(error) 
           << "Invalid request method: " << request_.method_string();
       response_.result(http::status::not_found);
     }
+  } catch (const request_error &e) {
+    BOOST_LOG_TRIVIAL(error) 
+      << "Invalid request: " << e.what();
+    response_.result(http::status::bad_request);
+    response_.body().clear();
+    awaiting_db_ = false;
   } catch (const std::exception &e) {
     BOOST_LOG_TRIVIAL(error) 
       << "Error with request handling: " << e.what();
     response_.result(http::status::bad_request);
+    response_.body().clear();
+    awaiting_db_ = false;
   }
 
-  write_response();
+  if(!awaiting_db_ && !detached_) {
+    write_response();
+  }
 }
 
 void http_connection::setup_response() {
   response_.version(request_.version());
-  response_.keep_alive(false);
+  ++requests_served_;
+  // A draining service closes every connection after its current request.
+  response_.keep_alive(request_.keep_alive() &&
+    requests_served_ < settings_->http.max_requests_per_connection &&
+    !context_->draining.load(std::memory_order_relaxed));
   response_.set(http::field::content_type, "application/json");
   response_.set(http::field::server, "presetshare.comments");
+  response_.set("X-Request-Id", std::to_string(request_id_));
+  if (trace_) {
+    response_.set("X-Trace-Id", trace_->trace_id);
+  } else if (context_->tracing) {
+    // The trace id of an untraced request is still returned to the client.
+    auto header = request_.find("X-Trace-Id");
+    if (header != request_.end() && tracer::valid_trace_id(
+        std::string_view(header->value().data(), header->value().size()))) {
+      response_.set("X-Trace-Id", header->value());
+    }
+  }
   target_ = request_.target();
   response_.result(http::status::ok);
+
+  route_ = route_of(std::string_view(target_.data(), target_.size()));
+  record_phase(phase_id::http_read, read_start_, request_start_ - read_start_);
+}
+
+bool http_connection::admit_request() {
+  // Admin, metrics and stream requests do not reach the store.
+  if (route_ == route_id::other || route_ == route_id::stream_comments) {
+    return true;
+  }
+
+  // The slot is taken first, a request shed by the concurrency limit must
+  // not use up a token of the client.
+  auto& admission = *context_->admission;
+  if (!admission.try_acquire()) {
+    reject_request(http::status::service_unavailable, admission.config().retry_after,
+      reject_reason::concurrency);
+    return false;
+  }
+
+  if (route_ == route_id::add_comment) {
+    auto wait = admission.take_make_token(rate_limit_client());
+    if (wait.count() > 0) {
+      admission.cancel();
+      reject_request(http::status::too_many_requests, wait, reject_reason::rate);
+      return false;
+    }
+  }
+  admitted_ = true;
+  return true;
+}
+
+void http_connection::reject_request(http::status status, std::chrono::milliseconds retry_after,
+  reject_reason reason) {
+  BOOST_LOG_TRIVIAL(debug) 
+    << "Request rejected by admission control: " << static_cast<unsigned>(status);
+
+  context_->admission->count_rejected(reason);
+  response_.result(status);
+  response_.set(http::field::retry_after, std::to_string(retry_after_seconds(retry_after)));
+}
+
+std::string http_connection::rate_limit_client() const {
+  if (context_->admission->config().make_key == rate_limit_key::created_by) {
+    auto created_by = request_.find("Created_by");
+    if (created_by != request_.end()) {
+      return std::string(created_by->value());
+    }
+  }
+
+  beast::error_code ec;
+  auto endpoint = socket_.remote_endpoint(ec);
+  return ec ? std::string() : endpoint.address().to_string();
 }
 
 void http_connection::handle_get_request() {
   if(target_ == "/comments") {
     get_comments();
+  } else if(route_ == route_id::stream_comments) {
+    stream_comments();
+  } else if(target_ == "/metrics") {
+    get_metrics();
+  } else if(target_ == "/admin/log-level") {
+    if(authorize_admin()) {
+      get_log_level();
+    }
   } else {
     BOOST_LOG_TRIVIAL(error) 
       << "Invalid GET request target: " << target_;
@@ -69,6 +295,8 @@ void http_connection::handle_get_request() {
 void http_connection::handle_post_request() {
   if(target_ == "/comments/make") {
     add_comment();
+  } else if(target_ == "/comments/bulk") {
+    bulk_comments();
   } else {
     BOOST_LOG_TRIVIAL(error) 
       << "Invalid POST request target: " << target_;
@@ -81,6 +309,10 @@ void http_connection::handle_patch_request() {
     delete_comment();
   } else if(target_ == "/comments/change") {
     change_comment();
+  } else if(target_ == "/admin/log-level") {
+    if(authorize_admin()) {
+      change_log_level();
+    }
   } else {
     BOOST_LOG_TRIVIAL(error) 
       << "Invalid POST request target: " << target_;
@@ -91,12 +323,28 @@ void http_connection::handle_patch_request() {
 void http_connection::write_response() {
   auto self = shared_from_this();
 
-  response_.content_length(response_.body().size());
+  if (admitted_) {
+    admitted_ = false;
+    context_->admission->release(std::chrono::steady_clock::now() - request_start_);
+  }
 
-  http::async_write(socket_, response_,
-    [self](beast::error_code ec, std::size_t) {
-      self->socket_.shutdown(tcp::socket::shutdown_send, ec);
-      self->deadline_.cancel();
+  response_.content_length(response_.body().size());
+  auto write_start = std::chrono::steady_clock::now();
+
+  serializer_.emplace(response_);
+  http::async_write(socket_, *serializer_,
+    [self, write_start](beast::error_code ec, std::size_t) {
+      auto now = std::chrono::steady_clock::now();
+      self->record_phase(phase_id::write, write_start, now - write_start);
+      self->record_phase(phase_id::request, self->request_start_, now - self->request_start_);
+      count_response(self->route_, self->response_.result_int());
+      self->end_request();
+
+      if(!ec && self->response_.keep_alive()) {
+        self->read_request();
+      } else {
+        self->close();
+      }
   });
 }
 
@@ -104,313 +352,658 @@ void http_connection::check_deadline() {
   auto self = shared_from_this();
 
   deadline_.async_wait([self](beast::error_code ec) {
-    if(!ec) {
-      self->socket_.close(ec);
+    boost::ignore_unused(ec);
+    if(!self->socket_.is_open()) {
+      return;
+    }
+    if(self->deadline_.expiry() <= net::steady_timer::clock_type::now()) {
+      self->close();
+    } else {
+      self->check_deadline();
     }
   });
 }
 
-void http_connection::get_comments() {
-  auto entity = std::string(request_.find("Entity")->value());
-  auto page = std::stoll(request_.find("Pagination-Page")->value());
-  auto per_page = std::stoi(request_.find("Pagination-Per-Page")->value());
-
-  page = std::max(page, 1LL);
-  per_page = std::clamp(per_page, 1, 100);
-
-  request_un_map_["entity"] = entity;
-  request_un_map_["pagination-page"] = page;
-  request_un_map_["pagination-per-page"] = per_page;
-
-  response_.set("Pagination-Current-Page", std::to_string(page));
-  response_.set("Pagination-Per-Page", std::to_string(per_page));
-
-  BOOST_LOG_TRIVIAL(info) 
-    << "Fetching comments for entity: " << entity
-    << ", Page: " << page 
-    << ", Per Page: " << per_page;
+void http_connection::close() {
+  beast::error_code ec;
+  socket_.shutdown(tcp::socket::shutdown_send, ec);
+  socket_.close(ec);
+  deadline_.cancel();
+}
 
-  const char* query =
-    "SELECT entity, created_time, comment_id, author, created_by, text, updated_time "
-    "FROM keyspace_comments.comments "
-    "WHERE entity = ? AND deleted = false";
+void http_connection::get_comments() {
+  auto params = parse_get_comments_params(request_);
+
+  response_.set("Pagination-Current-Page", std::to_string(params.page));
+  response_.set("Pagination-Per-Page", std::to_string(params.per_page));
+
+  BOOST_LOG_TRIVIAL(debug) 
+    << "Fetching comments for entity: " << params.entity
+    << ", Page: " << params.page 
+    << ", Per Page: " << params.per_page;
+
+  page_request request;
+  request.entity = params.entity;
+  request.per_page = static_cast<size_t>(params.per_page);
+  request.cursor = params.cursor;
+  request.has_keyset = params.has_keyset;
+  request.after_created_time = params.after_created_time;
+  request.after_comment_id = params.after_comment_id;
+
+  // A cursor or a keyset continues right after the previous page, only the
+  // page number fallback has to skip the comments of the previous pages.
+  long long cache_page = 0;
+  std::uint64_t cache_generation = 0;
+  if (params.cursor.empty() && !params.has_keyset) {
+    request.to_skip = request.per_page * static_cast<size_t>(params.page - 1);
+
+    auto& cache = *context_->cache;
+    if (cache.cacheable(params.page, request.per_page)) {
+      if (auto cached = cache.find(params.entity, params.page, request.per_page)) {
+        write_comments_page(*cached, request.per_page);
+        return;
+      }
+      cache_page = params.page;
+      cache_generation = cache.generation(params.entity);
+    }
+  }
 
-  auto statement = std::unique_ptr<CassStatement, 
-    decltype(&cass_statement_free)>(cass_statement_new(query, 1), &cass_statement_free);
-  cass_statement_bind_string(statement.get(), 0, entity.c_str());
+  // Only a cache miss allocates the state of the store operations.
+  auto comments = std::make_shared<comments_page>();
+  comments->per_page = request.per_page;
+  comments->entity = params.entity;
+  comments->cache_page = cache_page;
+  comments->cache_generation = cache_generation;
 
-  connect(statement.get());
+  auto self = shared_from_this();
+  auto execute_start = std::chrono::steady_clock::now();
+
+  context_->store->list_page(request, socket_.get_executor(),
+    [self, comments, execute_start](store_status status, page_result result) {
+      log_request_scope log_scope(self->request_id_);
+      auto now = std::chrono::steady_clock::now();
+      self->record_phase(phase_id::db_execute, execute_start,
+        now - execute_start - result.serialization);
+      self->record_phase(phase_id::serialization, now - result.serialization,
+        result.serialization);
+      if (self->check_store_status(status)) {
+        comments->result = std::move(result);
+      } else {
+        comments->failed = true;
+      }
+      self->finish_comments_page(comments);
+    });
+  awaiting_db_ = true;
+  comments->pending = 2;
+
+  context_->store->count(params.entity, socket_.get_executor(),
+    [self, comments, execute_start](store_status status, long long total_rows) {
+      log_request_scope log_scope(self->request_id_);
+      self->record_phase(phase_id::db_execute, execute_start,
+        std::chrono::steady_clock::now() - execute_start);
+      if (self->check_store_status(status)) {
+        comments->total_rows = total_rows;
+      } else {
+        comments->failed = true;
+      }
+      self->finish_comments_page(comments);
+    });
 }
 
 void http_connection::add_comment() {
-  auto json_body = get_request_json_body();
+  auto params = parse_new_comment_params(request_);
+  auto text = get_request_text();
+
+  BOOST_LOG_TRIVIAL(debug) 
+    << "Adding new comment for entity: " << params.entity;
+
+  // The id and the creation time are generated here, so the response can
+  // carry the comment without a read-back.
+  auto comment_id = context_->store->new_comment_id();
+  auto created_time = static_cast<cass_int64_t>(cass_uuid_timestamp(comment_id));
+
+  comment_fields comment;
+  comment.entity = params.entity;
+  comment.comment_id = comment_id;
+  comment.author = params.author;
+  comment.created_by = params.created_by;
+  comment.text = text;
+  comment.created_time = created_time;
+  comment.updated_time = created_time;
+  append_comment(response_.body(), comment);
+
+  if (context_->hub->has_subscribers(params.entity)) {
+    event_.append("event: add\ndata: ").append(response_.body()).append("\n\n");
+  }
 
-  auto text = json_body.value("text", "");
-  auto author = std::string(request_.find("Author")->value());
-  auto entity = std::string(request_.find("Entity")->value());
-  auto created_by = std::stoll(request_.find("Created_by")->value());
+  context_->store->insert(comment, socket_.get_executor(), 
+    mutation_handler(params.entity, http::status::created));
+  awaiting_db_ = true;
+}
 
-  request_un_map_["entity"] = entity;
+void http_connection::delete_comment() {
+  auto key = parse_comment_key(request_);
+
+  BOOST_LOG_TRIVIAL(debug) 
+    << "Deleting comment with ID: " << key.comment_id_text 
+    << " for entity: " << key.entity;
+
+  if (context_->hub->has_subscribers(key.entity)) {
+    event_.append("event: delete\ndata: {\"comment_id\":");
+    append_json_string(event_, key.comment_id_text);
+    event_.append(",\"created_time\":");
+    append_json_number(event_, key.created_time);
+    event_.append(",\"entity\":");
+    append_json_string(event_, key.entity);
+    event_.append("}\n\n");
+  }
 
-  BOOST_LOG_TRIVIAL(info) 
-    << "Adding new comment for entity: " << entity;
+  context_->store->soft_delete(key, socket_.get_executor(), 
+    mutation_handler(key.entity, http::status::ok));
+  awaiting_db_ = true;
+}
 
-  const char* query =
-    "INSERT INTO keyspace_comments.comments (comment_id, entity, author, "
-    "text, deleted, created_by, created_time, updated_time) "
-    "VALUES (uuid(), ?, ?, "
-    "?, false, ?, toUnixTimestamp(now()), toUnixTimestamp(now()))";
+void http_connection::change_comment() {
+  auto key = parse_comment_key(request_);
+  auto text = get_request_text();
+
+  BOOST_LOG_TRIVIAL(debug) 
+    << "Changing comment with ID: " << key.comment_id_text 
+    << " for entity: " << key.entity;
+
+  if (context_->hub->has_subscribers(key.entity)) {
+    event_.append("event: change\ndata: {\"comment_id\":");
+    append_json_string(event_, key.comment_id_text);
+    event_.append(",\"created_time\":");
+    append_json_number(event_, key.created_time);
+    event_.append(",\"entity\":");
+    append_json_string(event_, key.entity);
+    event_.append(",\"text\":");
+    append_json_string(event_, text);
+    event_.append("}\n\n");
+  }
 
-  auto statement = std::unique_ptr<CassStatement, 
-    decltype(&cass_statement_free)>(cass_statement_new(query, 4), &cass_statement_free);
-  cass_statement_bind_string(statement.get(), 0, entity.c_str());
-  cass_statement_bind_string(statement.get(), 1, author.c_str());
-  cass_statement_bind_string(statement.get(), 2, text.c_str());
-  cass_statement_bind_int64(statement.get(), 3, created_by);
+  context_->store->update_text(key, text, socket_.get_executor(), 
+    mutation_handler(key.entity, http::status::ok));
+  awaiting_db_ = true;
+}
 
-  connect(statement.get());
+comment_store::write_handler http_connection::mutation_handler(std::string_view entity, 
+  http::status success) {
+  return [self = shared_from_this(), entity, success, 
+    execute_start = std::chrono::steady_clock::now()](store_status status) {
+    log_request_scope log_scope(self->request_id_);
+    self->record_phase(phase_id::db_execute, execute_start,
+      std::chrono::steady_clock::now() - execute_start);
+    self->finish_mutation(status, entity, success);
+  };
 }
 
-void http_connection::delete_comment() {
-  auto entity = std::string(request_.find("Entity")->value());
-  auto comment_id = std::string(request_.find("Comment_id")->value());
-  auto created_time = std::stoll(request_.find("Created_time")->value());
+void http_connection::finish_mutation(store_status status, std::string_view entity, 
+  http::status success) {
+  if (check_store_status(status)) {
+    response_.result(success);
+    context_->cache->invalidate(entity);
+    if (!event_.empty()) {
+      context_->hub->publish(entity, std::make_shared<const std::string>(std::move(event_)));
+      event_.clear();
+    }
+  } else {
+    response_.body().clear();
+  }
+  write_response();
+}
 
-  request_un_map_["comment_id"] = comment_id;
-  request_un_map_["created_time"] = created_time;
-  request_un_map_["entity"] = entity;
+bool http_connection::check_store_status(store_status status) {
+  switch (status) {
+    case store_status::ok:
+      return true;
+    case store_status::not_found:
+      BOOST_LOG_TRIVIAL(error) 
+        << "Comment does not exists";
+      response_.result(http::status::not_found);
+      return false;
+    case store_status::deleted:
+      BOOST_LOG_TRIVIAL(error) 
+        << "Comment is deleted";
+      response_.result(http::status::conflict);
+      return false;
+    default:
+      response_.result(http::status::bad_request);
+      return false;
+  }
+}
 
-  BOOST_LOG_TRIVIAL(info) 
-    << "Deleting comment with ID: " << comment_id 
-    << " for entity: " << entity;
+void http_connection::finish_comments_page(std::shared_ptr<comments_page> page) {
+  if (--page->pending > 0) {
+    return;
+  }
 
-  const char* query =
-    "UPDATE keyspace_comments.comments SET deleted = true "
-    "WHERE entity = ? AND comment_id = ? AND created_time = ?";
+  if (page->failed) {
+    response_.body().clear();
+  } else {
+    response_.body() = std::move(page->result.comments);
 
-  CassUuid uuid_comment_id;
-  cass_uuid_from_string(comment_id.c_str(), &uuid_comment_id);
+    cached_page result;
+    result.total_rows = page->total_rows;
+    result.next_cursor = std::move(page->result.next_cursor);
+    write_comments_page(result, page->per_page);
 
-  auto statement = std::unique_ptr<CassStatement, 
-    decltype(&cass_statement_free)>(cass_statement_new(query, 3), &cass_statement_free);
-  cass_statement_bind_string(statement.get(), 0, entity.c_str());
-  cass_statement_bind_uuid(statement.get(), 1, uuid_comment_id);
-  cass_statement_bind_int64(statement.get(), 2, created_time);
+    if (page->cache_page > 0) {
+      result.body = response_.body();
+      context_->cache->insert(page->entity, page->cache_page, page->per_page,
+        page->cache_generation, std::make_shared<const cached_page>(std::move(result)));
+    }
+  }
 
-  connect(statement.get());
+  write_response();
 }
 
-void http_connection::change_comment() {
-  auto json_body = get_request_json_body();
-
-  auto text = json_body.value("text", "");
-  auto entity = std::string(request_.find("Entity")->value());
-  auto comment_id = std::string(request_.find("Comment_id")->value());
-  auto created_time = std::stoll(request_.find("Created_time")->value());
-
-  request_un_map_["comment_id"] = comment_id;
-  request_un_map_["entity"] = entity;
-  request_un_map_["created_time"] = created_time;
-
-  BOOST_LOG_TRIVIAL(info) 
-    << "Changing comment with ID: " << comment_id 
-    << " for entity: " << entity;
-
-  const char* query =
-    "UPDATE keyspace_comments.comments SET text = ?, "
-    "updated_time = toUnixTimestamp(now()) WHERE entity = ? "
-    "AND comment_id = ? AND created_time = ?";
-
-  CassUuid uuid_comment_id;
-  cass_uuid_from_string(comment_id.c_str(), &uuid_comment_id);
-  
-  auto statement = std::unique_ptr<CassStatement, 
-    decltype(&cass_statement_free)>(cass_statement_new(query, 4), &cass_statement_free);
-  cass_statement_bind_string(statement.get(), 0, text.c_str());
-  cass_statement_bind_string(statement.get(), 1, entity.c_str());
-  cass_statement_bind_uuid(statement.get(), 2, uuid_comment_id);
-  cass_statement_bind_int64(statement.get(), 3, created_time);
-
-  connect(statement.get());
-}
-
-void http_connection::connect(CassStatement* statement) {
-  auto cluster = std::unique_ptr<CassCluster, 
-    decltype(&cass_cluster_free)>(cass_cluster_new(), &cass_cluster_free);
-  cass_cluster_set_contact_points(cluster.get(), hosts_);
-  auto connect_future = std::unique_ptr<CassFuture, 
-    decltype(&cass_future_free)>(cass_session_connect(
-      session_.get(), cluster.get()), &cass_future_free);
-
-  if (cass_future_error_code(connect_future.get()) == CASS_OK) {
-    execute_query(statement);
-  } else {
-    const char* message;
-    size_t message_length;
-    cass_future_error_message(connect_future.get(), &message, &message_length);
-    BOOST_LOG_TRIVIAL(error) 
-      << "Unable to connect to db: " << std::string(message, message_length);
-    response_.result(http::status::bad_request);
+void http_connection::write_comments_page(const cached_page& page, size_t per_page) {
+  auto total_page_count = static_cast<long long>(
+    std::ceil(static_cast<double>(page.total_rows) / per_page));
+  response_.set("Pagination-Total-Pages", std::to_string(total_page_count));
+  response_.set("Pagination-Total-Comments", std::to_string(page.total_rows));
+  if (!page.next_cursor.empty()) {
+    response_.set("Pagination-Next-Cursor", page.next_cursor);
+  }
+  if (!page.body.empty()) {
+    response_.body() = page.body;
   }
-
 }
 
-void http_connection::execute_query(CassStatement* statement) {
-  bool executes = true;
+void http_connection::bulk_comments() {
+  auto params = parse_bulk_params(get_request_json_body(), settings_->bulk.max_entities);
+
+  BOOST_LOG_TRIVIAL(debug) 
+    << "Fetching comments of " << params.entities.size() 
+    << " entities, Limit: " << params.limit;
+
+  auto bulk = std::make_shared<bulk_request>(socket_.get_executor());
+  bulk->limit = params.limit;
+  bulk->route = route_;
+  bulk->request_id = request_id_;
+  bulk->trace = trace_;
+  bulk->remaining = params.entities.size();
+  bulk->entities.resize(params.entities.size());
+  for (size_t i = 0; i < params.entities.size(); ++i) {
+    bulk->entities[i].entity = std::move(params.entities[i]);
+  }
 
-  if (target_ == "/comments/change" || target_ == "/comments/delete") {
-    executes = is_comment_exists();
-    if (!executes) {
-      BOOST_LOG_TRIVIAL(error) 
-        << "Comment does not exists";
-      response_.result(http::status::bad_request);
+  awaiting_db_ = true;
+  auto self = shared_from_this();
+  bulk->deadline.expires_after(settings_->bulk.deadline);
+  bulk->deadline.async_wait([self, bulk](beast::error_code ec) {
+    if (ec || bulk->finished) {
+      return;
     }
+    log_request_scope log_scope(bulk->request_id);
+    BOOST_LOG_TRIVIAL(warning) 
+      << "Bulk request timed out with " << bulk->remaining << " entities not fetched";
+    self->write_bulk_response(bulk);
+  });
+
+  auto concurrency = std::min(settings_->bulk.concurrency, bulk->entities.size());
+  for (size_t i = 0; i < concurrency && !bulk->finished; ++i) {
+    start_bulk_entity(bulk);
   }
+}
 
-  if (executes) {
-    CassFuture* result_future = cass_session_execute(session_.get(), statement);
-    if (cass_future_error_code(result_future) == CASS_OK) {
-      if (target_ == "/comments") {
-        handle_query_result(result_future);
+void http_connection::start_bulk_entity(std::shared_ptr<bulk_request> bulk) {
+  auto& cache = *context_->cache;
+
+  // Cached entities complete right away, keep going until an operation is started.
+  while (bulk->next < bulk->entities.size()) {
+    auto index = bulk->next++;
+    auto& item = bulk->entities[index];
+
+    if (cache.cacheable(1, bulk->limit)) {
+      if (auto cached = cache.find(item.entity, 1, bulk->limit)) {
+        item.comments = cached->body;
+        item.total_rows = cached->total_rows;
+        item.done = true;
+        if (--bulk->remaining == 0) {
+          write_bulk_response(bulk);
+          return;
+        }
+        continue;
       }
-    } else {
-      const char* message;
-      size_t message_length;
-      cass_future_error_message(result_future, &message, &message_length);
-      BOOST_LOG_TRIVIAL(error) 
-        << "Unable to run query: " << std::string(message, message_length);
-      response_.result(http::status::bad_request);
+      item.cacheable = true;
+      item.cache_generation = cache.generation(item.entity);
     }
 
-    cass_future_free(result_future);
+    item.pending = 1;
+    if (bulk->limit == 0) {
+      item.comments = "[]";
+    } else {
+      ++item.pending;
+      fetch_bulk_page(bulk, index);
+    }
+    count_bulk_entity(bulk, index);
+    return;
   }
 }
 
-bool http_connection::is_comment_exists() {
-  CassUuid uuid_comment_id;
-  cass_uuid_from_string((std::any_cast<std::string>(
-    request_un_map_["comment_id"])).c_str(), &uuid_comment_id);
-
-  const char* check_query = 
-    "SELECT * FROM keyspace_comments.comments "
-    "WHERE entity = ? AND comment_id = ? AND created_time = ? AND deleted = false";
-
-  auto check_statement = std::unique_ptr<CassStatement, 
-    decltype(&cass_statement_free)>(cass_statement_new(check_query, 3), &cass_statement_free);
+void http_connection::fetch_bulk_page(std::shared_ptr<bulk_request> bulk, size_t index) {
+  auto self = shared_from_this();
 
-  cass_statement_bind_string(check_statement.get(), 0, 
-    (std::any_cast<std::string>(request_un_map_["entity"])).c_str());
-  cass_statement_bind_uuid(check_statement.get(), 1, uuid_comment_id);
-  cass_statement_bind_int64(check_statement.get(), 2, 
-    std::any_cast<long long>(request_un_map_["created_time"]));
+  page_request request;
+  request.entity = bulk->entities[index].entity;
+  request.per_page = bulk->limit;
+
+  auto execute_start = std::chrono::steady_clock::now();
+
+  context_->store->list_page(request, socket_.get_executor(),
+    [self, bulk, index, execute_start](store_status status, page_result result) {
+      // The connection may already serve the next request, only the state
+      // captured with the bulk request belongs to this one.
+      auto now = std::chrono::steady_clock::now();
+      record_phase(bulk->route, bulk->trace, phase_id::db_execute, execute_start,
+        now - execute_start - result.serialization);
+      record_phase(bulk->route, bulk->trace, phase_id::serialization,
+        now - result.serialization, result.serialization);
+      if (bulk->finished) {
+        return;
+      }
 
-  auto check_result_future = std::unique_ptr<CassFuture, 
-    decltype(&cass_future_free)>(cass_session_execute(
-    session_.get(), check_statement.get()), &cass_future_free);
+      log_request_scope log_scope(bulk->request_id);
+      trace_scope trace(bulk->trace);
+      auto& item = bulk->entities[index];
+      if (status == store_status::ok) {
+        item.comments = std::move(result.comments);
+        item.next_cursor = std::move(result.next_cursor);
+      } else {
+        item.failed = true;
+      }
+      self->finish_bulk_query(bulk, index);
+    });
+}
 
-  const CassResult* check_result = cass_future_get_result(check_result_future.get());
-  auto count_rows = cass_result_row_count(check_result);
-  
-  cass_result_free(check_result);
+void http_connection::count_bulk_entity(std::shared_ptr<bulk_request> bulk, size_t index) {
+  auto self = shared_from_this();
+  auto execute_start = std::chrono::steady_clock::now();
+
+  context_->store->count(bulk->entities[index].entity, socket_.get_executor(),
+    [self, bulk, index, execute_start](store_status status, long long total_rows) {
+      record_phase(bulk->route, bulk->trace, phase_id::db_execute, execute_start,
+        std::chrono::steady_clock::now() - execute_start);
+      if (bulk->finished) {
+        return;
+      }
 
-  return count_rows == 1;
+      log_request_scope log_scope(bulk->request_id);
+      trace_scope trace(bulk->trace);
+      auto& item = bulk->entities[index];
+      if (status == store_status::ok) {
+        item.total_rows = total_rows;
+      } else {
+        item.failed = true;
+      }
+      self->finish_bulk_query(bulk, index);
+    });
 }
 
-void http_connection::handle_query_result(CassFuture* result_future) {
-  const CassResult* result = cass_future_get_result(result_future);
-  auto rows = std::unique_ptr<CassIterator, 
-    decltype(&cass_iterator_free)>(cass_iterator_from_result(result), &cass_iterator_free);
-  nlohmann::json json_array = nlohmann::json::array();
-  size_t total_rows = cass_result_row_count(result);
+void http_connection::finish_bulk_query(std::shared_ptr<bulk_request> bulk, size_t index) {
+  auto& item = bulk->entities[index];
+  if (--item.pending > 0) {
+    return;
+  }
 
-  long long page = std::any_cast<long long>(request_un_map_["pagination-page"]);
-  int per_page = std::any_cast<int>(request_un_map_["pagination-per-page"]);
+  item.done = true;
+  if (item.cacheable && !item.failed) {
+    cached_page page;
+    page.body = item.comments;
+    page.total_rows = item.total_rows;
+    page.next_cursor = item.next_cursor;
+    context_->cache->insert(item.entity, 1, bulk->limit, item.cache_generation,
+      std::make_shared<const cached_page>(std::move(page)));
+  }
 
-  size_t start_row = per_page * (page - 1);
-  size_t end_row = per_page * page;
+  if (--bulk->remaining == 0) {
+    write_bulk_response(bulk);
+  } else {
+    start_bulk_entity(bulk);
+  }
+}
 
-  for (size_t i = 0; cass_iterator_next(rows.get()) && i < end_row; ++i) {
-    if (i >= start_row) {
-      json_array.push_back(get_json_row(result, rows.get()));
+void http_connection::write_bulk_response(std::shared_ptr<bulk_request> bulk) {
+  bulk->finished = true;
+  bulk->deadline.cancel();
+
+  // Entities are written in request order, failed and timed out entities
+  // carry an error instead of failing the whole response.
+  auto& body = response_.body();
+  body.reserve(bulk->entities.size() * (bulk->limit * 256 + 64));
+  body.push_back('{');
+  for (const auto& item : bulk->entities) {
+    if (body.size() > 1) {
+      body.push_back(',');
+    }
+    append_json_string(body, item.entity);
+    if (!item.done) {
+      body.append(":{\"error\":\"timeout\"}");
+    } else if (item.failed) {
+      body.append(":{\"error\":\"db\"}");
+    } else {
+      body.append(":{\"comments\":");
+      body.append(item.comments);
+      body.append(",\"total\":");
+      append_json_number(body, item.total_rows);
+      body.push_back('}');
     }
   }
+  body.push_back('}');
 
-  auto total_page_count = 
-    static_cast<long long>(std::ceil(static_cast<double>(total_rows) / per_page));
-  response_.set("Pagination-Total-Pages", std::to_string(total_page_count));
-  response_.set("Pagination-Total-Comments", std::to_string(total_rows));
-
-  cass_result_free(result);
-  beast::ostream(response_.body()) << json_array;
+  write_response();
 }
 
-nlohmann::json http_connection::get_json_row(const CassResult* result, 
-  CassIterator* rows) const {
-  size_t column_count = cass_result_column_count(result);
-  const CassRow* row = cass_iterator_get_row(rows);
-  nlohmann::json json_row;
+void http_connection::stream_comments() {
+  auto entity = parse_stream_entity(
+    std::string_view(target_.data(), target_.size()), request_);
 
-  for (size_t i = 0; i < column_count; ++i) {
-    const char* column_name;
-    size_t column_name_length;
-    cass_result_column_name(result, i, &column_name, &column_name_length);
-    std::string col_name(column_name, column_name_length);
+  BOOST_LOG_TRIVIAL(debug) 
+    << "Streaming comments of entity: " << entity;
 
-    const CassValue* column = cass_row_get_column(row, i);
+  // The stream owns the socket from now on, this connection ends with the request.
+  auto stream = std::make_shared<comment_stream>(std::move(socket_), context_->hub, 
+    std::move(entity), settings_->stream);
+  deadline_.cancel();
+  detached_ = true;
+  count_response(route_, static_cast<unsigned>(http::status::ok));
+  stream->start(request_id_);
+}
 
-    CassValueType type = cass_value_type(column);
+void http_connection::get_metrics() {
+  response_.set(http::field::content_type, "text/plain; version=0.0.4");
+  auto& body = response_.body();
+  body.reserve(64 * 1024);
+
+  append_service_metrics(body);
+
+  const auto& cache = *context_->cache;
+  append_metric_header(body, "comments_cache_requests_total", "counter",
+    "Lookups of the GET /comments response cache");
+  append_metric_value(body, "comments_cache_requests_total", "result=\"hit\"", 
+    static_cast<double>(cache.hits()));
+  append_metric_value(body, "comments_cache_requests_total", "result=\"miss\"", 
+    static_cast<double>(cache.misses()));
+  append_metric_header(body, "comments_cache_evictions_total", "counter",
+    "Entities evicted from the response cache");
+  append_metric_value(body, "comments_cache_evictions_total", "", 
+    static_cast<double>(cache.evictions()));
+
+  append_metric_header(body, "comments_stream_subscribers", "gauge",
+    "Open GET /comments/stream connections");
+  append_metric_value(body, "comments_stream_subscribers", "", 
+    static_cast<double>(context_->hub->subscribers()));
+  append_metric_header(body, "comments_stream_evictions_total", "counter",
+    "Stream subscribers closed because they could not keep up");
+  append_metric_value(body, "comments_stream_evictions_total", "", 
+    static_cast<double>(context_->hub->evictions()));
+
+  context_->admission->append_metrics(body);
+
+  append_metric_header(body, "comments_log_dropped_records_total", "counter",
+    "Log records dropped because a sink queue was full");
+  append_metric_value(body, "comments_log_dropped_records_total", "", 
+    static_cast<double>(log_dropped_records()));
+
+  if (context_->tracing) {
+    append_metric_header(body, "comments_trace_spans_total", "counter",
+      "Spans of traced requests recorded for the trace file");
+    append_metric_value(body, "comments_trace_spans_total", "", 
+      static_cast<double>(context_->tracing->spans()));
+    append_metric_header(body, "comments_trace_dropped_spans_total", "counter",
+      "Spans dropped because the trace file could not keep up");
+    append_metric_value(body, "comments_trace_dropped_spans_total", "", 
+      static_cast<double>(context_->tracing->dropped_spans()));
+  }
 
-    switch (type) {
-      case CASS_VALUE_TYPE_UUID: {
-        CassUuid uuid;
-        char uuid_str[CASS_UUID_STRING_LENGTH];
-        cass_value_get_uuid(column, &uuid);
-        cass_uuid_string(uuid, uuid_str);
-        json_row[col_name] = uuid_str;
-        break;
-      }
-      case CASS_VALUE_TYPE_BIGINT: {
-        cass_int64_t column_value;
-        cass_value_get_int64(column, &column_value);
-        json_row[col_name] = column_value;
-        break;
-      }
-      case CASS_VALUE_TYPE_BOOLEAN: {
-        cass_bool_t column_value;
-        cass_value_get_bool(column, &column_value);
-        json_row[col_name] = (column_value == cass_true ? true : false);
-        break;
-      }
-      default: {
-        const char* column_value;
-        size_t column_value_length;
-        cass_value_get_string(column, &column_value, &column_value_length);
-        std::string col_value(column_value, column_value_length);
-        json_row[col_name] = col_value;
-        break;
-      }
-    }
+  context_->store->append_metrics(body);
+}
+
+bool http_connection::authorize_admin() {
+  const auto& token = settings_->http.admin_token;
+  auto header = request_.find("Admin-Token");
+  std::string_view given;
+  if (header != request_.end()) {
+    given = std::string_view(header->value().data(), header->value().size());
+  }
+
+  // Every byte is compared, the time does not tell how much of the token matched.
+  bool authorized = !token.empty() && given.size() == token.size();
+  unsigned char difference = 0;
+  for (std::size_t i = 0; authorized && i < token.size(); ++i) {
+    difference |= static_cast<unsigned char>(token[i] ^ given[i]);
   }
+  if (!authorized || difference != 0) {
+    BOOST_LOG_TRIVIAL(warning) 
+      << "Admin request without a valid token: " << target_;
+    response_.result(http::status::forbidden);
+    return false;
+  }
+  return true;
+}
 
-  return json_row;
+void http_connection::get_log_level() {
+  auto& body = response_.body();
+  body.append("{\"dropped_records\":");
+  append_json_number(body, static_cast<std::int64_t>(log_dropped_records()));
+  body.append(",\"level\":");
+  append_json_string(body, boost::log::trivial::to_string(log_level()));
+  body.push_back('}');
+}
+
+void http_connection::change_log_level() {
+  auto level = parse_log_level_params(request_);
+  set_log_level(level);
+
+  BOOST_LOG_TRIVIAL(warning) 
+    << "Log level changed to " << boost::log::trivial::to_string(level);
 }
 
 nlohmann::json http_connection::get_request_json_body() const {
-  const auto& body = request_.body();
-  std::stringstream ss;
+  auto parse_start = std::chrono::steady_clock::now();
+  auto json = nlohmann::json::parse(request_.body());
+  record_phase(phase_id::json_parse, parse_start, std::chrono::steady_clock::now() - parse_start);
+  return json;
+}
+
+std::string http_connection::get_request_text() const {
+  auto parse_start = std::chrono::steady_clock::now();
+  auto text = parse_comment_text(request_.body());
+  record_phase(phase_id::json_parse, parse_start, std::chrono::steady_clock::now() - parse_start);
+  return text;
+}
+
+tcp::acceptor make_acceptor(net::io_context& ioc, const tcp::endpoint& endpoint, bool reuse_port) {
+  using reuse_port_option = net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
 
-  for(const auto& buffer : body.data()) {
-    ss << boost::beast::make_printable(buffer);
+  // Accept handlers and the close of a drain are serialized on the strand.
+  tcp::acceptor acceptor{net::make_strand(ioc)};
+  acceptor.open(endpoint.protocol());
+  acceptor.set_option(net::socket_base::reuse_address(true));
+  if(reuse_port) {
+    acceptor.set_option(reuse_port_option(true));
+  }
+  acceptor.bind(endpoint);
+  acceptor.listen(net::socket_base::max_listen_connections);
+  return acceptor;
+}
+
+tcp::acceptor adopt_acceptor(net::io_context& ioc, int fd) {
+  sockaddr_storage address{};
+  socklen_t length = sizeof(address);
+  if(::getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+    throw std::runtime_error("Inherited socket " + std::to_string(fd) + " is not a socket");
   }
 
-  return nlohmann::json::parse(ss);
+  // Every acceptor owns its descriptor, the inherited one stays open for the others.
+  int own_fd = ::dup(fd);
+  if(own_fd < 0) {
+    throw std::runtime_error("Unable to duplicate inherited socket " + std::to_string(fd));
+  }
+  tcp::acceptor acceptor{net::make_strand(ioc)};
+  acceptor.assign(address.ss_family == AF_INET6 ? tcp::v6() : tcp::v4(), own_fd);
+  return acceptor;
 }
 
-void http_server(tcp::acceptor& acceptor, tcp::socket& socket) {
-  acceptor.async_accept(socket, [&](beast::error_code ec) {
-    if(!ec) {
-      std::make_shared<http_connection>(std::move(socket))->start();
-      http_server(acceptor, socket);
-    }
-  });
-}
\ No newline at end of file
+int inherited_listen_fd() {
+  const char* fds = std::getenv("LISTEN_FDS");
+  const char* pid = std::getenv("LISTEN_PID");
+  if(fds == nullptr || std::atoi(fds) < 1) {
+    return -1;
+  }
+  // Only the process the sockets were passed to may use them, not its children.
+  if(pid != nullptr && std::atol(pid) != static_cast<long>(::getpid())) {
+    return -1;
+  }
+  return 3;
+}
+
+namespace {
+
+/**
+ * @brief Answers a connection over the connection limit with 503 Service
+ * Unavailable and closes it without reading the request.
+ * @param socket Socket
+ * @param retry_after Retry-After of the response
+ */
+void reject_connection(connection_socket socket, std::chrono::seconds retry_after) {
+  auto rejected = std::make_shared<connection_socket>(std::move(socket));
+  auto response = std::make_shared<std::string>(
+    "HTTP/1.1 503 Service Unavailable\r\nServer: presetshare.comments\r\nRetry-After: " +
+    std::to_string(std::max<long long>(1, retry_after.count())) +
+    "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+
+  net::async_write(*rejected, net::buffer(*response),
+    [rejected, response](beast::error_code, std::size_t) {
+      beast::error_code ec;
+      rejected->shutdown(tcp::socket::shutdown_send, ec);
+      rejected->close(ec);
+    });
+}
+
+} // namespace
+
+void http_server(tcp::acceptor& acceptor, std::shared_ptr<service_context> context) {
+  // Acceptors are opened on an io_context, see make_acceptor.
+  auto& ioc = static_cast<net::io_context&>(
+    net::query(acceptor.get_executor(), net::execution::context));
+  acceptor.async_accept(net::make_strand(ioc), 
+    [&acceptor, context](beast::error_code ec, connection_socket socket) {
+      if(!ec && context->admission->try_open_connection()) {
+        std::allocate_shared<http_connection>(pooled_allocator<http_connection>(), 
+          std::move(socket), context)->start();
+      } else if(!ec) {
+        context->admission->count_rejected(reject_reason::connections);
+        reject_connection(std::move(socket), context->admission->config().retry_after);
+      } else if(ec != net::error::operation_aborted) {
+        BOOST_LOG_TRIVIAL(error) 
+          << "Unable to accept connection: " << ec.message();
+      }
+      if(acceptor.is_open()) {
+        http_server(acceptor, context);
+      }
+    });
+}
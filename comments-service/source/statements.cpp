@@ -0,0 +1,251 @@
+#include "statements.hpp"
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+/**
+ * @brief CQL text and number of bound values of a query.
+ */
+struct query_definition {
+  const char* text;
+  std::size_t parameter_count;
+  //! True when the query uses the comments_live table
+  bool live;
+};
+
+//! Queries indexed by query_id
+constexpr std::array<query_definition, static_cast<std::size_t>(query_id::count)> queries = {{
+  {"SELECT entity, created_time, comment_id, author, created_by, text, updated_time "
+   "FROM keyspace_comments.comments "
+   "WHERE entity = ? AND deleted = false", 1, false},
+  {"SELECT entity, created_time, comment_id, author, created_by, text, updated_time "
+   "FROM keyspace_comments.comments "
+   "WHERE entity = ? AND created_time < ? AND deleted = false "
+   "ALLOW FILTERING", 2, false},
+  {"SELECT entity, created_time, comment_id, author, created_by, text, updated_time "
+   "FROM keyspace_comments.comments "
+   "WHERE entity = ? AND created_time = ? AND comment_id > ? AND deleted = false "
+   "ALLOW FILTERING", 3, false},
+  {"SELECT entity, created_time, comment_id, author, created_by, text, updated_time "
+   "FROM keyspace_comments.comments_live "
+   "WHERE entity = ?", 1, true},
+  {"SELECT entity, created_time, comment_id, author, created_by, text, updated_time "
+   "FROM keyspace_comments.comments_live "
+   "WHERE entity = ? AND (created_time, comment_id) < (?, ?)", 3, true},
+  {"SELECT live FROM keyspace_comments.comment_counters "
+   "WHERE entity = ?", 1, false},
+  {"UPDATE keyspace_comments.comment_counters SET live = live + 1 "
+   "WHERE entity = ?", 1, false},
+  {"UPDATE keyspace_comments.comment_counters SET live = live - 1 "
+   "WHERE entity = ?", 1, false},
+  {"UPDATE keyspace_comments.comment_counters SET live = live + ? "
+   "WHERE entity = ?", 2, false},
+  {"INSERT INTO keyspace_comments.comments (comment_id, entity, author, "
+   "text, deleted, created_by, created_time, updated_time) "
+   "VALUES (?, ?, ?, ?, false, ?, ?, ?)", 7, false},
+  {"INSERT INTO keyspace_comments.comments_live (comment_id, entity, author, "
+   "text, created_by, created_time, updated_time) "
+   "VALUES (?, ?, ?, ?, ?, ?, ?)", 7, true},
+  {"UPDATE keyspace_comments.comments SET deleted = true "
+   "WHERE entity = ? AND comment_id = ? AND created_time = ? "
+   "IF deleted = false", 3, false},
+  {"UPDATE keyspace_comments.comments SET deleted = true "
+   "WHERE entity = ? AND comment_id = ? AND created_time = ?", 3, false},
+  {"DELETE FROM keyspace_comments.comments_live "
+   "WHERE entity = ? AND comment_id = ? AND created_time = ? "
+   "IF EXISTS", 3, true},
+  {"DELETE FROM keyspace_comments.comments_live "
+   "WHERE entity = ? AND comment_id = ? AND created_time = ?", 3, true},
+  {"UPDATE keyspace_comments.comments SET text = ?, "
+   "updated_time = toUnixTimestamp(now()) WHERE entity = ? "
+   "AND comment_id = ? AND created_time = ? "
+   "IF deleted = false", 4, false},
+  {"UPDATE keyspace_comments.comments SET text = ?, "
+   "updated_time = toUnixTimestamp(now()) WHERE entity = ? "
+   "AND comment_id = ? AND created_time = ?", 4, false},
+  {"UPDATE keyspace_comments.comments_live SET text = ?, "
+   "updated_time = toUnixTimestamp(now()) WHERE entity = ? "
+   "AND comment_id = ? AND created_time = ? "
+   "IF EXISTS", 4, true},
+  {"UPDATE keyspace_comments.comments_live SET text = ?, "
+   "updated_time = toUnixTimestamp(now()) WHERE entity = ? "
+   "AND comment_id = ? AND created_time = ?", 4, true}
+}};
+
+/**
+ * @brief Returns true for the queries that update the comment counter.
+ * @param id Query identifier
+ */
+bool updates_counter(query_id id) {
+  return id == query_id::increment_comment_count || id == query_id::decrement_comment_count ||
+    id == query_id::add_comment_count;
+}
+
+/**
+ * @brief Preparation started by prepare_async.
+ */
+struct pending_prepare {
+  prepared_statements* registry;
+  query_id id;
+};
+
+} // namespace
+
+query_id page_query(schema_mode mode, bool keyset) {
+  if(mode == schema_mode::v2) {
+    return keyset ? query_id::get_live_comments_after : query_id::get_live_comments;
+  }
+  return keyset ? query_id::get_comments_same_time : query_id::get_comments;
+}
+
+mutation_queries delete_queries(schema_mode mode) {
+  switch(mode) {
+    case schema_mode::v1:
+      return {query_id::delete_comment, query_id::count};
+    case schema_mode::dual:
+      return {query_id::delete_comment, query_id::delete_live_comment_mirror};
+    case schema_mode::v2:
+      return {query_id::delete_live_comment, query_id::delete_comment_mirror};
+  }
+  return {query_id::delete_comment, query_id::count};
+}
+
+mutation_queries change_queries(schema_mode mode) {
+  switch(mode) {
+    case schema_mode::v1:
+      return {query_id::change_comment, query_id::count};
+    case schema_mode::dual:
+      return {query_id::change_comment, query_id::change_live_comment_mirror};
+    case schema_mode::v2:
+      return {query_id::change_live_comment, query_id::change_comment_mirror};
+  }
+  return {query_id::change_comment, query_id::count};
+}
+
+prepared_statements::prepared_statements(CassSession* session) :
+  session_(session) {}
+
+void prepared_statements::prepare_all(schema_mode mode) {
+  for(std::size_t i = 0; i < size_; ++i) {
+    // comments_live does not exist before the migration to v2.
+    if(queries[i].live && mode == schema_mode::v1) {
+      continue;
+    }
+
+    auto prepare_future = std::unique_ptr<CassFuture,
+      decltype(&cass_future_free)>(cass_session_prepare(
+        session_, queries[i].text), &cass_future_free);
+
+    if(cass_future_error_code(prepare_future.get()) != CASS_OK) {
+      const char* message;
+      size_t message_length;
+      cass_future_error_message(prepare_future.get(), &message, &message_length);
+      throw std::runtime_error("Unable to prepare query: " + std::string(queries[i].text)
+        + ": " + std::string(message, message_length));
+    }
+
+    std::lock_guard lock(mutex_);
+    prepared_[i] = prepared_ptr(cass_future_get_prepared(prepare_future.get()),
+      &cass_prepared_free);
+  }
+
+  BOOST_LOG_TRIVIAL(info)
+    << "Prepared queries of the schema mode";
+}
+
+statement_ptr prepared_statements::bind(query_id id) {
+  auto index = static_cast<std::size_t>(id);
+  prepared_ptr prepared;
+  {
+    std::lock_guard lock(mutex_);
+    prepared = prepared_[index];
+  }
+
+  statement_ptr statement(nullptr, &cass_statement_free);
+  if(prepared) {
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    statement.reset(cass_prepared_bind(prepared.get()));
+  } else {
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    prepare_async(id);
+    statement.reset(cass_statement_new(queries[index].text, queries[index].parameter_count));
+  }
+
+  if(updates_counter(id)) {
+    cass_statement_set_is_idempotent(statement.get(), cass_false);
+    cass_statement_set_retry_policy(statement.get(), no_retry_.get());
+  }
+  return statement;
+}
+
+void prepared_statements::invalidate(query_id id) {
+  {
+    std::lock_guard lock(mutex_);
+    prepared_[static_cast<std::size_t>(id)].reset();
+  }
+
+  BOOST_LOG_TRIVIAL(warning)
+    << "Prepared query is invalidated: " << text(id);
+
+  prepare_async(id);
+}
+
+void prepared_statements::handle_error(query_id id, CassError error) {
+  // Other errors, invalid queries included, come from the request or the
+  // cluster and say nothing about the prepared statement.
+  if(error == CASS_ERROR_SERVER_UNPREPARED) {
+    invalidate(id);
+  }
+}
+
+std::uint64_t prepared_statements::hits() const {
+  return hits_.load(std::memory_order_relaxed);
+}
+
+std::uint64_t prepared_statements::misses() const {
+  return misses_.load(std::memory_order_relaxed);
+}
+
+const char* prepared_statements::text(query_id id) {
+  return queries[static_cast<std::size_t>(id)].text;
+}
+
+void prepared_statements::prepare_async(query_id id) {
+  auto index = static_cast<std::size_t>(id);
+  {
+    std::lock_guard lock(mutex_);
+    if(preparing_[index]) {
+      return;
+    }
+    preparing_[index] = true;
+  }
+
+  auto prepare_future = cass_session_prepare(session_, queries[index].text);
+  cass_future_set_callback(prepare_future, &prepared_statements::on_prepared,
+    new pending_prepare{this, id});
+  cass_future_free(prepare_future);
+}
+
+void prepared_statements::on_prepared(CassFuture* future, void* data) {
+  std::unique_ptr<pending_prepare> pending(static_cast<pending_prepare*>(data));
+  auto registry = pending->registry;
+  auto index = static_cast<std::size_t>(pending->id);
+
+  prepared_ptr prepared;
+  if(cass_future_error_code(future) == CASS_OK) {
+    prepared = prepared_ptr(cass_future_get_prepared(future), &cass_prepared_free);
+  } else {
+    const char* message;
+    size_t message_length;
+    cass_future_error_message(future, &message, &message_length);
+    BOOST_LOG_TRIVIAL(error)
+      << "Unable to prepare query: " << std::string(message, message_length);
+  }
+
+  std::lock_guard lock(registry->mutex_);
+  registry->preparing_[index] = false;
+  if(prepared) {
+    registry->prepared_[index] = std::move(prepared);
+  }
+}
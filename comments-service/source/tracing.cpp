@@ -0,0 +1,221 @@
+#include "tracing.hpp"
+#include "json_writer.hpp"
+#include <random>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace {
+
+//! Trace of the requests handled by this thread, null outside of traced requests
+thread_local const std::shared_ptr<request_trace>* current_request_trace = nullptr;
+
+//! Longest trace id taken from a request header
+constexpr std::size_t max_trace_id_length = 64;
+
+} // namespace
+
+tracer::tracer(trace_config config) :
+  config_(std::move(config)),
+  file_(std::fopen(config_.file.c_str(), "w"), &std::fclose),
+  pid_(static_cast<std::int64_t>(::getpid())) {
+  if (!file_) {
+    throw std::runtime_error("Unable to open the trace file " + config_.file);
+  }
+
+  epoch_offset_ = std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::system_clock::now().time_since_epoch() -
+    std::chrono::steady_clock::now().time_since_epoch());
+
+  // The array is closed by the destructor, trace viewers also load a file
+  // whose array was left open by a killed process.
+  buffer_.append("[{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":");
+  append_json_number(buffer_, pid_);
+  buffer_.append(",\"args\":{\"name\":\"comments-service\"}}");
+  writer_ = std::thread([this] { run_writer(); });
+}
+
+tracer::~tracer() {
+  {
+    std::lock_guard lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_one();
+  writer_.join();
+  std::fputs("\n]\n", file_.get());
+}
+
+bool tracer::sample() {
+  if (config_.sample_rate == 0) {
+    return false;
+  }
+  thread_local unsigned requests = 0;
+  return ++requests % config_.sample_rate == 0;
+}
+
+bool tracer::honors_header() const {
+  return config_.honor_header;
+}
+
+std::string tracer::new_trace_id() {
+  static constexpr char digits[] = "0123456789abcdef";
+  thread_local std::mt19937_64 random(std::random_device{}());
+
+  auto value = random();
+  std::string trace_id(16, '0');
+  for (auto& digit : trace_id) {
+    digit = digits[value & 0x0f];
+    value >>= 4;
+  }
+  return trace_id;
+}
+
+bool tracer::valid_trace_id(std::string_view trace_id) {
+  if (trace_id.empty() || trace_id.size() > max_trace_id_length) {
+    return false;
+  }
+  for (char c : trace_id) {
+    bool valid = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+      (c >= 'A' && c <= 'Z') || c == '-' || c == '_';
+    if (!valid) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void tracer::record_span(std::string_view trace_id, std::uint64_t request_id,
+  std::string_view name, std::string_view category, std::chrono::steady_clock::time_point start,
+  std::chrono::steady_clock::duration duration) {
+  std::string event;
+  event.reserve(192);
+  event.append("{\"name\":");
+  append_json_string(event, name);
+  event.append(",\"cat\":");
+  append_json_string(event, category);
+  event.append(",\"ph\":\"X\",\"ts\":");
+  append_json_number(event, to_micros(start));
+  event.append(",\"dur\":");
+  append_json_number(event,
+    std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+  event.append(",\"pid\":");
+  append_json_number(event, pid_);
+  event.append(",\"tid\":");
+  append_json_number(event, static_cast<std::int64_t>(request_id));
+  event.append(",\"args\":{\"trace_id\":");
+  append_json_string(event, trace_id);
+  event.append("}}");
+  append_event(event);
+}
+
+void tracer::record_db_session(std::string_view trace_id, std::uint64_t request_id,
+  std::string_view query, const CassUuid& session_id) {
+  char session[CASS_UUID_STRING_LENGTH];
+  cass_uuid_string(session_id, session);
+
+  std::string event;
+  event.reserve(256);
+  event.append("{\"name\":\"db_trace\",\"cat\":\"db\",\"ph\":\"i\",\"s\":\"t\",\"ts\":");
+  append_json_number(event, to_micros(std::chrono::steady_clock::now()));
+  event.append(",\"pid\":");
+  append_json_number(event, pid_);
+  event.append(",\"tid\":");
+  append_json_number(event, static_cast<std::int64_t>(request_id));
+  event.append(",\"args\":{\"trace_id\":");
+  append_json_string(event, trace_id);
+  event.append(",\"query\":");
+  append_json_string(event, query);
+  event.append(",\"session_id\":");
+  append_json_string(event, session);
+  event.append("}}");
+  append_event(event);
+}
+
+std::uint64_t tracer::spans() const {
+  return spans_.load(std::memory_order_relaxed);
+}
+
+std::uint64_t tracer::dropped_spans() const {
+  return dropped_spans_.load(std::memory_order_relaxed);
+}
+
+void tracer::append_event(const std::string& event) {
+  bool flush = false;
+  {
+    std::lock_guard lock(mutex_);
+    if (buffer_.size() + event.size() > config_.max_buffer_bytes) {
+      dropped_spans_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    buffer_.append(",\n").append(event);
+    flush = buffer_.size() >= config_.flush_bytes;
+  }
+  spans_.fetch_add(1, std::memory_order_relaxed);
+  if (flush) {
+    wake_.notify_one();
+  }
+}
+
+void tracer::run_writer() {
+  std::string batch;
+  std::unique_lock lock(mutex_);
+  while (true) {
+    wake_.wait_for(lock, config_.flush_interval, [this] {
+      return stopping_ || buffer_.size() >= config_.flush_bytes;
+    });
+
+    // The buffer is swapped under the lock and written without it.
+    batch.clear();
+    batch.swap(buffer_);
+    bool stopping = stopping_;
+    lock.unlock();
+    if (!batch.empty()) {
+      std::fwrite(batch.data(), 1, batch.size(), file_.get());
+      std::fflush(file_.get());
+    }
+    if (stopping) {
+      return;
+    }
+    lock.lock();
+  }
+}
+
+std::int64_t tracer::to_micros(std::chrono::steady_clock::time_point time) const {
+  return (std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()) +
+    epoch_offset_).count();
+}
+
+trace_scope::trace_scope(const std::shared_ptr<request_trace>& trace) :
+  previous_(current_request_trace) {
+  current_request_trace = &trace;
+}
+
+trace_scope::~trace_scope() {
+  current_request_trace = previous_;
+}
+
+std::shared_ptr<request_trace> current_trace() {
+  return current_request_trace != nullptr ? *current_request_trace : nullptr;
+}
+
+void trace_statement(CassStatement* statement) {
+  if (current_request_trace != nullptr && *current_request_trace) {
+    cass_statement_set_tracing(statement, cass_true);
+  }
+}
+
+void trace_batch(CassBatch* batch) {
+  if (current_request_trace != nullptr && *current_request_trace) {
+    cass_batch_set_tracing(batch, cass_true);
+  }
+}
+
+void record_db_trace(const std::shared_ptr<request_trace>& trace, std::string_view query,
+  CassFuture* result_future) {
+  if (!trace) {
+    return;
+  }
+  CassUuid session_id;
+  if (cass_future_tracing_id(result_future, &session_id) == CASS_OK) {
+    trace->writer->record_db_session(trace->trace_id, trace->request_id, query, session_id);
+  }
+}
@@ -0,0 +1,162 @@
+#include "admission.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+/**
+ * @brief Throws std::runtime_error when the condition does not hold.
+ * @param condition Checked condition
+ * @param what Description of the failure
+ */
+void check(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error(what);
+  }
+}
+
+/**
+ * @brief Takes slots until the limit is reached, then returns them without
+ * adapting the limit. Returns the number of slots taken.
+ * @param admission Admission control
+ */
+unsigned free_slots(admission_control& admission) {
+  unsigned taken = 0;
+  while (taken < 1000 && admission.try_acquire()) {
+    ++taken;
+  }
+  for (unsigned i = 0; i < taken; ++i) {
+    admission.cancel();
+  }
+  return taken;
+}
+
+/**
+ * @brief A full bucket allows burst comments at once, then one per
+ * 1 / rate seconds, and tells how long to wait for the next token.
+ */
+void test_token_refill() {
+  admission_config config;
+  config.make_rate = 2;
+  config.make_burst = 3;
+  admission_control admission(config);
+
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < 3; ++i) {
+    check(admission.take_make_token("client", start) == 0ms, "burst is not allowed");
+  }
+  check(admission.take_make_token("client", start) == 500ms, "wait of an empty bucket");
+  check(admission.take_make_token("client", start + 250ms) == 250ms,
+    "wait of a half refilled bucket");
+  check(admission.take_make_token("client", start + 500ms) == 0ms, "refilled token is not taken");
+  check(admission.take_make_token("other", start + 500ms) == 0ms,
+    "clients share a bucket");
+
+  // Refills stop at the burst.
+  const auto later = start + 60s;
+  for (int i = 0; i < 3; ++i) {
+    check(admission.take_make_token("client", later) == 0ms, "refilled burst is not allowed");
+  }
+  check(admission.take_make_token("client", later) > 0ms, "bucket refilled over the burst");
+
+  admission_config unlimited;
+  admission_control open(unlimited);
+  for (int i = 0; i < 100; ++i) {
+    check(open.take_make_token("client", start) == 0ms, "rate 0 limits comments");
+  }
+}
+
+/**
+ * @brief Retry-After is the wait rounded up to whole seconds, at least 1.
+ */
+void test_retry_after() {
+  check(retry_after_seconds(0ms) == 1, "Retry-After of no wait");
+  check(retry_after_seconds(1ms) == 1, "Retry-After of 1 ms");
+  check(retry_after_seconds(1000ms) == 1, "Retry-After of 1 s");
+  check(retry_after_seconds(1001ms) == 2, "Retry-After of 1.001 s");
+  check(retry_after_seconds(2500ms) == 3, "Retry-After of 2.5 s");
+}
+
+/**
+ * @brief The adaptive limit shrinks by a tenth on a slow request and grows
+ * back by one per limit fast requests while the slots are in use.
+ */
+void test_adaptive_limit() {
+  admission_config config;
+  config.max_in_flight = 20;
+  config.min_in_flight = 5;
+  config.adaptive = true;
+  config.target_latency = 50ms;
+  admission_control admission(config);
+  check(free_slots(admission) == 20, "initial limit");
+
+  check(admission.try_acquire(), "slot is not taken");
+  admission.release(100ms);
+  check(free_slots(admission) == 18, "slow request does not shrink the limit");
+
+  // A second slow request within the target latency does not shrink it again.
+  check(admission.try_acquire(), "slot is not taken");
+  admission.release(100ms);
+  check(free_slots(admission) == 18, "limit shrinks twice in one target latency");
+
+  // Fast requests of a busy service grow the limit.
+  for (int i = 0; i < 40; ++i) {
+    for (int j = 0; j < 18; ++j) {
+      admission.try_acquire();
+    }
+    for (int j = 0; j < 18; ++j) {
+      admission.release(1ms);
+    }
+  }
+  check(free_slots(admission) == 20, "fast requests do not grow the limit to the maximum");
+
+  // An idle service does not grow it.
+  config.max_in_flight = 30;
+  admission_control idle(config);
+  check(idle.try_acquire(), "slot is not taken");
+  idle.release(100ms);
+  for (int i = 0; i < 100; ++i) {
+    idle.try_acquire();
+    idle.release(1ms);
+  }
+  check(free_slots(idle) == 27, "idle service grows the limit");
+}
+
+/**
+ * @brief The connection cap counts open connections.
+ */
+void test_connections() {
+  admission_config config;
+  config.max_connections = 2;
+  admission_control admission(config);
+  check(admission.try_open_connection() && admission.try_open_connection(), "connection refused");
+  check(!admission.try_open_connection(), "connection over the cap");
+  admission.close_connection();
+  check(admission.try_open_connection(), "closed connection is still counted");
+  check(admission.connections() == 2, "open connections");
+}
+
+} // namespace
+
+/**
+ * @brief Checks the token buckets, Retry-After, the adaptive limit and the
+ * connection cap of admission control.
+ */
+int main() {
+  try {
+    test_token_refill();
+    test_retry_after();
+    test_adaptive_limit();
+    test_connections();
+    std::cout << "admission: ok" << std::endl;
+  }
+  catch (std::exception const& e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,100 @@
+#include "json_writer.hpp"
+#include <nlohmann/json.hpp>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace {
+
+/**
+ * @brief Throws std::runtime_error when the condition does not hold.
+ * @param condition Checked condition
+ * @param what Description of the failure
+ */
+void check(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error(what);
+  }
+}
+
+/**
+ * @brief Checks that the value is written as the expected json string and
+ * that the output parses back.
+ * @param value Written value
+ * @param expected Expected string content between the quotes
+ * @param what Description of the value
+ */
+void check_string(std::string_view value, std::string_view expected, const std::string& what) {
+  std::string out;
+  append_json_string(out, value);
+  check(out == "\"" + std::string(expected) + "\"", what + " is written as " + out);
+  check(nlohmann::json::accept(out), what + " is not valid json");
+}
+
+//! U+FFFD replacement character in UTF-8
+constexpr std::string_view fffd = "\xef\xbf\xbd";
+
+/**
+ * @brief Escapes are written for quotes, backslashes and control characters.
+ */
+void test_escapes() {
+  check_string("", "", "empty string");
+  check_string("plain ascii text longer than a word", "plain ascii text longer than a word",
+    "ascii text");
+  check_string("a\"b\\c\nd\te\x01", "a\\\"b\\\\c\\nd\\te\\u0001", "escaped characters");
+  check_string(std::string_view("nul\0byte", 8), "nul\\u0000byte", "nul byte");
+}
+
+/**
+ * @brief Valid multibyte text is copied unchanged.
+ */
+void test_valid_utf8() {
+  const std::string_view text = "\xc3\xa9t\xc3\xa9 \xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82 "
+    "\xe2\x82\xac \xe4\xb8\xad\xe6\x96\x87 \xf0\x9f\x8e\xb9 \xef\xbf\xbf \xf4\x8f\xbf\xbf";
+  check_string(text, text, "multibyte text");
+  check_string("\xed\x9f\xbf\xee\x80\x80", "\xed\x9f\xbf\xee\x80\x80", "code points around the surrogates");
+  check_string("quote \xc3\xa9\"", "quote \xc3\xa9\\\"", "escape after multibyte text");
+}
+
+/**
+ * @brief Invalid sequences are replaced with one U+FFFD per maximal invalid
+ * prefix, the text around them is kept.
+ */
+void test_invalid_utf8() {
+  const std::string r(fffd);
+  check_string("a\xff" "b", "a" + r + "b", "invalid byte");
+  check_string("\x80\xbf", r + r, "lone continuation bytes");
+  check_string("\xc0\xaf", r + r, "overlong slash");
+  check_string("\xe0\x80\xaf", r + r + r, "overlong three byte slash");
+  check_string("\xf0\x82\x82\xac", r + r + r + r, "overlong four byte euro sign");
+  check_string("\xed\xa0\x80", r + r + r, "high surrogate");
+  check_string("\xed\xbf\xbf", r + r + r, "low surrogate");
+  check_string("\xf4\x90\x80\x80", r + r + r + r, "code point above U+10FFFF");
+  check_string("\xf5\x80\x80\x80", r + r + r + r, "lead byte above U+10FFFF");
+  check_string("ab\xe2\x82", "ab" + r, "truncated sequence at the end");
+  check_string("\xe2\x82" "ab", r + "ab", "truncated sequence before ascii");
+  check_string("\xf0\x9f\x8e\xc3\xa9", r + "\xc3\xa9", "truncated sequence before a valid one");
+  check_string("\xc3\"", r + "\\\"", "truncated sequence before a quote");
+  check_string("text longer than a word \xfe with \xc3\xa9 and \xff",
+    "text longer than a word " + r + " with \xc3\xa9 and " + r, "mixed text");
+}
+
+} // namespace
+
+/**
+ * @brief Checks that append_json_string always writes valid json strings.
+ */
+int main() {
+  try {
+    test_escapes();
+    test_valid_utf8();
+    test_invalid_utf8();
+    std::cout << "json_writer: ok" << std::endl;
+  }
+  catch (std::exception const& e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}
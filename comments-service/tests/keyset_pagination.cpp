@@ -0,0 +1,223 @@
+#include "memory_store.hpp"
+#include "scylla_store.hpp"
+#include <nlohmann/json.hpp>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace net = boost::asio;
+
+namespace {
+
+//! Comments created in the same millisecond, more than fit in one page
+constexpr int tied_comments = 7;
+//! Comments created before and after the tied ones
+constexpr int other_comments = 3;
+//! Page size, smaller than the number of tied comments
+constexpr std::size_t per_page = 2;
+
+/**
+ * @brief Comment of a listed page.
+ */
+struct listed_comment {
+  //! Comment id
+  std::string comment_id;
+  //! Creation time
+  long long created_time = 0;
+};
+
+/**
+ * @brief Throws std::runtime_error when the condition does not hold.
+ * @param condition Checked condition
+ * @param what Description of the failure
+ */
+void check(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error(what);
+  }
+}
+
+/**
+ * @brief Runs the io_context until the store operations are completed.
+ * @param ioc io_context the handlers are invoked on
+ */
+void run(net::io_context& ioc) {
+  ioc.restart();
+  ioc.run();
+}
+
+/**
+ * @brief Inserts the comments of the entity, tied_comments of them with the
+ * same creation time. Returns the ids of the inserted comments.
+ * @param store Comment store
+ * @param ioc io_context the handlers are invoked on
+ * @param entity Entity
+ */
+std::set<std::string> insert_comments(comment_store& store, net::io_context& ioc,
+  const std::string& entity) {
+  const long long tied_time = 1700000000000;
+  std::vector<long long> times;
+  for (int i = 0; i < other_comments; ++i) {
+    times.push_back(tied_time + 1 + i);
+    times.push_back(tied_time - 1 - i);
+  }
+  times.insert(times.end(), tied_comments, tied_time);
+
+  std::set<std::string> ids;
+  for (auto created_time : times) {
+    comment_fields comment;
+    comment.entity = entity;
+    comment.comment_id = store.new_comment_id();
+    comment.author = "author";
+    comment.created_by = 1;
+    comment.text = "text";
+    comment.created_time = created_time;
+    comment.updated_time = created_time;
+
+    char id[CASS_UUID_STRING_LENGTH];
+    cass_uuid_string(comment.comment_id, id);
+    ids.insert(id);
+
+    auto status = store_status::failed;
+    store.insert(comment, ioc.get_executor(), [&](store_status s) { status = s; });
+    run(ioc);
+    check(status == store_status::ok, "Unable to insert a comment");
+  }
+  return ids;
+}
+
+/**
+ * @brief Lists one page and returns its comments and its cursor.
+ * @param store Comment store
+ * @param ioc io_context the handlers are invoked on
+ * @param request Page to list
+ * @param cursor Cursor of the next page
+ */
+std::vector<listed_comment> list_page(comment_store& store, net::io_context& ioc,
+  const page_request& request, std::string& cursor) {
+  auto status = store_status::failed;
+  page_result result;
+  store.list_page(request, ioc.get_executor(), [&](store_status s, page_result r) {
+    status = s;
+    result = std::move(r);
+  });
+  run(ioc);
+  check(status == store_status::ok, "Unable to list a page");
+
+  std::vector<listed_comment> comments;
+  for (const auto& row : nlohmann::json::parse(result.comments)) {
+    comments.push_back({row.at("comment_id").get<std::string>(),
+      row.at("created_time").get<long long>()});
+  }
+  cursor = result.next_cursor;
+  return comments;
+}
+
+/**
+ * @brief Pages through the entity and checks that every comment is listed
+ * exactly once, newest first.
+ * @param store Comment store
+ * @param ioc io_context the handlers are invoked on
+ * @param entity Entity
+ * @param expected Ids of the comments of the entity
+ * @param use_cursor Continues with the cursor instead of the keyset of the last comment
+ */
+void check_pages(comment_store& store, net::io_context& ioc, const std::string& entity,
+  const std::set<std::string>& expected, bool use_cursor) {
+  const std::string mode = use_cursor ? "cursor" : "keyset";
+  std::set<std::string> listed;
+  long long previous_time = std::numeric_limits<long long>::max();
+
+  page_request request;
+  request.entity = entity;
+  request.per_page = per_page;
+  std::string cursor;
+
+  for (std::size_t pages = 0; ; ++pages) {
+    check(pages <= expected.size(), mode + " paging does not end");
+    auto comments = list_page(store, ioc, request, cursor);
+    for (const auto& comment : comments) {
+      check(listed.insert(comment.comment_id).second,
+        mode + " paging repeats comment " + comment.comment_id);
+      check(comment.created_time <= previous_time, mode + " paging is not newest first");
+      previous_time = comment.created_time;
+    }
+
+    if (use_cursor ? cursor.empty() : comments.size() < per_page) {
+      break;
+    }
+    if (use_cursor) {
+      request.cursor = cursor;
+    } else {
+      request.has_keyset = true;
+      request.after_created_time = comments.back().created_time;
+      cass_uuid_from_string(comments.back().comment_id.c_str(), &request.after_comment_id);
+    }
+  }
+
+  check(listed == expected, mode + " paging skips comments");
+}
+
+/**
+ * @brief Inserts comments with equal creation times and pages through them
+ * with keysets and with cursors.
+ * @param store Comment store
+ * @param name Name of the store
+ * @param entity Entity, not used by other runs
+ */
+void test_store(comment_store& store, const std::string& name, const std::string& entity) {
+  net::io_context ioc;
+  auto ids = insert_comments(store, ioc, entity);
+  check_pages(store, ioc, entity, ids, false);
+  check_pages(store, ioc, entity, ids, true);
+  std::cout << name << ": ok" << std::endl;
+}
+
+} // namespace
+
+/**
+ * @brief Checks that pages of comments created in the same millisecond
+ * neither repeat nor skip comments. Runs against the memory store, and
+ * against ScyllaDB in every schema mode when COMMENTS_TEST_DB_HOSTS is set.
+ */
+int main() {
+  try {
+    log_config log;
+    log.level = boost::log::trivial::warning;
+    log.rotation_mb = 0;
+    init_log(log);
+
+    memory_store memory;
+    test_store(memory, "memory", "keyset-test");
+
+    const char* hosts = std::getenv("COMMENTS_TEST_DB_HOSTS");
+    if (hosts == nullptr) {
+      std::cout << "scylla: skipped, COMMENTS_TEST_DB_HOSTS is not set" << std::endl;
+    } else {
+      // Every run uses new entities, the comments of earlier runs are left behind.
+      db_config config;
+      config.contact_points = hosts;
+      char run_id[CASS_UUID_STRING_LENGTH];
+      cass_uuid_string(memory.new_comment_id(), run_id);
+      const std::string entity = std::string("keyset-test-") + run_id;
+      for (auto mode : {schema_mode::v1, schema_mode::v2}) {
+        config.schema = mode;
+        auto db = std::make_shared<db_session>(config);
+        db->connect();
+        auto store = std::make_shared<scylla_store>(db, insert_batch_config{});
+        const std::string name = mode == schema_mode::v1 ? "scylla v1" : "scylla v2";
+        test_store(*store, name, entity + (mode == schema_mode::v1 ? "-v1" : "-v2"));
+      }
+    }
+    stop_log();
+  }
+  catch (std::exception const& e) {
+    stop_log();
+    std::cerr << "Error: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,228 @@
+#include "request_params.hpp"
+#include <boost/asio/buffer.hpp>
+#include <cstdlib>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace http = boost::beast::http;
+
+namespace {
+
+/**
+ * @brief Throws std::runtime_error when the condition does not hold.
+ * @param condition Checked condition
+ * @param what Description of the failure
+ */
+void check(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error(what);
+  }
+}
+
+/**
+ * @brief Throws std::runtime_error unless the call throws request_error.
+ * @param call Checked call
+ * @param what Description of the malformed input
+ */
+void check_rejected(const std::function<void()>& call, const std::string& what) {
+  try {
+    call();
+  } catch (const request_error&) {
+    return;
+  }
+  throw std::runtime_error("Accepted " + what);
+}
+
+/**
+ * @brief Returns header fields with the values.
+ * @param values Header names and values
+ */
+request_fields make_headers(std::initializer_list<std::pair<const char*, const char*>> values) {
+  request_fields headers;
+  for (const auto& [name, value] : values) {
+    headers.set(name, value);
+  }
+  return headers;
+}
+
+/**
+ * @brief Malformed GET /comments headers are rejected, out of range page
+ * numbers and sizes are clamped.
+ */
+void test_get_comments_headers() {
+  auto params = parse_get_comments_params(make_headers({{"Entity", "e"},
+    {"Pagination-Page", "-5"}, {"Pagination-Per-Page", "1000"}}));
+  check(params.entity == "e" && params.page == 1 && params.per_page == 100 && !params.has_keyset,
+    "page and page size are not clamped");
+
+  check_rejected([] { parse_get_comments_params(make_headers({{"Pagination-Per-Page", "20"}})); },
+    "missing Entity");
+  check_rejected([] { parse_get_comments_params(make_headers({{"Entity", ""},
+    {"Pagination-Per-Page", "20"}})); }, "empty Entity");
+  check_rejected([] { parse_get_comments_params(make_headers({{"Entity", "e"}})); },
+    "missing Pagination-Per-Page");
+  check_rejected([] { parse_get_comments_params(make_headers({{"Entity", "e"},
+    {"Pagination-Per-Page", "abc"}})); }, "non-numeric Pagination-Per-Page");
+  check_rejected([] { parse_get_comments_params(make_headers({{"Entity", "e"},
+    {"Pagination-Per-Page", "20x"}})); }, "Pagination-Per-Page with trailing characters");
+  check_rejected([] { parse_get_comments_params(make_headers({{"Entity", "e"},
+    {"Pagination-Per-Page", "99999999999999999999"}})); }, "overflowing Pagination-Per-Page");
+  check_rejected([] { parse_get_comments_params(make_headers({{"Entity", "e"},
+    {"Pagination-Page", "1.5"}, {"Pagination-Per-Page", "20"}})); }, "fractional Pagination-Page");
+
+  const char* comment_id = "c4c1d0a2-5a4b-11ef-8000-000000000001";
+  params = parse_get_comments_params(make_headers({{"Entity", "e"}, {"Pagination-Per-Page", "20"},
+    {"Pagination-After-Created-Time", "1700000000000"}, {"Pagination-After-Comment-Id", comment_id}}));
+  check(params.has_keyset && params.after_created_time == 1700000000000, "keyset is not parsed");
+
+  check_rejected([] { parse_get_comments_params(make_headers({{"Entity", "e"},
+    {"Pagination-Per-Page", "20"}, {"Pagination-After-Created-Time", "1700000000000"}})); },
+    "keyset without Pagination-After-Comment-Id");
+  check_rejected([] { parse_get_comments_params(make_headers({{"Entity", "e"},
+    {"Pagination-Per-Page", "20"}, {"Pagination-After-Created-Time", "1700000000000"},
+    {"Pagination-After-Comment-Id", "c4c1d0a2-5a4b-11ef-8000-00000000000g"}})); },
+    "malformed Pagination-After-Comment-Id");
+  check_rejected([] { parse_get_comments_params(make_headers({{"Entity", "e"},
+    {"Pagination-Per-Page", "20"}, {"Pagination-After-Created-Time", "1700000000000"},
+    {"Pagination-After-Comment-Id", "c4c1d0a2"}})); }, "short Pagination-After-Comment-Id");
+}
+
+/**
+ * @brief Malformed headers of the write and admin requests are rejected.
+ */
+void test_other_headers() {
+  const char* comment_id = "c4c1d0a2-5a4b-11ef-8000-000000000001";
+  auto key = parse_comment_key(make_headers({{"Entity", "e"}, {"Comment_id", comment_id},
+    {"Created_time", "1700000000000"}}));
+  check(key.entity == "e" && key.comment_id_text == comment_id && key.created_time == 1700000000000,
+    "comment key is not parsed");
+
+  check_rejected([&] { parse_comment_key(make_headers({{"Entity", "e"},
+    {"Created_time", "1700000000000"}})); }, "missing Comment_id");
+  check_rejected([&] { parse_comment_key(make_headers({{"Entity", "e"}, {"Comment_id", comment_id},
+    {"Created_time", "yesterday"}})); }, "non-numeric Created_time");
+
+  auto comment = parse_new_comment_params(make_headers({{"Entity", "e"}, {"Author", "a"},
+    {"Created_by", "42"}}));
+  check(comment.author == "a" && comment.created_by == 42, "new comment headers are not parsed");
+  check_rejected([] { parse_new_comment_params(make_headers({{"Entity", "e"}, {"Author", "a"},
+    {"Created_by", "-"}})); }, "non-numeric Created_by");
+  check_rejected([] { parse_new_comment_params(make_headers({{"Entity", "e"},
+    {"Created_by", "42"}})); }, "missing Author");
+
+  check_rejected([] { parse_log_level_params(make_headers({{"Log-Level", "loud"}})); },
+    "unknown Log-Level");
+  check_rejected([] { parse_log_level_params(make_headers({})); }, "missing Log-Level");
+
+  check(parse_stream_entity("/comments/stream?x=1&entity=a%20b+c", make_headers({})) == "a b c",
+    "stream entity is not decoded");
+  check_rejected([] { parse_stream_entity("/comments/stream?entity=a%2", make_headers({})); },
+    "truncated escape");
+  check_rejected([] { parse_stream_entity("/comments/stream?entity=%zz", make_headers({})); },
+    "invalid escape");
+  check_rejected([] { parse_stream_entity("/comments/stream?entity=", make_headers({})); },
+    "empty entity parameter");
+}
+
+/**
+ * @brief The comment text is taken from the top level text member,
+ * malformed bodies are rejected.
+ */
+void test_comment_body() {
+  check(parse_comment_text(R"({"text": "hi é"})") == "hi \xc3\xa9", "text is not parsed");
+  check(parse_comment_text(R"({"other": [1, {"text": 2}], "text": "a"})") == "a",
+    "nested text member is taken");
+  check(parse_comment_text(R"({"text": "a", "text": "b"})") == "b", "last duplicated text does not win");
+  check(parse_comment_text("{}").empty(), "missing text is not empty");
+
+  check_rejected([] { parse_comment_text(""); }, "empty body");
+  check_rejected([] { parse_comment_text(R"({"text": "a")"); }, "truncated body");
+  check_rejected([] { parse_comment_text(R"({"text": "a"} x)"); }, "trailing characters");
+  check_rejected([] { parse_comment_text(R"({"text": 1})"); }, "numeric text");
+  check_rejected([] { parse_comment_text(R"({"text": null})"); }, "null text");
+  check_rejected([] { parse_comment_text(R"({"text": ["a"]})"); }, "array text");
+  check_rejected([] { parse_comment_text(R"({"text": {"a": 1}})"); }, "object text");
+  check_rejected([] { parse_comment_text(R"(["text", "a"])"); }, "array body");
+  check_rejected([] { parse_comment_text(R"("text")"); }, "string body");
+}
+
+/**
+ * @brief Malformed POST /comments/bulk bodies are rejected, duplicated
+ * entities are dropped.
+ */
+void test_bulk_body() {
+  auto params = parse_bulk_params(nlohmann::json::parse(
+    R"({"entities": ["a", "b", "a"], "limit": 500})"), 3);
+  check(params.entities.size() == 2 && params.limit == 100, "bulk body is not parsed");
+
+  auto parse = [](const char* body) { parse_bulk_params(nlohmann::json::parse(body), 3); };
+  check_rejected([&] { parse(R"({"limit": 5})"); }, "missing entities");
+  check_rejected([&] { parse(R"({"entities": [], "limit": 5})"); }, "empty entities");
+  check_rejected([&] { parse(R"({"entities": "a", "limit": 5})"); }, "string entities");
+  check_rejected([&] { parse(R"({"entities": ["a", "b", "c", "d"], "limit": 5})"); },
+    "too many entities");
+  check_rejected([&] { parse(R"({"entities": ["a", 1], "limit": 5})"); }, "numeric entity");
+  check_rejected([&] { parse(R"({"entities": ["a", ""], "limit": 5})"); }, "empty entity");
+  check_rejected([&] { parse(R"({"entities": ["a"]})"); }, "missing limit");
+  check_rejected([&] { parse(R"({"entities": ["a"], "limit": 1.5})"); }, "fractional limit");
+}
+
+/**
+ * @brief Feeds the request to a parser limited to limit body bytes and
+ * returns the error of the parse.
+ * @param request Serialized request
+ * @param limit Body size limit
+ */
+boost::beast::error_code parse_limited(const std::string& request, std::size_t limit) {
+  request_parser parser;
+  parser.body_limit(limit);
+  parser.eager(true);
+  boost::beast::error_code ec;
+  auto consumed = parser.put(boost::asio::buffer(request), ec);
+  if (!ec && !parser.is_done()) {
+    check(consumed == request.size(), "request is not consumed");
+    ec = http::error::need_more;
+  }
+  return ec;
+}
+
+/**
+ * @brief Bodies over the limit are rejected, with a Content-Length before
+ * the body is read.
+ */
+void test_body_limit() {
+  check(!parse_limited("POST /comments/make HTTP/1.1\r\nContent-Length: 4\r\n\r\nabcd", 4),
+    "body at the limit is rejected");
+  check(parse_limited("POST /comments/make HTTP/1.1\r\nContent-Length: 5\r\n\r\n", 4) ==
+    http::error::body_limit, "Content-Length over the limit is not rejected with the header");
+  check(parse_limited("POST /comments/make HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+    "3\r\nabc\r\n2\r\nde\r\n0\r\n\r\n", 4) == http::error::body_limit,
+    "chunked body over the limit is not rejected");
+  check(!parse_limited("POST /comments/make HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+    "2\r\nab\r\n2\r\ncd\r\n0\r\n\r\n", 4), "chunked body at the limit is rejected");
+}
+
+} // namespace
+
+/**
+ * @brief Checks that malformed headers and bodies are rejected with
+ * request_error and that the body size limit holds.
+ */
+int main() {
+  try {
+    test_get_comments_headers();
+    test_other_headers();
+    test_comment_body();
+    test_bulk_body();
+    test_body_limit();
+    std::cout << "request_params: ok" << std::endl;
+  }
+  catch (std::exception const& e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}
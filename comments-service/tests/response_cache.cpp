@@ -0,0 +1,145 @@
+#include "response_cache.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+/**
+ * @brief Throws std::runtime_error when the condition does not hold.
+ * @param condition Checked condition
+ * @param what Description of the failure
+ */
+void check(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error(what);
+  }
+}
+
+/**
+ * @brief Returns a page with a body of the size.
+ * @param bytes Body size
+ */
+std::shared_ptr<const cached_page> make_page(std::size_t bytes) {
+  auto page = std::make_shared<cached_page>();
+  page->body.assign(bytes, 'x');
+  page->total_rows = 1;
+  return page;
+}
+
+/**
+ * @brief Returns settings of a single shard cache, so all entities share one LRU.
+ * @param max_bytes Upper bound of the cached bodies size
+ */
+cache_config single_shard(std::size_t max_bytes) {
+  cache_config config;
+  config.max_bytes = max_bytes;
+  config.shards = 1;
+  config.ttl = std::chrono::minutes(1);
+  return config;
+}
+
+/**
+ * @brief Inserts a page with the current generation of the entity.
+ * @param cache Cache
+ * @param entity Entity
+ * @param bytes Body size
+ */
+void put(response_cache& cache, const std::string& entity, std::size_t bytes) {
+  cache.insert(entity, 1, 20, cache.generation(entity), make_page(bytes));
+}
+
+/**
+ * @brief The least recently used entity is evicted when the cache grows
+ * over max_bytes, a lookup makes an entity the most recently used one.
+ */
+void test_eviction() {
+  response_cache cache(single_shard(300));
+  put(cache, "a", 100);
+  put(cache, "b", 100);
+  put(cache, "c", 100);
+  check(cache.evictions() == 0, "eviction under max_bytes");
+
+  check(cache.find("a", 1, 20) != nullptr, "page is not cached");
+  put(cache, "d", 100);
+  check(cache.evictions() == 1, "evictions after one insert over max_bytes");
+  check(cache.find("b", 1, 20) == nullptr, "least recently used entity is not evicted");
+  check(cache.find("a", 1, 20) != nullptr, "recently used entity is evicted");
+  check(cache.find("c", 1, 20) != nullptr, "entity c is evicted");
+  check(cache.find("d", 1, 20) != nullptr, "inserted entity is evicted");
+
+  // Pages of one entity are evicted together.
+  cache.insert("a", 2, 20, cache.generation("a"), make_page(100));
+  check(cache.find("c", 1, 20) == nullptr, "entity c is not evicted");
+  check(cache.find("a", 1, 20) != nullptr && cache.find("a", 2, 20) != nullptr,
+    "page of the recently used entity is evicted");
+
+  put(cache, "e", 301);
+  check(cache.find("e", 1, 20) == nullptr, "page over max_bytes is cached");
+
+  check(cache.hits() == 6 && cache.misses() == 3, "hits and misses");
+}
+
+/**
+ * @brief A page read before its entity was invalidated is not cached.
+ */
+void test_stale_generation() {
+  response_cache cache(single_shard(1000));
+  put(cache, "a", 10);
+
+  auto generation = cache.generation("a");
+  cache.invalidate("a");
+  check(cache.find("a", 1, 20) == nullptr, "invalidated page is served");
+
+  cache.insert("a", 1, 20, generation, make_page(10));
+  check(cache.find("a", 1, 20) == nullptr, "stale generation insert is cached");
+
+  put(cache, "a", 10);
+  check(cache.find("a", 1, 20) != nullptr, "current generation insert is dropped");
+
+  // The generation belongs to the shard, a write to another entity of the
+  // shard also drops the page.
+  generation = cache.generation("a");
+  cache.invalidate("b");
+  cache.insert("a", 2, 20, generation, make_page(10));
+  check(cache.find("a", 2, 20) == nullptr, "insert after a shard invalidation is cached");
+}
+
+/**
+ * @brief Pages expire after ttl and only the first pages are cacheable.
+ */
+void test_expiry() {
+  auto config = single_shard(1000);
+  config.ttl = std::chrono::milliseconds(0);
+  response_cache cache(config);
+  put(cache, "a", 10);
+  check(cache.find("a", 1, 20) == nullptr, "expired page is served");
+
+  check(cache.cacheable(1, 20) && cache.cacheable(config.max_page, 20), "first pages are not cacheable");
+  check(!cache.cacheable(0, 20) && !cache.cacheable(config.max_page + 1, 20),
+    "page out of range is cacheable");
+
+  config.max_bytes = 0;
+  check(!response_cache(config).cacheable(1, 20), "disabled cache is cacheable");
+}
+
+} // namespace
+
+/**
+ * @brief Checks the eviction, invalidation and expiry of the response cache.
+ */
+int main() {
+  try {
+    test_eviction();
+    test_stale_generation();
+    test_expiry();
+    std::cout << "response_cache: ok" << std::endl;
+  }
+  catch (std::exception const& e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}
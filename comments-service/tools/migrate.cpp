@@ -0,0 +1,386 @@
+#include "db_session.hpp"
+#include <algorithm>
+#include <charconv>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+using future_ptr = std::unique_ptr<CassFuture, decltype(&cass_future_free)>;
+
+/**
+ * @brief Schema migration.
+ */
+struct migration {
+  //! Version reached by the migration
+  int version;
+  //! Description stored in schema_migrations
+  const char* description;
+  //! Applies the migration
+  std::function<void(CassSession*)> apply;
+};
+
+/**
+ * @brief Waits for the future and throws std::runtime_error if it failed.
+ * @param future CassFuture object
+ * @param what Description of the request for the error message
+ */
+future_ptr wait(CassFuture* future, std::string_view what) {
+  future_ptr result(future, &cass_future_free);
+  if(cass_future_error_code(result.get()) != CASS_OK) {
+    const char* message;
+    size_t message_length;
+    cass_future_error_message(result.get(), &message, &message_length);
+    throw std::runtime_error(std::string(what) + ": " + std::string(message, message_length));
+  }
+  return result;
+}
+
+/**
+ * @brief Runs a query without parameters, blocking until done.
+ * @param session db session
+ * @param query CQL query
+ */
+result_ptr execute(CassSession* session, const char* query) {
+  statement_ptr statement(cass_statement_new(query, 0), &cass_statement_free);
+  auto future = wait(cass_session_execute(session, statement.get()), query);
+  return result_ptr(cass_future_get_result(future.get()), &cass_result_free);
+}
+
+/**
+ * @brief Prepares a query, blocking until done.
+ * @param session db session
+ * @param query CQL query
+ */
+std::unique_ptr<const CassPrepared, decltype(&cass_prepared_free)> prepare(
+  CassSession* session, const char* query) {
+  auto future = wait(cass_session_prepare(session, query), query);
+  return {cass_future_get_prepared(future.get()), &cass_prepared_free};
+}
+
+/**
+ * @brief Copies the value of a comment column into the statement, null values stay unset.
+ * @param statement Insert statement
+ * @param index Parameter index
+ * @param value Column value
+ */
+void copy_value(CassStatement* statement, size_t index, const CassValue* value) {
+  if(value == nullptr || cass_value_is_null(value)) {
+    return;
+  }
+  switch(cass_value_type(value)) {
+    case CASS_VALUE_TYPE_UUID: {
+      CassUuid uuid;
+      cass_value_get_uuid(value, &uuid);
+      cass_statement_bind_uuid(statement, index, uuid);
+      break;
+    }
+    case CASS_VALUE_TYPE_BIGINT: {
+      cass_int64_t number;
+      cass_value_get_int64(value, &number);
+      cass_statement_bind_int64(statement, index, number);
+      break;
+    }
+    default: {
+      const char* text;
+      size_t text_length;
+      cass_value_get_string(value, &text, &text_length);
+      cass_statement_bind_string_n(statement, index, text, text_length);
+      break;
+    }
+  }
+}
+
+/**
+ * @brief Creates the comments_live table.
+ * @param session db session
+ */
+void create_live_table(CassSession* session) {
+  execute(session,
+    "CREATE TABLE IF NOT EXISTS keyspace_comments.comments_live ("
+    "entity text, comment_id uuid, author text, text text, created_by bigint, "
+    "created_time bigint, updated_time bigint, "
+    "PRIMARY KEY ((entity), created_time, comment_id)) "
+    "WITH CLUSTERING ORDER BY (created_time DESC, comment_id DESC)");
+}
+
+/**
+ * @brief Copies the comments that are not deleted into comments_live.
+ *
+ * Rows are written with the write time of the source row, so changes and
+ * deletes dual-written by the service while the copy runs are not undone.
+ * @param session db session
+ */
+void backfill_live_table(CassSession* session) {
+  constexpr int page_size = 1000;
+
+  auto insert = prepare(session,
+    "INSERT INTO keyspace_comments.comments_live (entity, created_time, comment_id, "
+    "author, created_by, text, updated_time) VALUES (?, ?, ?, ?, ?, ?, ?) "
+    "USING TIMESTAMP ?");
+
+  statement_ptr scan(cass_statement_new(
+    "SELECT entity, created_time, comment_id, author, created_by, text, updated_time, "
+    "deleted, WRITETIME(text) FROM keyspace_comments.comments", 0), &cass_statement_free);
+  cass_statement_set_paging_size(scan.get(), page_size);
+
+  long long copied = 0;
+  long long skipped = 0;
+  for(;;) {
+    auto page_future = wait(cass_session_execute(session, scan.get()), "Unable to scan comments");
+    result_ptr page(cass_future_get_result(page_future.get()), &cass_result_free);
+
+    std::vector<future_ptr> inserts;
+    inserts.reserve(page_size);
+
+    auto rows = std::unique_ptr<CassIterator,
+      decltype(&cass_iterator_free)>(cass_iterator_from_result(page.get()), &cass_iterator_free);
+    while(cass_iterator_next(rows.get())) {
+      auto row = cass_iterator_get_row(rows.get());
+
+      cass_bool_t deleted = cass_false;
+      auto deleted_value = cass_row_get_column(row, 7);
+      if(!cass_value_is_null(deleted_value)) {
+        cass_value_get_bool(deleted_value, &deleted);
+      }
+      if(deleted == cass_true) {
+        ++skipped;
+        continue;
+      }
+
+      statement_ptr statement(cass_prepared_bind(insert.get()), &cass_statement_free);
+      for(size_t i = 0; i < 7; ++i) {
+        copy_value(statement.get(), i, cass_row_get_column(row, i));
+      }
+      cass_int64_t write_time = 0;
+      cass_value_get_int64(cass_row_get_column(row, 8), &write_time);
+      cass_statement_bind_int64(statement.get(), 7, write_time);
+
+      inserts.emplace_back(cass_session_execute(session, statement.get()), &cass_future_free);
+    }
+
+    for(auto& future : inserts) {
+      wait(future.release(), "Unable to copy comment");
+      ++copied;
+    }
+
+    if(cass_result_has_more_pages(page.get()) != cass_true) {
+      break;
+    }
+    cass_statement_set_paging_state(scan.get(), page.get());
+    BOOST_LOG_TRIVIAL(info)
+      << "Copied " << copied << " comments";
+  }
+
+  BOOST_LOG_TRIVIAL(info)
+    << "Copied " << copied << " comments, skipped " << skipped << " deleted comments";
+}
+
+/**
+ * @brief Creates the comment_counters table, which clusters initialized
+ * before the counters were added do not have.
+ * @param session db session
+ */
+void create_counter_table(CassSession* session) {
+  execute(session,
+    "CREATE TABLE IF NOT EXISTS keyspace_comments.comment_counters ("
+    "entity text PRIMARY KEY, live counter)");
+}
+
+/**
+ * @brief Sets the counter of every entity to the number of its comments
+ * that are not deleted.
+ *
+ * Counters can only be incremented, so the difference to the current value
+ * is added. Comments added or deleted while the migration runs may be
+ * counted twice or not at all, the migration is meant to run while writes
+ * are stopped.
+ * @param session db session
+ */
+void backfill_counters(CassSession* session) {
+  constexpr int page_size = 1000;
+
+  std::unordered_map<std::string, long long> live;
+  statement_ptr scan(cass_statement_new(
+    "SELECT entity, deleted FROM keyspace_comments.comments", 0), &cass_statement_free);
+  cass_statement_set_paging_size(scan.get(), page_size);
+
+  for(;;) {
+    auto page_future = wait(cass_session_execute(session, scan.get()), "Unable to scan comments");
+    result_ptr page(cass_future_get_result(page_future.get()), &cass_result_free);
+
+    auto rows = std::unique_ptr<CassIterator,
+      decltype(&cass_iterator_free)>(cass_iterator_from_result(page.get()), &cass_iterator_free);
+    while(cass_iterator_next(rows.get())) {
+      auto row = cass_iterator_get_row(rows.get());
+
+      const char* entity;
+      size_t entity_length;
+      cass_value_get_string(cass_row_get_column(row, 0), &entity, &entity_length);
+      auto& count = live[std::string(entity, entity_length)];
+
+      cass_bool_t deleted = cass_false;
+      auto deleted_value = cass_row_get_column(row, 1);
+      if(!cass_value_is_null(deleted_value)) {
+        cass_value_get_bool(deleted_value, &deleted);
+      }
+      if(deleted != cass_true) {
+        ++count;
+      }
+    }
+
+    if(cass_result_has_more_pages(page.get()) != cass_true) {
+      break;
+    }
+    cass_statement_set_paging_state(scan.get(), page.get());
+  }
+
+  auto select = prepare(session,
+    "SELECT live FROM keyspace_comments.comment_counters WHERE entity = ?");
+  auto update = prepare(session,
+    "UPDATE keyspace_comments.comment_counters SET live = live + ? WHERE entity = ?");
+
+  long long corrected = 0;
+  for(const auto& [entity, count] : live) {
+    statement_ptr current(cass_prepared_bind(select.get()), &cass_statement_free);
+    cass_statement_bind_string_n(current.get(), 0, entity.data(), entity.size());
+    auto current_future = wait(cass_session_execute(session, current.get()),
+      "Unable to read comment counter");
+    result_ptr result(cass_future_get_result(current_future.get()), &cass_result_free);
+
+    cass_int64_t counted = 0;
+    if(auto row = cass_result_first_row(result.get())) {
+      cass_value_get_int64(cass_row_get_column(row, 0), &counted);
+    }
+    if(counted == count) {
+      continue;
+    }
+
+    // A counter update is not idempotent, it is not retried.
+    statement_ptr statement(cass_prepared_bind(update.get()), &cass_statement_free);
+    cass_statement_bind_int64(statement.get(), 0, count - counted);
+    cass_statement_bind_string_n(statement.get(), 1, entity.data(), entity.size());
+    cass_statement_set_is_idempotent(statement.get(), cass_false);
+    wait(cass_session_execute(session, statement.get()), "Unable to update comment counter");
+    ++corrected;
+  }
+
+  BOOST_LOG_TRIVIAL(info)
+    << "Counted comments of " << live.size() << " entities, corrected "
+    << corrected << " counters";
+}
+
+//! Migrations in version order, version 1 is scylla-init.txt
+const std::vector<migration> migrations = {
+  {2, "create comments_live", create_live_table},
+  {3, "backfill comments_live", backfill_live_table},
+  {4, "create comment_counters", create_counter_table},
+  {5, "backfill comment_counters", backfill_counters}
+};
+
+/**
+ * @brief Returns the latest applied version, 1 when no migration was applied.
+ * @param session db session
+ */
+int current_version(CassSession* session) {
+  execute(session,
+    "CREATE TABLE IF NOT EXISTS keyspace_comments.schema_migrations ("
+    "version int PRIMARY KEY, description text, applied_at bigint)");
+
+  auto result = execute(session, "SELECT version FROM keyspace_comments.schema_migrations");
+  int version = 1;
+  auto rows = std::unique_ptr<CassIterator,
+    decltype(&cass_iterator_free)>(cass_iterator_from_result(result.get()), &cass_iterator_free);
+  while(cass_iterator_next(rows.get())) {
+    cass_int32_t applied;
+    cass_value_get_int32(cass_row_get_column(cass_iterator_get_row(rows.get()), 0), &applied);
+    version = std::max(version, static_cast<int>(applied));
+  }
+  return version;
+}
+
+/**
+ * @brief Records the migration as applied.
+ * @param session db session
+ * @param m Applied migration
+ */
+void record(CassSession* session, const migration& m) {
+  statement_ptr statement(cass_statement_new(
+    "INSERT INTO keyspace_comments.schema_migrations (version, description, applied_at) "
+    "VALUES (?, ?, toUnixTimestamp(now()))", 2), &cass_statement_free);
+  cass_statement_bind_int32(statement.get(), 0, m.version);
+  cass_statement_bind_string(statement.get(), 1, m.description);
+  wait(cass_session_execute(session, statement.get()), "Unable to record migration");
+}
+
+/**
+ * @brief Prints command line usage.
+ * @param program Program name
+ */
+void print_usage(const char* program) {
+  std::cerr << "Usage: " << program << " <db hosts> [target version]\n";
+  std::cerr << "  Applies the schema migrations up to the target version, all by default.\n";
+  std::cerr << "Versions:\n";
+  std::cerr << "  1  scylla-init.txt\n";
+  for(const auto& m : migrations) {
+    std::cerr << "  " << m.version << "  " << m.description << "\n";
+  }
+}
+
+} // namespace
+
+/**
+ * @brief Applies the pending schema migrations.
+ */
+int main(int argc, char* argv[]) {
+  if(argc < 2 || argc > 3) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  int target = migrations.back().version;
+  if(argc == 3) {
+    std::string_view value = argv[2];
+    auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), target);
+    if(ec != std::errc() || ptr != value.data() + value.size()) {
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  try {
+    log_config log;
+    log.rotation_mb = 0;
+    init_log(log);
+
+    db_config config;
+    config.contact_points = argv[1];
+    db_session db(config);
+    db.connect();
+
+    auto version = current_version(db.get());
+    BOOST_LOG_TRIVIAL(info)
+      << "Schema version: " << version;
+
+    for(const auto& m : migrations) {
+      if(m.version <= version || m.version > target) {
+        continue;
+      }
+      BOOST_LOG_TRIVIAL(info)
+        << "Applying migration " << m.version << ": " << m.description;
+      m.apply(db.get());
+      record(db.get(), m);
+    }
+    stop_log();
+  }
+  catch(std::exception const& e) {
+    stop_log();
+    std::cerr << "Error: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}